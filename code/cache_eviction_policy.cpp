@@ -0,0 +1,150 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "cache_eviction_policy.h"
+
+#include <algorithm>
+#include <assert.h>
+
+using std::string;
+
+CacheEvictionPolicy *CacheEvictionPolicy::create(const string &name) {
+  if (name == "LRU") {
+    return new LruEvictionPolicy();
+  }
+  if (name == "2Q") {
+    return new TwoQueueEvictionPolicy();
+  }
+  return nullptr;
+}
+
+void LruEvictionPolicy::onInsert(int key) {
+  assert(mPositions.find(key) == mPositions.end());
+  mKeys.push_front(key);
+  mPositions[key] = mKeys.begin();
+}
+
+void LruEvictionPolicy::onAccess(int key) {
+  auto it = mPositions.find(key);
+  assert(it != mPositions.end());
+  mKeys.splice(mKeys.begin(), mKeys, it->second);
+}
+
+void LruEvictionPolicy::onRemove(int key) {
+  auto it = mPositions.find(key);
+  assert(it != mPositions.end());
+  mKeys.erase(it->second);
+  mPositions.erase(it);
+}
+
+int LruEvictionPolicy::chooseVictim(const std::function<bool(int)> &canEvict) const {
+  for (auto it = mKeys.rbegin(); it != mKeys.rend(); ++it) {
+    if (canEvict(*it)) {
+      return *it;
+    }
+  }
+  return NO_VICTIM;
+}
+
+// Sizes of the queues, as suggested by Johnson and Shasha, relative to
+// the number of entries in the cache.  We don't know the capacity of the
+// cache in entries, since it may be limited by bytes instead.
+static const int IN_QUEUE_DIVISOR = 4;
+static const int GHOST_QUEUE_DIVISOR = 2;
+static const int MIN_GHOSTS = 4;
+
+TwoQueueEvictionPolicy::TwoQueueEvictionPolicy() {
+}
+
+void TwoQueueEvictionPolicy::onInsert(int key) {
+  assert(mPositions.find(key) == mPositions.end());
+  Position position;
+  auto ghost = mGhostPositions.find(key);
+  if (ghost != mGhostPositions.end()) {
+    // Seen recently, so it's likely to be used again
+    mGhosts.erase(ghost->second);
+    mGhostPositions.erase(ghost);
+    mMain.push_front(key);
+    position.queue = MAIN;
+    position.it = mMain.begin();
+  } else {
+    mIn.push_front(key);
+    position.queue = IN;
+    position.it = mIn.begin();
+  }
+  mPositions[key] = position;
+}
+
+void TwoQueueEvictionPolicy::onAccess(int key) {
+  auto it = mPositions.find(key);
+  assert(it != mPositions.end());
+  // Hits in the FIFO don't count; they're usually correlated references
+  // from the same piece of work.
+  if (it->second.queue == MAIN) {
+    mMain.splice(mMain.begin(), mMain, it->second.it);
+  }
+}
+
+void TwoQueueEvictionPolicy::onRemove(int key) {
+  auto it = mPositions.find(key);
+  assert(it != mPositions.end());
+  if (it->second.queue == MAIN) {
+    mMain.erase(it->second.it);
+  } else {
+    mIn.erase(it->second.it);
+    mGhosts.push_front(key);
+    mGhostPositions[key] = mGhosts.begin();
+  }
+  mPositions.erase(it);
+
+  size_t maxGhosts = std::max(mPositions.size() / GHOST_QUEUE_DIVISOR, (size_t) MIN_GHOSTS);
+  while (mGhosts.size() > maxGhosts) {
+    mGhostPositions.erase(mGhosts.back());
+    mGhosts.pop_back();
+  }
+}
+
+int TwoQueueEvictionPolicy::chooseVictim(const std::function<bool(int)> &canEvict) const {
+  int victim = NO_VICTIM;
+  if (mIn.size() > std::max(mPositions.size() / IN_QUEUE_DIVISOR, (size_t) 1)) {
+    victim = pickFrom(mIn, canEvict);
+  }
+  if (victim == NO_VICTIM) {
+    victim = pickFrom(mMain, canEvict);
+  }
+  if (victim == NO_VICTIM) {
+    victim = pickFrom(mIn, canEvict);
+  }
+  return victim;
+}
+
+int TwoQueueEvictionPolicy::pickFrom(const std::list<int> &queue,
+                                     const std::function<bool(int)> &canEvict) const {
+  for (auto it = queue.rbegin(); it != queue.rend(); ++it) {
+    if (canEvict(*it)) {
+      return *it;
+    }
+  }
+  return NO_VICTIM;
+}
@@ -0,0 +1,109 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _CACHE_EVICTION_POLICY_H_
+#define _CACHE_EVICTION_POLICY_H_
+
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+// Decides which entry of a cache to evict next.  The cache tells the
+// policy about every insertion, hit and removal, identified by integer
+// keys.  Policies aren't thread-safe; the cache must serialize calls.
+
+class CacheEvictionPolicy {
+public:
+  virtual ~CacheEvictionPolicy() {}
+
+  // A new entry was added to the cache.
+  virtual void onInsert(int key) = 0;
+
+  // An existing entry was looked up.
+  virtual void onAccess(int key) = 0;
+
+  // An entry was evicted from the cache.
+  virtual void onRemove(int key) = 0;
+
+  // Return the key of the entry to evict next, skipping entries for which
+  // canEvict returns false.  Return NO_VICTIM if there are none.
+  virtual int chooseVictim(const std::function<bool(int)> &canEvict) const = 0;
+
+  static const int NO_VICTIM = -1000000;
+
+  // Return a new policy with the given name ("LRU" or "2Q"), or nullptr if
+  // the name is unknown.
+  static CacheEvictionPolicy *create(const std::string &name);
+};
+
+// Evict the least recently used entry.
+
+class LruEvictionPolicy : public CacheEvictionPolicy {
+public:
+  virtual void onInsert(int key);
+  virtual void onAccess(int key);
+  virtual void onRemove(int key);
+  virtual int chooseVictim(const std::function<bool(int)> &canEvict) const;
+
+private:
+  // Most recently used first
+  std::list<int> mKeys;
+  std::unordered_map<int, std::list<int>::iterator> mPositions;
+};
+
+// The "full 2Q" policy of Johnson and Shasha.  New entries go into a FIFO
+// queue.  Entries evicted from the FIFO are remembered for a while, and
+// if they're loaded again they go into an LRU queue of entries known to
+// be used repeatedly.  A scan through many entries that are used only
+// once (like isolation's outer rings of neighbors) can then only flush
+// the FIFO, not the frequently used entries.
+
+class TwoQueueEvictionPolicy : public CacheEvictionPolicy {
+public:
+  TwoQueueEvictionPolicy();
+
+  virtual void onInsert(int key);
+  virtual void onAccess(int key);
+  virtual void onRemove(int key);
+  virtual int chooseVictim(const std::function<bool(int)> &canEvict) const;
+
+private:
+  enum Queue { IN, MAIN };
+
+  struct Position {
+    Queue queue;
+    std::list<int>::iterator it;
+  };
+
+  std::list<int> mIn;      // Entries seen once, newest first
+  std::list<int> mMain;    // Entries seen repeatedly, most recently used first
+  std::list<int> mGhosts;  // Keys recently evicted from mIn, newest first
+  std::unordered_map<int, Position> mPositions;
+  std::unordered_map<int, std::list<int>::iterator> mGhostPositions;
+
+  int pickFrom(const std::list<int> &queue, const std::function<bool(int)> &canEvict) const;
+};
+
+#endif  // _CACHE_EVICTION_POLICY_H_
@@ -0,0 +1,280 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "cache_stats.h"
+#include "easylogging++.h"
+
+#include <chrono>
+#include <stdio.h>
+
+using std::string;
+
+LatencyHistogram::LatencyHistogram()
+    : mCount(0),
+      mTotalMicros(0),
+      mMaxMicros(0) {
+  for (int i = 0; i < NUM_BUCKETS; ++i) {
+    mBuckets[i] = 0;
+  }
+}
+
+void LatencyHistogram::record(double seconds) {
+  uint64 micros = static_cast<uint64>(seconds * 1e6);
+  int bucket = 0;
+  while (bucket < NUM_BUCKETS - 1 && (micros >> bucket) != 0) {
+    bucket += 1;
+  }
+  ++mBuckets[bucket];
+  ++mCount;
+  mTotalMicros += micros;
+
+  uint64 oldMax = mMaxMicros.load();
+  while (micros > oldMax && !mMaxMicros.compare_exchange_weak(oldMax, micros)) {
+  }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+  Snapshot snapshot;
+  snapshot.count = mCount.load();
+  snapshot.totalSeconds = mTotalMicros.load() / 1e6;
+  snapshot.maxSeconds = mMaxMicros.load() / 1e6;
+  for (int i = 0; i < NUM_BUCKETS; ++i) {
+    snapshot.buckets[i] = mBuckets[i].load();
+  }
+  return snapshot;
+}
+
+double LatencyHistogram::bucketLimitSeconds(int bucket) {
+  return static_cast<double>(static_cast<uint64>(1) << bucket) / 1e6;
+}
+
+double LatencyHistogram::Snapshot::meanSeconds() const {
+  return (count == 0) ? 0 : totalSeconds / count;
+}
+
+double LatencyHistogram::Snapshot::percentileSeconds(double fraction) const {
+  uint64 total = 0;
+  for (int i = 0; i < NUM_BUCKETS; ++i) {
+    total += buckets[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  // Counts were read one by one, so may not add up to count
+  uint64 target = static_cast<uint64>(fraction * total);
+  uint64 seen = 0;
+  for (int i = 0; i < NUM_BUCKETS; ++i) {
+    seen += buckets[i];
+    if (seen > target) {
+      return bucketLimitSeconds(i);
+    }
+  }
+  return bucketLimitSeconds(NUM_BUCKETS - 1);
+}
+
+CacheStats::CacheStats()
+    : mHits(0),
+      mMisses(0),
+      mSharedLoads(0),
+      mUncachedLoads(0),
+      mMissingTiles(0),
+      mEvictions(0),
+      mEvictedBytes(0),
+      mBytesResident(0),
+      mPeakBytesResident(0),
+      mLockWaits(0),
+      mLockWaitMicros(0) {
+}
+
+CacheStats::~CacheStats() {
+  for (auto &it : mLoadLatencies) {
+    delete it.second;
+  }
+}
+
+void CacheStats::addEviction(size_t numBytes) {
+  ++mEvictions;
+  mEvictedBytes += numBytes;
+}
+
+void CacheStats::addLockWait(double seconds) {
+  ++mLockWaits;
+  mLockWaitMicros += static_cast<uint64>(seconds * 1e6);
+}
+
+void CacheStats::setBytesResident(size_t numBytes) {
+  mBytesResident = numBytes;
+  uint64 oldPeak = mPeakBytesResident.load();
+  while (numBytes > oldPeak && !mPeakBytesResident.compare_exchange_weak(oldPeak, numBytes)) {
+  }
+}
+
+LatencyHistogram *CacheStats::loadLatency(const string &formatName) {
+  mLock.lock();
+  LatencyHistogram *&histogram = mLoadLatencies[formatName];
+  if (histogram == nullptr) {
+    histogram = new LatencyHistogram();
+  }
+  LatencyHistogram *retval = histogram;
+  mLock.unlock();
+  return retval;
+}
+
+void CacheStats::print(FILE *file) {
+  const double megabyte = 1024.0 * 1024.0;
+  uint64 hits = mHits.load();
+  uint64 lookups = hits + mMisses.load() + mSharedLoads.load();
+  fprintf(file, "Tile cache: %llu hits, %llu misses, %llu shared loads (hit rate %.1f%%)\n",
+          (unsigned long long) hits, (unsigned long long) mMisses.load(),
+          (unsigned long long) mSharedLoads.load(),
+          (lookups == 0) ? 0.0 : 100.0 * hits / lookups);
+  fprintf(file, "Tile cache: %llu uncached loads, %llu missing tiles, %llu evictions (%.1f MB)\n",
+          (unsigned long long) mUncachedLoads.load(), (unsigned long long) mMissingTiles.load(),
+          (unsigned long long) mEvictions.load(), mEvictedBytes.load() / megabyte);
+  fprintf(file, "Tile cache: %.1f MB resident, peak %.1f MB; lock contended %llu times, waited %.3fs\n",
+          mBytesResident.load() / megabyte, mPeakBytesResident.load() / megabyte,
+          (unsigned long long) mLockWaits.load(), mLockWaitMicros.load() / 1e6);
+
+  mLock.lock();
+  for (auto &it : mLoadLatencies) {
+    LatencyHistogram::Snapshot latency = it.second->snapshot();
+    fprintf(file, "Tile loads (%s): %llu, mean %.1fms, p50 < %.1fms, p90 < %.1fms, "
+            "p99 < %.1fms, max %.1fms\n",
+            it.first.c_str(), (unsigned long long) latency.count,
+            latency.meanSeconds() * 1000,
+            latency.percentileSeconds(0.5) * 1000,
+            latency.percentileSeconds(0.9) * 1000,
+            latency.percentileSeconds(0.99) * 1000,
+            latency.maxSeconds * 1000);
+  }
+  mLock.unlock();
+}
+
+string CacheStats::toJson() {
+  char buffer[512];
+  snprintf(buffer, sizeof(buffer),
+           "{\"hits\": %llu, \"misses\": %llu, \"sharedLoads\": %llu, "
+           "\"uncachedLoads\": %llu, \"missingTiles\": %llu, "
+           "\"evictions\": %llu, \"evictedBytes\": %llu, "
+           "\"bytesResident\": %llu, \"peakBytesResident\": %llu, "
+           "\"lockWaits\": %llu, \"lockWaitSeconds\": %.6f, "
+           "\"loadLatency\": {",
+           (unsigned long long) mHits.load(), (unsigned long long) mMisses.load(),
+           (unsigned long long) mSharedLoads.load(), (unsigned long long) mUncachedLoads.load(),
+           (unsigned long long) mMissingTiles.load(), (unsigned long long) mEvictions.load(),
+           (unsigned long long) mEvictedBytes.load(), (unsigned long long) mBytesResident.load(),
+           (unsigned long long) mPeakBytesResident.load(), (unsigned long long) mLockWaits.load(),
+           mLockWaitMicros.load() / 1e6);
+  string json(buffer);
+
+  mLock.lock();
+  bool first = true;
+  for (auto &it : mLoadLatencies) {
+    LatencyHistogram::Snapshot latency = it.second->snapshot();
+    snprintf(buffer, sizeof(buffer),
+             "%s\"%s\": {\"count\": %llu, \"totalSeconds\": %.6f, \"maxSeconds\": %.6f, "
+             "\"bucketLimitsSeconds\": [",
+             first ? "" : ", ", it.first.c_str(), (unsigned long long) latency.count,
+             latency.totalSeconds, latency.maxSeconds);
+    json += buffer;
+    for (int i = 0; i < LatencyHistogram::NUM_BUCKETS; ++i) {
+      snprintf(buffer, sizeof(buffer), "%s%g", (i == 0) ? "" : ", ",
+               LatencyHistogram::bucketLimitSeconds(i));
+      json += buffer;
+    }
+    json += "], \"buckets\": [";
+    for (int i = 0; i < LatencyHistogram::NUM_BUCKETS; ++i) {
+      snprintf(buffer, sizeof(buffer), "%s%llu", (i == 0) ? "" : ", ",
+               (unsigned long long) latency.buckets[i]);
+      json += buffer;
+    }
+    json += "]}";
+    first = false;
+  }
+  mLock.unlock();
+
+  json += "}}";
+  return json;
+}
+
+CacheStatsReporter::CacheStatsReporter(CacheStats *stats, int intervalSeconds,
+                                       const string &jsonFilename)
+    : mStats(stats),
+      mIntervalSeconds(intervalSeconds),
+      mJsonFilename(jsonFilename),
+      mStarted(false),
+      mStopping(false) {
+}
+
+CacheStatsReporter::~CacheStatsReporter() {
+  if (mStarted) {
+    stop();
+  }
+}
+
+void CacheStatsReporter::start() {
+  mStarted = true;
+  if (mIntervalSeconds > 0) {
+    mThread = std::thread(&CacheStatsReporter::reportLoop, this);
+  }
+}
+
+void CacheStatsReporter::stop() {
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mStopping = true;
+  }
+  mCondition.notify_all();
+  if (mThread.joinable()) {
+    mThread.join();
+  }
+  mStarted = false;
+  report();
+}
+
+void CacheStatsReporter::report() {
+  mStats->print(stdout);
+  fflush(stdout);
+
+  if (!mJsonFilename.empty()) {
+    FILE *file = fopen(mJsonFilename.c_str(), "w");
+    if (file == nullptr) {
+      LOG(ERROR) << "Couldn't open " << mJsonFilename << " for cache statistics";
+      return;
+    }
+    fprintf(file, "%s\n", mStats->toJson().c_str());
+    fclose(file);
+  }
+}
+
+void CacheStatsReporter::reportLoop() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (!mCondition.wait_for(lock, std::chrono::seconds(mIntervalSeconds),
+                              [this] { return mStopping; })) {
+    lock.unlock();
+    report();
+    lock.lock();
+  }
+}
@@ -0,0 +1,151 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _CACHE_STATS_H_
+#define _CACHE_STATS_H_
+
+#include "lock.h"
+#include "primitives.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// A histogram of latencies, with power-of-two buckets in microseconds.
+// Recording is lock-free, so it can be done from any thread.
+
+class LatencyHistogram {
+public:
+  // Bucket i counts latencies below 2^i microseconds that aren't in a
+  // lower bucket; the last bucket also counts everything larger.
+  static const int NUM_BUCKETS = 28;
+
+  LatencyHistogram();
+
+  void record(double seconds);
+
+  struct Snapshot {
+    uint64 count;
+    double totalSeconds;
+    double maxSeconds;
+    uint64 buckets[NUM_BUCKETS];
+
+    double meanSeconds() const;
+    // Upper bound of the bucket containing the given fraction of samples
+    double percentileSeconds(double fraction) const;
+  };
+  Snapshot snapshot() const;
+
+  // Upper bound of the given bucket
+  static double bucketLimitSeconds(int bucket);
+
+private:
+  std::atomic<uint64> mBuckets[NUM_BUCKETS];
+  std::atomic<uint64> mCount;
+  std::atomic<uint64> mTotalMicros;
+  std::atomic<uint64> mMaxMicros;
+};
+
+// Counters describing the behavior of a TileCache.  All are updated
+// atomically, so they can be read while the cache is in use.
+
+class CacheStats {
+public:
+  CacheStats();
+  ~CacheStats();
+
+  void addHit() { ++mHits; }
+  void addMiss() { ++mMisses; }
+  void addSharedLoad() { ++mSharedLoads; }
+  void addUncachedLoad() { ++mUncachedLoads; }
+  void addMissingTile() { ++mMissingTiles; }
+  void addEviction(size_t numBytes);
+  void addLockWait(double seconds);
+  void setBytesResident(size_t numBytes);
+
+  // Histogram of load times for tiles of the given format, created on first use.
+  // The histogram lives as long as this object.
+  LatencyHistogram *loadLatency(const std::string &formatName);
+
+  // Print a human-readable summary
+  void print(FILE *file);
+
+  // Return all the statistics as a JSON object
+  std::string toJson();
+
+private:
+  std::atomic<uint64> mHits;            // getOrLoad found the tile in the cache
+  std::atomic<uint64> mMisses;          // getOrLoad loaded the tile
+  std::atomic<uint64> mSharedLoads;     // getOrLoad waited for another thread's load
+  std::atomic<uint64> mUncachedLoads;   // Calls to loadWithoutCaching
+  std::atomic<uint64> mMissingTiles;    // Loads of tiles that don't exist
+  std::atomic<uint64> mEvictions;
+  std::atomic<uint64> mEvictedBytes;
+  std::atomic<uint64> mBytesResident;
+  std::atomic<uint64> mPeakBytesResident;
+  std::atomic<uint64> mLockWaits;       // Times the cache lock was contended
+  std::atomic<uint64> mLockWaitMicros;
+
+  // Histograms by format name, protected by mLock
+  Lock mLock;
+  std::map<std::string, LatencyHistogram *> mLoadLatencies;
+};
+
+// Prints the statistics of a CacheStats every so often on a background
+// thread, and once more when stopped.  Optionally also writes them as
+// JSON to a file, which is overwritten with the latest numbers each time.
+
+class CacheStatsReporter {
+public:
+  // intervalSeconds of 0 means only report when stopped.  jsonFilename
+  // may be empty.
+  CacheStatsReporter(CacheStats *stats, int intervalSeconds, const std::string &jsonFilename);
+
+  // Calls stop if needed
+  ~CacheStatsReporter();
+
+  void start();
+
+  // Stop reporting periodically, and make a final report
+  void stop();
+
+private:
+  CacheStats *mStats;
+  int mIntervalSeconds;
+  std::string mJsonFilename;
+  bool mStarted;
+
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  bool mStopping;  // Protected by mMutex
+  std::thread mThread;
+
+  void report();
+  void reportLoop();
+};
+
+#endif  // _CACHE_STATS_H_
@@ -0,0 +1,284 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// A tool to check that SweepTreeBuilder and TreeBuilder give the same
+// prominence values for the peaks of real tiles, and to compare how long
+// they take.  It can also check TreeBuilder building tiles in bands the
+// same way.
+
+#include "divide_tree.h"
+#include "island_tree.h"
+#include "sweep_tree_builder.h"
+#include "tile.h"
+#include "tile_loading_policy.h"
+#include "tree_builder.h"
+
+#include "easylogging++.h"
+
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef PLATFORM_WINDOWS
+#include "getopt-win.h"
+#endif
+
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+INITIALIZE_EASYLOGGINGPP
+
+// Most differences to print for each tile
+static const int MAX_PRINTED_DIFFERENCES = 10;
+
+static void usage() {
+  printf("Usage:\n");
+  printf("  compare_tree_builders min_lat max_lat min_lng max_lng\n");
+  printf("  where coordinates are integer degrees\n");
+  printf("\n");
+  printf("  Options:\n");
+  printf("  -i directory      Directory with terrain data\n");
+  printf("  -f format         \"SRTM\", \"NED13-ZIP\", \"NED1-ZIP\" input files\n");
+  printf("  -m min_prominence Only compare peaks with at least this prominence, default = 0\n");
+  printf("  -b num_bands      Compare with TreeBuilder building tiles in this many bands\n");
+  printf("                    instead of with SweepTreeBuilder\n");
+  exit(1);
+}
+
+// Map from peak location to prominence, for peaks with at least the
+// given prominence
+static unordered_map<Offsets::Value, int> getProminences(const DivideTree &tree,
+                                                         int minProminence) {
+  IslandTree islandTree(tree);
+  islandTree.build();
+
+  unordered_map<Offsets::Value, int> prominences;
+  const vector<IslandTree::Node> &nodes = islandTree.nodes();
+  for (int i = 1; i < (int) nodes.size(); ++i) {
+    if (nodes[i].prominence >= minProminence) {
+      prominences[tree.peaks()[i - 1].location.value()] = nodes[i].prominence;
+    }
+  }
+
+  return prominences;
+}
+
+// Print peaks in prominences1 that are missing from prominences2, and
+// if includeChanged is true, those with a different prominence there.
+// Return the number of differences.
+static int printDifferences(const Tile &tile, const char *name1, const char *name2,
+                            const unordered_map<Offsets::Value, int> &prominences1,
+                            const unordered_map<Offsets::Value, int> &prominences2,
+                            bool includeChanged, int *numPrinted) {
+  int numDifferences = 0;
+  for (auto it : prominences1) {
+    auto other = prominences2.find(it.first);
+    if (other != prominences2.end() && (!includeChanged || other->second == it.second)) {
+      continue;
+    }
+
+    numDifferences += 1;
+    if (*numPrinted < MAX_PRINTED_DIFFERENCES) {
+      *numPrinted += 1;
+      LatLng pos = tile.latlng(Offsets(it.first));
+      if (other == prominences2.end()) {
+        printf("  Peak at %.4f %.4f has prominence %d from %s, missing from %s\n",
+               pos.latitude(), pos.longitude(), it.second, name1, name2);
+      } else {
+        printf("  Peak at %.4f %.4f has prominence %d from %s, %d from %s\n",
+               pos.latitude(), pos.longitude(), it.second, name1, other->second, name2);
+      }
+    }
+  }
+
+  return numDifferences;
+}
+
+// Print runoffs of tree1 that aren't in tree2 with the same elevation,
+// filled quadrants and peak area flag.  Return the number of differences.
+static int printRunoffDifferences(const Tile &tile, const char *name1, const char *name2,
+                                  const DivideTree &tree1, const DivideTree &tree2,
+                                  int *numPrinted) {
+  unordered_map<Offsets::Value, const Runoff *> runoffs2;
+  for (const Runoff &runoff : tree2.runoffs()) {
+    runoffs2[runoff.location.value()] = &runoff;
+  }
+
+  int numDifferences = 0;
+  for (const Runoff &runoff : tree1.runoffs()) {
+    auto other = runoffs2.find(runoff.location.value());
+    if (other != runoffs2.end() &&
+        other->second->elevation == runoff.elevation &&
+        other->second->filledQuadrants == runoff.filledQuadrants &&
+        other->second->insidePeakArea == runoff.insidePeakArea) {
+      continue;
+    }
+
+    numDifferences += 1;
+    if (*numPrinted < MAX_PRINTED_DIFFERENCES) {
+      *numPrinted += 1;
+      LatLng pos = tile.latlng(runoff.location);
+      printf("  Runoff at %.4f %.4f from %s is %s in %s\n",
+             pos.latitude(), pos.longitude(), name1,
+             (other == runoffs2.end()) ? "missing" : "different", name2);
+    }
+  }
+
+  return numDifferences;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+  string terrain_directory(".");
+  FileFormat fileFormat = FileFormat::HGT;
+  int minProminence = 0;
+  int numBands = 0;
+
+  // Parse options
+  START_EASYLOGGINGPP(argc, argv);
+  int ch;
+  string str;
+  while ((ch = getopt(argc, argv, "b:f:i:m:")) != -1) {
+    switch (ch) {
+    case 'b':
+      numBands = atoi(optarg);
+      break;
+
+    case 'f':
+      str = optarg;
+      if (str == "SRTM") {
+        fileFormat = FileFormat::HGT;
+      } else if (str == "NED1-ZIP") {
+        fileFormat = FileFormat::NED1_ZIP;
+      } else if (str == "NED13-ZIP") {
+        fileFormat = FileFormat::NED13_ZIP;
+      } else {
+        printf("Unknown file format %s\n", optarg);
+        usage();
+      }
+      break;
+
+    case 'i':
+      terrain_directory = optarg;
+      break;
+
+    case 'm':
+      minProminence = atoi(optarg);
+      break;
+    }
+  }
+
+  argc -= optind;
+  argv += optind;
+
+  if (argc < 4) {
+    usage();
+  }
+
+  float bounds[4];
+  for (int i = 0; i < 4; ++i) {
+    char *endptr;
+    bounds[i] = strtof(argv[i], &endptr);
+    if (*endptr != 0) {
+      printf("Couldn't parse argument %d as number: %s\n", i + 1, argv[i]);
+      usage();
+    }
+  }
+
+  // Load tiles the same way prominence does
+  BasicTileLoadingPolicy policy(terrain_directory, fileFormat);
+  policy.enableNeighborEdgeLoading(true);
+
+  const char *name1 = "TreeBuilder";
+  const char *name2 = (numBands > 0) ? "bands" : "SweepTreeBuilder";
+  int numTiles = 0;
+  int totalDifferences = 0;
+  double totalSeconds[2] = { 0, 0 };
+  for (int lat = (int) floor(bounds[0]); lat < (int) ceil(bounds[1]); ++lat) {
+    for (int lng = (int) floor(bounds[2]); lng < (int) ceil(bounds[3]); ++lng) {
+      Tile *tile = policy.loadTile(lat, lng);
+      if (tile == nullptr) {
+        continue;
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      TreeBuilder *treeBuilder = new TreeBuilder(tile);
+      DivideTree *tree = treeBuilder->buildDivideTree();
+      delete treeBuilder;
+      double treeSeconds = secondsSince(start);
+
+      start = std::chrono::steady_clock::now();
+      DivideTree *otherTree;
+      if (numBands > 0) {
+        otherTree = TreeBuilder::buildDivideTreeInBands(tile, numBands, nullptr);
+      } else {
+        SweepTreeBuilder *sweepBuilder = new SweepTreeBuilder(tile);
+        otherTree = sweepBuilder->buildDivideTree();
+        delete sweepBuilder;
+      }
+      double otherSeconds = secondsSince(start);
+
+      unordered_map<Offsets::Value, int> prominences = getProminences(*tree, minProminence);
+      unordered_map<Offsets::Value, int> otherProminences =
+        getProminences(*otherTree, minProminence);
+
+      printf("Tile %d %d: %d peaks, %s %.3f s, %s %.3f s\n",
+             lat, lng, (int) prominences.size(), name1, treeSeconds, name2, otherSeconds);
+      int numPrinted = 0;
+      int numDifferences =
+        printDifferences(*tile, name1, name2, prominences, otherProminences, true, &numPrinted) +
+        printDifferences(*tile, name2, name1, otherProminences, prominences, false, &numPrinted);
+
+      // The runoffs decide how the tile's tree merges with its neighbors
+      if (numBands > 0) {
+        numDifferences +=
+          printRunoffDifferences(*tile, name1, name2, *tree, *otherTree, &numPrinted) +
+          printRunoffDifferences(*tile, name2, name1, *otherTree, *tree, &numPrinted);
+      }
+      if (numDifferences > 0) {
+        printf("  %d differences\n", numDifferences);
+      }
+
+      numTiles += 1;
+      totalDifferences += numDifferences;
+      totalSeconds[0] += treeSeconds;
+      totalSeconds[1] += otherSeconds;
+      delete tree;
+      delete otherTree;
+      delete tile;
+    }
+  }
+
+  printf("%d tiles, %d differences; %s %.3f s, %s %.3f s\n",
+         numTiles, totalDifferences, name1, totalSeconds[0], name2, totalSeconds[1]);
+
+  return totalDifferences == 0 ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// A tool to convert divide tree files between the text (.dvt) and
+// binary (.dvtb) formats
+
+#include "divide_tree.h"
+#ifdef PLATFORM_LINUX
+#include <unistd.h>
+#endif
+#ifdef PLATFORM_WINDOWS
+#include "getopt-win.h"
+#endif
+
+#include "easylogging++.h"
+
+INITIALIZE_EASYLOGGINGPP
+
+using std::string;
+
+static void usage() {
+  printf("Usage:\n");
+  printf("  convert_divide_tree input_file output_file\n");
+  printf("  Files with the .dvtb extension are binary; others are text\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  // Parse options
+  START_EASYLOGGINGPP(argc, argv);
+
+  int ch;
+  while ((ch = getopt(argc, argv, "")) != -1) {
+    usage();
+  }
+  argc -= optind;
+  argv += optind;
+
+  if (argc != 2) {
+    usage();
+  }
+
+  string inputFilename = argv[0];
+  string outputFilename = argv[1];
+
+  DivideTree *divideTree = DivideTree::readFromFile(inputFilename);
+  if (divideTree == nullptr) {
+    LOG(ERROR) << "Failed to load divide tree from " << inputFilename;
+    return 1;
+  }
+
+  bool ok = divideTree->writeToFile(outputFilename);
+  if (!ok) {
+    LOG(ERROR) << "Failed to write divide tree to " << outputFilename;
+  }
+
+  delete divideTree;
+  return ok ? 0 : 1;
+}
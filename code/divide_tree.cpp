@@ -28,20 +28,91 @@
 #include "island_tree.h"
 #include "kml_writer.h"
 #include "line_tree.h"
+#include "link_cut_forest.h"
+#include "mapped_file.h"
 #include "util.h"
 
 #include <assert.h>
 #include <fstream>
+#include <string.h>
 #include <unordered_map>
 
 using std::make_pair;
-using std::multimap;
 using std::string;
 using std::unordered_map;
 using std::unordered_multimap;
 using std::unordered_set;
 using std::vector;
 
+const char DivideTree::BINARY_EXTENSION[] = ".dvtb";
+
+// Layout of binary divide tree files
+static const char BINARY_MAGIC[8] = { 'D', 'V', 'T', 'B', 'I', 'N', 'A', 'R' };
+static const uint32 BINARY_BYTE_ORDER_MARK = 0x01020304;
+static const uint32 BINARY_VERSION = 1;
+
+struct BinaryHeader {
+  char magic[8];
+  uint32 byteOrderMark;
+  uint32 version;
+  float minLatitude;
+  float minLongitude;
+  int32 pixelsPerDegreeLatitude;
+  int32 pixelsPerDegreeLongitude;
+  // Number of records in each array, and offset of its first record
+  // from the start of the file
+  uint64 numPeaks;
+  uint64 peaksOffset;
+  uint64 numSaddles;
+  uint64 saddlesOffset;
+  uint64 numRunoffs;
+  uint64 runoffsOffset;
+  uint64 numNodes;
+  uint64 nodesOffset;
+  uint64 numRunoffEdges;
+  uint64 runoffEdgesOffset;
+};
+
+struct BinaryPeak {
+  int32 x;
+  int32 y;
+  int32 elevation;
+};
+
+struct BinarySaddle {
+  int32 x;
+  int32 y;
+  int32 elevation;
+  uint8 type;  // A Saddle::Type
+  uint8 padding[3];
+};
+
+struct BinaryRunoff {
+  int32 x;
+  int32 y;
+  int32 elevation;
+  int32 filledQuadrants;
+  uint8 insidePeakArea;
+  uint8 padding[3];
+};
+
+struct BinaryNode {
+  int32 parentId;
+  int32 saddleId;
+};
+
+// Return the offset of the next 8-byte boundary at or after offset
+static uint64 alignBinaryOffset(uint64 offset) {
+  return (offset + 7) & ~(uint64) 7;
+}
+
+// Return true if filename ends in DivideTree::BINARY_EXTENSION
+static bool hasBinaryExtension(const string &filename) {
+  size_t length = strlen(DivideTree::BINARY_EXTENSION);
+  return filename.size() >= length &&
+    filename.compare(filename.size() - length, length, DivideTree::BINARY_EXTENSION) == 0;
+}
+
 // TODO: What to do at boundary of different resolutions?
 // TODO: Better KML icons
 // TODO: Investigate multithreading crash
@@ -57,91 +128,282 @@ DivideTree::DivideTree(const CoordinateSystem &coordinateSystem,
     node.saddleId = Node::Null;
   }
   mRunoffEdges.resize(mRunoffs.size());  // Runoffs are 0-indexed
+  mForest = nullptr;
+}
+
+DivideTree::~DivideTree() {
+  delete mForest;
 }
 
 int DivideTree::maybeAddEdge(int peakId1, int peakId2, int saddleId) {
+  if (mForest == nullptr) {
+    startAddingEdges();
+  }
+  
   // If peaks are already in the same tree, new edge would create a cycle.
-  int commonAncestorId = findCommonAncestor(peakId1, peakId2);
-  if (commonAncestorId == Node::Null) {
+  int commonAncestorId = mForest->findCommonAncestor(peakId1, peakId2);
+  if (commonAncestorId == LinkCutForest::Null) {
     // Two separate trees; fine to add edge.
-    // Make one peak into the root of its tree so that we can
-    // set its parent to the other peak.
-    makeNodeIntoRoot(peakId1);
-    mNodes[peakId1].parentId = peakId2;
-    mNodes[peakId1].saddleId = saddleId;
+    addForestEdge(peakId1, peakId2, saddleId);
     VLOG(3) << "Adding divide tree edge " << peakId1 << " " << peakId2;
     return Node::Null;
   }
 
-  // Find lowest saddle on proposed cycle
-  int lowestSaddleNode1 = findLowestSaddleOnPath(peakId1, commonAncestorId);
-  int lowestSaddleNode2 = findLowestSaddleOnPath(peakId2, commonAncestorId);
-
+  // Find lowest saddle on proposed cycle.  On each side of the common
+  // ancestor, the one closest to the peak wins a tie.
+  int lowestEdge1 = mForest->findLowestBelow(peakId1, commonAncestorId);
+  int lowestEdge2 = mForest->findLowestBelow(peakId2, commonAncestorId);
   VLOG(3) << "Common ancestor is " << commonAncestorId; 
-  VLOG(3) << "Low saddle candidates are " << lowestSaddleNode1 << " " << lowestSaddleNode2;
+  VLOG(3) << "Low saddle edge candidates are " << lowestEdge1 << " " << lowestEdge2;
   
-  // Make node1 the one with a guaranteed parent and saddle
-  if (lowestSaddleNode1 == Node::Null || mNodes[lowestSaddleNode1].saddleId == Node::Null) {
-    std::swap(lowestSaddleNode1, lowestSaddleNode2);
+  // Make edge1 the one that's guaranteed to exist
+  if (lowestEdge1 == LinkCutForest::Null) {
+    std::swap(lowestEdge1, lowestEdge2);
   }
 
-  assert(lowestSaddleNode1 != Node::Null);
-  assert(mNodes[lowestSaddleNode1].saddleId != Node::Null);
+  assert(lowestEdge1 != LinkCutForest::Null);
   
-  int lowestSaddleElevation = getSaddle(mNodes[lowestSaddleNode1].saddleId).elevation;
-  int lowestSaddleNodeId = lowestSaddleNode1;
-  if (lowestSaddleNodeId == Node::Null ||
-      (lowestSaddleNode2 != Node::Null && getSaddle(mNodes[lowestSaddleNode2].saddleId).elevation < lowestSaddleElevation)) {
-    lowestSaddleElevation = getSaddle(mNodes[lowestSaddleNode2].saddleId).elevation;
-    lowestSaddleNodeId = lowestSaddleNode2;
+  int lowestEdge = lowestEdge1;
+  if (lowestEdge2 != LinkCutForest::Null &&
+      mForest->value(lowestEdge2) < mForest->value(lowestEdge1)) {
+    lowestEdge = lowestEdge2;
   }
 
   // If proposed saddle is the lowest, discard new edge, nothing to do
-  if (getSaddle(saddleId).elevation < lowestSaddleElevation) {
+  if (getSaddle(saddleId).elevation < mForest->value(lowestEdge)) {
     return saddleId;
   }
 
   // Break edge with lowest saddle
-  int basinSaddleId = mNodes[lowestSaddleNodeId].saddleId;
-  mNodes[lowestSaddleNodeId].parentId = Node::Null;
-  mNodes[lowestSaddleNodeId].saddleId = Node::Null;
+  int basinSaddleId = mForestEdgeSaddles[lowestEdge - mNodes.size()];
+  removeForestEdge(lowestEdge);
   
   // Add new edge
-  makeNodeIntoRoot(peakId1);
-  mNodes[peakId1].parentId = peakId2;
+  addForestEdge(peakId1, peakId2, saddleId);
   VLOG(3) << "Adding modified divide tree edge " << peakId1 << " " << peakId2;
-  mNodes[peakId1].saddleId = saddleId;
 
   return basinSaddleId;
 }
 
+void DivideTree::finishAddingEdges() {
+  if (mForest == nullptr) {
+    return;
+  }
+
+  for (int runoffId = 0; runoffId < (int) mRunoffEdges.size(); ++runoffId) {
+    updateRunoffEdge(runoffId);
+  }
+  
+  // A removed peak and the peak it was merged into are still joined in
+  // mForest, by an edge with no saddle.  The merged peak takes the
+  // parent of whichever of them is higher in the tree.
+  int numNodes = (int) mNodes.size();
+  for (int peakId = 1; peakId < numNodes; ++peakId) {
+    Node &node = mNodes[peakId];
+    node.parentId = Node::Null;
+    node.saddleId = Node::Null;
+    if (mSurvivingPeaks[peakId] != Node::Null) {
+      continue;
+    }
+    
+    int edgeNodeId = findParentEdge(peakId);
+    if (edgeNodeId != LinkCutForest::Null) {
+      node.parentId = findSurvivingPeak(mForest->parent(edgeNodeId));
+      node.saddleId = mForestEdgeSaddles[edgeNodeId - numNodes];
+    }
+  }
+
+  // Remove the saddles and nodes of removed peaks, and renumber the rest
+  int numSaddles = (int) mSaddles.size();
+  vector<int> newSaddleIds(numSaddles + 1);
+  vector<bool> removedSaddleIndices(numSaddles, false);  // 0-based
+  for (int saddleId : mRemovedSaddleIds) {
+    removedSaddleIndices[saddleId - 1] = true;
+  }
+  int newSaddleId = 1;
+  for (int saddleId = 1; saddleId <= numSaddles; ++saddleId) {
+    if (!removedSaddleIndices[saddleId - 1]) {
+      newSaddleIds[saddleId] = newSaddleId++;
+    }
+  }
+  
+  vector<int> newPeakIds(numNodes, 0);
+  vector<bool> removedPeakIndices(numNodes - 1, false);  // 0-based
+  int newPeakId = 1;
+  for (int peakId = 1; peakId < numNodes; ++peakId) {
+    if (mSurvivingPeaks[peakId] == Node::Null) {
+      newPeakIds[peakId] = newPeakId++;
+    } else {
+      removedPeakIndices[peakId - 1] = true;
+    }
+  }
+  
+  removeVectorElementsByIndices(&mSaddles, removedSaddleIndices);
+  removeVectorElementsByIndices(&mPeaks, removedPeakIndices);
+  vector<Node> nodes;
+  nodes.reserve(mPeaks.size() + 1);
+  nodes.push_back(mNodes[0]);
+  for (int peakId = 1; peakId < numNodes; ++peakId) {
+    if (newPeakIds[peakId] != 0) {
+      Node node = mNodes[peakId];
+      if (node.parentId != Node::Null) {
+        node.parentId = newPeakIds[node.parentId];
+        node.saddleId = newSaddleIds[node.saddleId];
+      }
+      nodes.push_back(node);
+    }
+  }
+  mNodes.swap(nodes);
+  for (int &runoffEdgeId : mRunoffEdges) {
+    runoffEdgeId = newPeakIds[runoffEdgeId];
+  }
+
+  delete mForest;
+  mForest = nullptr;
+  mForestEdgeSaddles.clear();
+  mSurvivingPeaks.clear();
+  mRemovedSaddleIds.clear();
+}
+
+void DivideTree::addEdgeFromRoot(int rootPeakId, int parentPeakId, int saddleId) {
+  assert(mForest == nullptr);
+  assert(mNodes[rootPeakId].parentId == Node::Null);
+  mNodes[rootPeakId].parentId = parentPeakId;
+  mNodes[rootPeakId].saddleId = saddleId;
+}
+
 void DivideTree::addRunoffEdge(int peakId, int runoffId) {
   mRunoffEdges[runoffId] = peakId;
 }
 
+// The peaks just above and below each peak in a divide tree.  It starts
+// as a compressed adjacency array, with one slice per peak.  Neighbors
+// added later go at the end of the array; each peak's entries are
+// linked together in the order they were added.
+class PeakNeighbors {
+public:
+  static const int Null = -1;
+
+  explicit PeakNeighbors(const vector<DivideTree::Node> &nodes);
+
+  // Return the first entry of peakId's neighbors, or Null if it has none
+  int first(int peakId) const { return mHeads[peakId]; }
+  // Return the entry after the given one, or Null
+  int next(int entry) const { return mNext[entry]; }
+  int neighbor(int entry) const { return mNeighbors[entry]; }
+
+  void add(int peakId, int neighborId);
+  // Remove the first instance of neighborId from peakId's neighbors
+  void remove(int peakId, int neighborId);
+  void clear(int peakId);
+
+private:
+  vector<int> mNeighbors;
+  vector<int> mNext;
+  vector<int> mHeads;
+  vector<int> mTails;
+};
+
+PeakNeighbors::PeakNeighbors(const vector<DivideTree::Node> &nodes) {
+  int numNodes = (int) nodes.size();
+  vector<int> offsets(numNodes + 1, 0);
+  for (int peakId = 1; peakId < numNodes; ++peakId) {
+    int parentId = nodes[peakId].parentId;
+    if (parentId != DivideTree::Node::Null) {
+      offsets[parentId + 1] += 1;
+      offsets[peakId + 1] += 1;
+    }
+  }
+  for (int peakId = 0; peakId < numNodes; ++peakId) {
+    offsets[peakId + 1] += offsets[peakId];
+  }
+
+  // Neighbors of each peak are in the order that a pass over the
+  // peaks meets them
+  mNeighbors.resize(offsets[numNodes]);
+  vector<int> fill(offsets.begin(), offsets.end() - 1);
+  for (int peakId = 1; peakId < numNodes; ++peakId) {
+    int parentId = nodes[peakId].parentId;
+    if (parentId != DivideTree::Node::Null) {
+      mNeighbors[fill[parentId]++] = peakId;
+      mNeighbors[fill[peakId]++] = parentId;
+    }
+  }
+
+  mNext.resize(mNeighbors.size());
+  mHeads.resize(numNodes);
+  mTails.resize(numNodes);
+  for (int peakId = 0; peakId < numNodes; ++peakId) {
+    int begin = offsets[peakId];
+    int end = offsets[peakId + 1];
+    for (int entry = begin; entry < end; ++entry) {
+      mNext[entry] = entry + 1;
+    }
+    if (begin == end) {
+      mHeads[peakId] = mTails[peakId] = Null;
+    } else {
+      mNext[end - 1] = Null;
+      mHeads[peakId] = begin;
+      mTails[peakId] = end - 1;
+    }
+  }
+}
+
+void PeakNeighbors::add(int peakId, int neighborId) {
+  int entry = (int) mNeighbors.size();
+  mNeighbors.push_back(neighborId);
+  mNext.push_back((int) Null);
+  if (mTails[peakId] == Null) {
+    mHeads[peakId] = entry;
+  } else {
+    mNext[mTails[peakId]] = entry;
+  }
+  mTails[peakId] = entry;
+}
+
+void PeakNeighbors::remove(int peakId, int neighborId) {
+  int previous = Null;
+  for (int entry = mHeads[peakId]; entry != Null; entry = mNext[entry]) {
+    if (mNeighbors[entry] == neighborId) {
+      if (previous == Null) {
+        mHeads[peakId] = mNext[entry];
+      } else {
+        mNext[previous] = mNext[entry];
+      }
+      if (mTails[peakId] == entry) {
+        mTails[peakId] = previous;
+      }
+      return;
+    }
+    previous = entry;
+  }
+}
+
+void PeakNeighbors::clear(int peakId) {
+  mHeads[peakId] = mTails[peakId] = Null;
+}
+
 void DivideTree::prune(int minProminence, const IslandTree &islandTree) {
+  assert(mForest == nullptr);
   // We'll need line tree to know whether it's safe to delete saddles
   LineTree lineTree(*this);
   lineTree.build();
   
-  unordered_set<int> deletedPeakIndices;  // 0-based
-  unordered_set<int> deletedSaddleIndices;  // 0-based
+  vector<bool> deletedPeakIndices(mPeaks.size(), false);  // 0-based
+  vector<bool> deletedSaddleIndices(mSaddles.size(), false);  // 0-based
   
-  // Build up back references to peaks.
-  // map of peak ID to all peaks just above and below in tree ("neighbors").
-  multimap<int, int> neighbors;
-  for (int peakId = 1; peakId < (int) mNodes.size(); ++peakId) {
-    const Node &node = mNodes[peakId];
-    if (node.parentId != Node::Null) {
-      neighbors.insert(make_pair(node.parentId, peakId));
-      neighbors.insert(make_pair(peakId, node.parentId));
-    }
-  }
+  // Build up back references to peaks: all peaks just above and below
+  // each peak in tree ("neighbors").
+  PeakNeighbors neighbors(mNodes);
   
-  // map of peakID to runoffIDs that point to it
-  multimap<int, int> runoffNeighbors;
-  for (int runoffId = 0; runoffId < (int) mRunoffEdges.size(); ++runoffId) {
-    runoffNeighbors.insert(make_pair(mRunoffEdges[runoffId], runoffId));
+  // Number of runoffs that point to each peak.  The runoffs of a deleted
+  // peak go to the peak in replacementPeaks, which may be deleted too.
+  vector<int> numRunoffs(mNodes.size(), 0);
+  vector<int> replacementPeaks(mNodes.size(), (int) Node::Null);
+  for (int peakId : mRunoffEdges) {
+    if (peakId != Node::Null) {
+      numRunoffs[peakId] += 1;
+    }
   }
 
   // Look for low-prominence peaks whose highest saddles also have low
@@ -149,6 +411,7 @@ void DivideTree::prune(int minProminence, const IslandTree &islandTree) {
   // peaks until nothing gets removed.  Subsequent loops may remove
   // more peaks because saddles will get wired up differently as
   // peaks are removed.
+  vector<int> neighborIds;
   bool anythingChanged = true;
   while (anythingChanged) {
     anythingChanged = false;
@@ -156,22 +419,20 @@ void DivideTree::prune(int minProminence, const IslandTree &islandTree) {
     VLOG(3) << "Looping over peaks looking for low prominence to prune";
     
     for (int peakId = 1; peakId < (int) mNodes.size(); ++peakId) {
-      const Peak &peak = getPeak(peakId);
       const Node &node = mNodes[peakId];
       // Peak has below min prominence?
       const IslandTree::Node &iNode = islandTree.nodes()[peakId];
-      if (deletedPeakIndices.find(peakId - 1) == deletedPeakIndices.end() &&
+      if (!deletedPeakIndices[peakId - 1] &&
           iNode.prominence != IslandTree::Node::Null &&
           iNode.prominence < minProminence) {
-        const auto range = neighbors.equal_range(peakId);
-        if (range.first == range.second) {
+        if (neighbors.first(peakId) == PeakNeighbors::Null) {
           // No neighbors; isolated peak.  If not connected to runoff,
           // just nuke it.  If it is connected to a runoff, we have to
           // keep it, because it might have high prominence from a
           // neighboring tile.
-          if (runoffNeighbors.find(peakId) == runoffNeighbors.end()) {
+          if (numRunoffs[peakId] == 0) {
             VLOG(3) << "Removing isolated peak " << peakId;
-            deletedPeakIndices.insert(peakId - 1);
+            deletedPeakIndices[peakId - 1] = true;
             anythingChanged = true;
           }
           continue;
@@ -181,8 +442,9 @@ void DivideTree::prune(int minProminence, const IslandTree &islandTree) {
         bool deletePeak = false;
         int ownerOfSaddleToDelete = Node::Null;
         int highestSaddleElevation = 0;
-        for (auto it = range.first; it != range.second; ++it) {
-          int neighborPeakId = it->second;
+        for (int entry = neighbors.first(peakId); entry != PeakNeighbors::Null;
+             entry = neighbors.next(entry)) {
+          int neighborPeakId = neighbors.neighbor(entry);
           int saddleOwnerPeakId = (neighborPeakId == node.parentId) ? peakId : neighborPeakId;
           const Saddle &saddle = getSaddle(mNodes[saddleOwnerPeakId].saddleId);
           if (ownerOfSaddleToDelete == Node:: Null || saddle.elevation > highestSaddleElevation) {
@@ -212,9 +474,10 @@ void DivideTree::prune(int minProminence, const IslandTree &islandTree) {
             newParentId = ownerOfSaddleToDelete;
             mNodes[ownerOfSaddleToDelete].parentId = node.parentId;
           }
-          vector<int> neighborIds;
-          for (auto it = range.first; it != range.second; ++it) {
-            int neighborPeakId = it->second;
+          neighborIds.clear();
+          for (int entry = neighbors.first(peakId); entry != PeakNeighbors::Null;
+               entry = neighbors.next(entry)) {
+            int neighborPeakId = neighbors.neighbor(entry);
             neighborIds.push_back(neighborPeakId);
             if (neighborPeakId != node.parentId && neighborPeakId != newParentId) {
               mNodes[neighborPeakId].parentId = newParentId;
@@ -222,83 +485,98 @@ void DivideTree::prune(int minProminence, const IslandTree &islandTree) {
           }
           
           // Update neighbors
-          for (auto neighborPeakId : neighborIds) {
-            removeFromMultimap(&neighbors, neighborPeakId, peakId);
+          for (int neighborPeakId : neighborIds) {
+            neighbors.remove(neighborPeakId, peakId);
             if (neighborPeakId != newParentId) {              
-              neighbors.insert(make_pair(newParentId, neighborPeakId));
-              neighbors.insert(make_pair(neighborPeakId, newParentId));
+              neighbors.add(newParentId, neighborPeakId);
+              neighbors.add(neighborPeakId, newParentId);
             }
           }
 
           // Any runoffs pointing to us must point to our parent
-          const auto runoffRange = runoffNeighbors.equal_range(peakId);
-          vector<int> runoffIds;
-          for (auto it = runoffRange.first; it != runoffRange.second; ++it) {
-            runoffIds.push_back(it->second);
-          }
-          for (auto runoffId : runoffIds) {
-            mRunoffEdges[runoffId] = newParentId;
-            runoffNeighbors.insert(make_pair(newParentId, runoffId));
-            // Runoff's adjacent peak is gone; it can't have any influence on the new parent
-            mRunoffs[runoffId].insidePeakArea = false;
-          }
+          numRunoffs[newParentId] += numRunoffs[peakId];
+          numRunoffs[peakId] = 0;
+          replacementPeaks[peakId] = newParentId;
           
           mNodes[peakId].parentId = Node::Null;
           mNodes[peakId].saddleId = Node::Null;
-          neighbors.erase(peakId);
-          runoffNeighbors.erase(peakId);
-          deletedPeakIndices.insert(peakId - 1);
-          deletedSaddleIndices.insert(saddleIdToDelete - 1);
+          neighbors.clear(peakId);
+          deletedPeakIndices[peakId - 1] = true;
+          deletedSaddleIndices[saddleIdToDelete - 1] = true;
           anythingChanged = true;
         }
       }
     }
   }
 
-  // peakDeletionOffsets[i] tells how much to subtract to go from
-  // pre-deletion peak index i to post-deletion peak index.
-  vector<int> peakDeletionOffsets(mPeaks.size(), 0);
-  for (int index : deletedPeakIndices) {
-    for (int i = index; i < (int) peakDeletionOffsets.size(); ++i) {
-      peakDeletionOffsets[i] += 1;
+  // Point runoffs at the peaks that replaced theirs
+  for (int runoffId = 0; runoffId < (int) mRunoffEdges.size(); ++runoffId) {
+    int &peakId = mRunoffEdges[runoffId];
+    if (peakId != Node::Null && replacementPeaks[peakId] != Node::Null) {
+      while (replacementPeaks[peakId] != Node::Null) {
+        peakId = replacementPeaks[peakId];
+      }
+      // Runoff's adjacent peak is gone; it can't have any influence on the new parent
+      mRunoffs[runoffId].insidePeakArea = false;
+    }
+  }
+
+  // Running counts of surviving peaks and saddles give their new IDs
+  vector<int> newPeakIds(mNodes.size(), (int) Node::Null);
+  int numPeaksLeft = 0;
+  for (int index = 0; index < (int) mPeaks.size(); ++index) {
+    if (!deletedPeakIndices[index]) {
+      newPeakIds[index + 1] = ++numPeaksLeft;
     }
   }
-  // Same for saddle deletions
-  vector<int> saddleDeletionOffsets(mSaddles.size(), 0);
-  for (int index : deletedSaddleIndices) {
-    for (int i = index; i < (int) saddleDeletionOffsets.size(); ++i) {
-      saddleDeletionOffsets[i] += 1;
+  vector<int> newSaddleIds(mSaddles.size() + 1, (int) Node::Null);
+  int numSaddlesLeft = 0;
+  for (int index = 0; index < (int) mSaddles.size(); ++index) {
+    if (!deletedSaddleIndices[index]) {
+      newSaddleIds[index + 1] = ++numSaddlesLeft;
     }
   }
 
   // Compact peak / saddle / node arrays to deal with deletions
   removeVectorElementsByIndices(&mSaddles, deletedSaddleIndices); 
   removeVectorElementsByIndices(&mPeaks, deletedPeakIndices);
-  // Indices are 0 based: need to temporarily remove blank mNodes[0]
-  mNodes.erase(mNodes.begin());
-  removeVectorElementsByIndices(&mNodes, deletedPeakIndices);
-  mNodes.insert(mNodes.begin(), Node());
+  int numNodesLeft = 1;  // Keep blank mNodes[0]
+  for (int peakId = 1; peakId < (int) mNodes.size(); ++peakId) {
+    if (!deletedPeakIndices[peakId - 1]) {
+      mNodes[numNodesLeft++] = mNodes[peakId];
+    }
+  }
+  mNodes.resize(numNodesLeft);
 
   VLOG(1) << "Pruned to " << mPeaks.size() << " peaks and " << mSaddles.size() << " saddles";
 
   // Update indices in nodes and runoff edges to account for deletions
   for (Node &node : mNodes) {
     if (node.parentId != Node::Null) {
-      node.parentId -= peakDeletionOffsets[node.parentId - 1];
+      node.parentId = newPeakIds[node.parentId];
     }
 
     if (node.saddleId != Node::Null) {
-      node.saddleId -= saddleDeletionOffsets[node.saddleId - 1];
+      node.saddleId = newSaddleIds[node.saddleId];
     }
   }
   for (int &edge : mRunoffEdges) {
     if (edge != Node::Null) {
-      edge -= peakDeletionOffsets[edge - 1];
+      edge = newPeakIds[edge];
     }
   }
+
+  // Give back the memory of what was deleted, including runoffs spliced
+  // by earlier merges
+  mPeaks.shrink_to_fit();
+  mSaddles.shrink_to_fit();
+  mNodes.shrink_to_fit();
+  mRunoffs.shrink_to_fit();
+  mRunoffEdges.shrink_to_fit();
 }
 
-void DivideTree::merge(const DivideTree &otherTree) {
+void DivideTree::merge(const DivideTree &otherTree, bool firstPeakLocations) {
+  assert(mForest == nullptr);
   int oldNumPeaks = mPeaks.size();
   int oldNumSaddles = mSaddles.size();
   int oldNumNodes = mNodes.size();
@@ -330,7 +608,7 @@ void DivideTree::merge(const DivideTree &otherTree) {
   }
 
   // Actually connect the two subtrees
-  spliceAllRunoffs();
+  spliceAllRunoffs(firstPeakLocations);
 }
 
 bool DivideTree::setOrigin(const CoordinateSystem &coordinateSystem) {
@@ -343,6 +621,13 @@ bool DivideTree::setOrigin(const CoordinateSystem &coordinateSystem) {
   int dx = offsets.x();
   int dy = offsets.y();
   VLOG(2) << "Offsetting origin by " << dx << " " << dy;
+  offsetLocations(dx, dy);
+
+  mCoordinateSystem = coordinateSystem;
+  return true;
+}
+
+void DivideTree::offsetLocations(int dx, int dy) {
   for (Peak &peak : mPeaks) {
     peak.location = peak.location.offsetBy(dx, dy);
   }
@@ -352,12 +637,48 @@ bool DivideTree::setOrigin(const CoordinateSystem &coordinateSystem) {
   for (Runoff &runoff : mRunoffs) {
     runoff.location = runoff.location.offsetBy(dx, dy);
   }
+}
 
-  mCoordinateSystem = coordinateSystem;
-  return true;
+void DivideTree::sortPeaks() {
+  assert(mForest == nullptr);
+  // Peak IDs are 1-based, and location values are in row order
+  vector<int> sortedPeakIds(mPeaks.size());
+  for (int i = 0; i < (int) mPeaks.size(); ++i) {
+    sortedPeakIds[i] = i + 1;
+  }
+  std::stable_sort(sortedPeakIds.begin(), sortedPeakIds.end(), [this](int id1, int id2) {
+      return mPeaks[id1 - 1].location.value() < mPeaks[id2 - 1].location.value();
+    });
+
+  vector<int> newPeakIds(mNodes.size(), (int) Node::Null);
+  for (int i = 0; i < (int) sortedPeakIds.size(); ++i) {
+    newPeakIds[sortedPeakIds[i]] = i + 1;
+  }
+
+  vector<Peak> peaks;
+  peaks.reserve(mPeaks.size());
+  vector<Node> nodes(mNodes.size());
+  for (int i = 0; i < (int) sortedPeakIds.size(); ++i) {
+    int peakId = sortedPeakIds[i];
+    peaks.push_back(mPeaks[peakId - 1]);
+    Node &node = nodes[i + 1];
+    node = mNodes[peakId];
+    if (node.parentId != Node::Null) {
+      node.parentId = newPeakIds[node.parentId];
+    }
+  }
+  for (int &peakId : mRunoffEdges) {
+    if (peakId != Node::Null) {
+      peakId = newPeakIds[peakId];
+    }
+  }
+
+  mPeaks.swap(peaks);
+  mNodes.swap(nodes);
 }
 
 void DivideTree::compact() {
+  assert(mForest == nullptr);
   unordered_map<int, int> saddleIdMap;
   unordered_set<int> removedIndices;
 
@@ -407,6 +728,10 @@ void DivideTree::flipElevations() {
 }
 
 bool DivideTree::writeToFile(const std::string &filename) const {
+  if (hasBinaryExtension(filename)) {
+    return writeToBinaryFile(filename);
+  }
+  
   FILE *file = fopen(filename.c_str(), "wb");
   if (file == nullptr) {
     return false;
@@ -450,6 +775,10 @@ bool DivideTree::writeToFile(const std::string &filename) const {
 }
 
 DivideTree *DivideTree::readFromFile(const std::string &filename) {
+  if (hasBinaryExtension(filename)) {
+    return readFromBinaryFile(filename);
+  }
+  
   if (!fileExists(filename)) {
     return nullptr;
   }
@@ -543,106 +872,309 @@ DivideTree *DivideTree::readFromFile(const std::string &filename) {
   return tree;
 }
 
-int DivideTree::findLowestSaddleOnPath(int childPeakId, int ancestorPeakId) {
-  if (childPeakId == ancestorPeakId) {
-    return Node::Null;
+bool DivideTree::writeToBinaryFile(const std::string &filename) const {
+  FILE *file = fopen(filename.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
   }
-  
-  int lowestSaddleNodeId = childPeakId;
-  while (childPeakId != ancestorPeakId) {
-    int parentPeakId = mNodes[childPeakId].parentId;
-    if (parentPeakId == Node::Null) {
-      LOG(ERROR) << "Couldn't find a path from node " << childPeakId << " to node " << ancestorPeakId;
-      return Node::Null;
-    }
 
-    // Lower saddle?
-    int childSaddleId = mNodes[childPeakId].saddleId;
-    if (getSaddle(childSaddleId).elevation < getSaddle(mNodes[lowestSaddleNodeId].saddleId).elevation) {
-      lowestSaddleNodeId = childPeakId;
-    }
-
-    childPeakId = parentPeakId;
+  BinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+  header.byteOrderMark = BINARY_BYTE_ORDER_MARK;
+  header.version = BINARY_VERSION;
+  header.minLatitude = mCoordinateSystem.minLatitude();
+  header.minLongitude = mCoordinateSystem.minLongitude();
+  header.pixelsPerDegreeLatitude = mCoordinateSystem.pixelsPerDegreeLatitude();
+  header.pixelsPerDegreeLongitude = mCoordinateSystem.pixelsPerDegreeLongitude();
+  header.numPeaks = mPeaks.size();
+  header.peaksOffset = alignBinaryOffset(sizeof(header));
+  header.numSaddles = mSaddles.size();
+  header.saddlesOffset = alignBinaryOffset(header.peaksOffset + mPeaks.size() * sizeof(BinaryPeak));
+  header.numRunoffs = mRunoffs.size();
+  header.runoffsOffset = alignBinaryOffset(header.saddlesOffset +
+                                           mSaddles.size() * sizeof(BinarySaddle));
+  header.numNodes = mNodes.size();
+  header.nodesOffset = alignBinaryOffset(header.runoffsOffset +
+                                         mRunoffs.size() * sizeof(BinaryRunoff));
+  header.numRunoffEdges = mRunoffEdges.size();
+  header.runoffEdgesOffset = alignBinaryOffset(header.nodesOffset +
+                                               mNodes.size() * sizeof(BinaryNode));
+
+  // Records are converted into one buffer per array, to write each
+  // array in one call
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  uint64 offset = sizeof(header);
+  vector<uint8> buffer;
+  auto writeArray = [&](uint64 arrayOffset) {
+    static const uint8 zeros[8] = { 0 };
+    ok = ok && fwrite(zeros, 1, arrayOffset - offset, file) == arrayOffset - offset;
+    ok = ok && fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    offset = arrayOffset + buffer.size();
+  };
+
+  buffer.assign(mPeaks.size() * sizeof(BinaryPeak), 0);
+  BinaryPeak *peaks = reinterpret_cast<BinaryPeak *>(buffer.data());
+  for (const Peak &peak : mPeaks) {
+    peaks->x = peak.location.x();
+    peaks->y = peak.location.y();
+    peaks->elevation = peak.elevation;
+    peaks += 1;
   }
+  writeArray(header.peaksOffset);
 
-  return lowestSaddleNodeId;
-}
+  buffer.assign(mSaddles.size() * sizeof(BinarySaddle), 0);
+  BinarySaddle *saddles = reinterpret_cast<BinarySaddle *>(buffer.data());
+  for (const Saddle &saddle : mSaddles) {
+    saddles->x = saddle.location.x();
+    saddles->y = saddle.location.y();
+    saddles->elevation = saddle.elevation;
+    saddles->type = static_cast<uint8>(saddle.type);
+    saddles += 1;
+  }
+  writeArray(header.saddlesOffset);
 
-void DivideTree::makeNodeIntoRoot(int nodeId) {
-  // Reverse all the parent links leading from this node up to current
-  // root, moving saddles to the reversed links.
-  Node *childNode = &mNodes[nodeId];
-  int childId = nodeId;
-  int parentId = childNode->parentId;
-  int saddleId = childNode->saddleId;
+  buffer.assign(mRunoffs.size() * sizeof(BinaryRunoff), 0);
+  BinaryRunoff *runoffs = reinterpret_cast<BinaryRunoff *>(buffer.data());
+  for (const Runoff &runoff : mRunoffs) {
+    runoffs->x = runoff.location.x();
+    runoffs->y = runoff.location.y();
+    runoffs->elevation = runoff.elevation;
+    runoffs->filledQuadrants = runoff.filledQuadrants;
+    runoffs->insidePeakArea = runoff.insidePeakArea ? 1 : 0;
+    runoffs += 1;
+  }
+  writeArray(header.runoffsOffset);
 
-  while (parentId != Node::Null) {
-    Node *parentNode = &mNodes[parentId];
-    int grandparentId = parentNode->parentId;
-    int tempSaddleId = parentNode->saddleId;
-    parentNode->saddleId = saddleId;
-    parentNode->parentId = childId;
-    saddleId = tempSaddleId;
-   
-    childNode = parentNode;
-    childId = parentId;
-    parentId = grandparentId;
+  buffer.assign(mNodes.size() * sizeof(BinaryNode), 0);
+  BinaryNode *nodes = reinterpret_cast<BinaryNode *>(buffer.data());
+  for (const Node &node : mNodes) {
+    nodes->parentId = node.parentId;
+    nodes->saddleId = node.saddleId;
+    nodes += 1;
   }
+  writeArray(header.nodesOffset);
 
-  // Specified node is now root of tree; clear its parent
-  childNode = &mNodes[nodeId];
-  childNode->saddleId = Node::Null;
-  childNode->parentId = Node::Null;
+  const uint8 *runoffEdges = reinterpret_cast<const uint8 *>(mRunoffEdges.data());
+  buffer.assign(runoffEdges, runoffEdges + mRunoffEdges.size() * sizeof(int32));
+  writeArray(header.runoffEdgesOffset);
+
+  if (fclose(file) != 0) {
+    ok = false;
+  }
+  return ok;
 }
 
-int DivideTree::findCommonAncestor(int nodeId1, int nodeId2) {
-  // First go up tree on one side until both nodes are at the same depth
-  int depth1 = getDepth(nodeId1);
-  int depth2 = getDepth(nodeId2);
+DivideTree *DivideTree::readFromBinaryFile(const std::string &filename) {
+  MappedFile file;
+  if (!file.open(filename)) {
+    return nullptr;
+  }
 
-  while (depth1 > depth2) {
-    nodeId1 = mNodes[nodeId1].parentId;
-    if (nodeId1 == Node::Null) {
-      break;
+  const uint8 *base = static_cast<const uint8 *>(file.data());
+  size_t size = file.size();
+  if (size < sizeof(BinaryHeader)) {
+    LOG(ERROR) << "Divide tree " << filename << " is truncated";
+    return nullptr;
+  }
+
+  const BinaryHeader *header = reinterpret_cast<const BinaryHeader *>(base);
+  if (memcmp(header->magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0) {
+    LOG(ERROR) << filename << " is not a binary divide tree";
+    return nullptr;
+  }
+  if (header->byteOrderMark != BINARY_BYTE_ORDER_MARK) {
+    LOG(ERROR) << "Divide tree " << filename << " was written on a machine with different byte order";
+    return nullptr;
+  }
+  if (header->version != BINARY_VERSION) {
+    LOG(ERROR) << "Divide tree " << filename << " has unsupported version " << header->version;
+    return nullptr;
+  }
+
+  // Check that every array is inside the file
+  const uint64 arrays[][3] = {
+    { header->numPeaks, header->peaksOffset, sizeof(BinaryPeak) },
+    { header->numSaddles, header->saddlesOffset, sizeof(BinarySaddle) },
+    { header->numRunoffs, header->runoffsOffset, sizeof(BinaryRunoff) },
+    { header->numNodes, header->nodesOffset, sizeof(BinaryNode) },
+    { header->numRunoffEdges, header->runoffEdgesOffset, sizeof(int32) },
+  };
+  for (const uint64 *array : arrays) {
+    if (array[1] > size || (size - array[1]) / array[2] < array[0]) {
+      LOG(ERROR) << "Divide tree " << filename << " is truncated";
+      return nullptr;
     }
-    depth1 -= 1;
   }
-  
-  while (depth2 > depth1) {
-    nodeId2 = mNodes[nodeId2].parentId;
-    if (nodeId2 == Node::Null) {
-      break;
+  if (header->pixelsPerDegreeLatitude == 0 || header->pixelsPerDegreeLongitude == 0) {
+    LOG(ERROR) << "Divide tree " << filename << " has no valid coordinate system";
+    return nullptr;
+  }
+
+  CoordinateSystem coordinateSystem(header->minLatitude, header->minLongitude,
+                                    header->pixelsPerDegreeLatitude,
+                                    header->pixelsPerDegreeLongitude);
+  DivideTree *tree = new DivideTree(coordinateSystem, vector<Peak>(), vector<Saddle>(),
+                                    vector<Runoff>());
+
+  const BinaryPeak *peaks = reinterpret_cast<const BinaryPeak *>(base + header->peaksOffset);
+  tree->mPeaks.reserve(header->numPeaks);
+  for (uint64 i = 0; i < header->numPeaks; ++i) {
+    tree->mPeaks.push_back(Peak(Offsets(peaks[i].x, peaks[i].y),
+                                static_cast<Elevation>(peaks[i].elevation)));
+  }
+
+  const BinarySaddle *saddles =
+    reinterpret_cast<const BinarySaddle *>(base + header->saddlesOffset);
+  tree->mSaddles.reserve(header->numSaddles);
+  for (uint64 i = 0; i < header->numSaddles; ++i) {
+    Saddle saddle(Offsets(saddles[i].x, saddles[i].y),
+                  static_cast<Elevation>(saddles[i].elevation));
+    saddle.type = Saddle::typeFromChar(saddles[i].type);
+    tree->mSaddles.push_back(saddle);
+  }
+
+  const BinaryRunoff *runoffs =
+    reinterpret_cast<const BinaryRunoff *>(base + header->runoffsOffset);
+  tree->mRunoffs.reserve(header->numRunoffs);
+  for (uint64 i = 0; i < header->numRunoffs; ++i) {
+    Runoff runoff(Offsets(runoffs[i].x, runoffs[i].y),
+                  static_cast<Elevation>(runoffs[i].elevation), runoffs[i].filledQuadrants);
+    runoff.insidePeakArea = runoffs[i].insidePeakArea != 0;
+    tree->mRunoffs.push_back(runoff);
+  }
+
+  const BinaryNode *nodes = reinterpret_cast<const BinaryNode *>(base + header->nodesOffset);
+  tree->mNodes.resize(header->numNodes);
+  for (uint64 i = 0; i < header->numNodes; ++i) {
+    tree->mNodes[i].parentId = nodes[i].parentId;
+    tree->mNodes[i].saddleId = nodes[i].saddleId;
+  }
+
+  const int32 *runoffEdges = reinterpret_cast<const int32 *>(base + header->runoffEdgesOffset);
+  tree->mRunoffEdges.assign(runoffEdges, runoffEdges + header->numRunoffEdges);
+
+  return tree;
+}
+
+bool DivideTree::readCoordinateSystem(const std::string &filename,
+                                      CoordinateSystem *coordinateSystem) {
+  if (hasBinaryExtension(filename)) {
+    std::ifstream file(filename, std::ios::binary);
+    BinaryHeader header;
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        memcmp(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0 ||
+        header.byteOrderMark != BINARY_BYTE_ORDER_MARK ||
+        header.pixelsPerDegreeLatitude == 0 || header.pixelsPerDegreeLongitude == 0) {
+      return false;
     }
-    depth2 -= 1;
+    *coordinateSystem = CoordinateSystem(header.minLatitude, header.minLongitude,
+                                         header.pixelsPerDegreeLatitude,
+                                         header.pixelsPerDegreeLongitude);
+    return true;
   }
 
-  // Walk up one level at a time, looking for common ancestor
-  while (true) {
-    if (nodeId1 == Node::Null || nodeId2 == Node::Null) {
-      return Node::Null;
+  // The G line is the first one after any comments
+  std::ifstream file(filename);
+  string line;
+  vector<string> elements;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
     }
+    if (line[0] != 'G') {
+      return false;
+    }
+    split(line, ',', elements);
+    if (elements.size() != 5) {
+      return false;
+    }
+    *coordinateSystem = CoordinateSystem(stof(elements[1]), stof(elements[2]),
+                                         stoi(elements[3]), stoi(elements[4]));
+    return true;
+  }
+  return false;
+}
 
-    if (nodeId1 == nodeId2) {
-      return nodeId1;
+void DivideTree::startAddingEdges() {
+  int numNodes = (int) mNodes.size();
+  mForest = new LinkCutForest();
+  for (int peakId = 0; peakId < numNodes; ++peakId) {
+    mForest->addNode(LinkCutForest::NO_VALUE);
+  }
+  for (int peakId = 1; peakId < numNodes; ++peakId) {
+    const Node &node = mNodes[peakId];
+    if (node.parentId != Node::Null) {
+      int edgeNodeId = mForest->addNode(getSaddle(node.saddleId).elevation);
+      mForestEdgeSaddles.push_back(node.saddleId);
+      // Every node is still in a tree of its own, or the root of its tree
+      mForest->link(edgeNodeId, node.parentId);
+      mForest->link(peakId, edgeNodeId);
     }
+  }
+  mSurvivingPeaks.assign(numNodes, (int) Node::Null);
+}
+
+void DivideTree::addForestEdge(int peakId1, int peakId2, int saddleId) {
+  int edgeNodeId = mForest->addNode(getSaddle(saddleId).elevation);
+  mForestEdgeSaddles.push_back(saddleId);
+  mForest->link(edgeNodeId, peakId2);
+  mForest->link(peakId1, edgeNodeId);
+}
+
+void DivideTree::removeForestEdge(int edgeNodeId) {
+  // The edge node stays behind as the root of the lower peak's tree.
+  // With no value, it's never lowest on a path, and finishAddingEdges
+  // stops there.
+  mForest->cut(edgeNodeId);
+  mForest->setValue(edgeNodeId, LinkCutForest::NO_VALUE);
+  mForestEdgeSaddles[edgeNodeId - mNodes.size()] = Node::Null;
+}
 
-    nodeId1 = mNodes[nodeId1].parentId;
-    nodeId2 = mNodes[nodeId2].parentId;
+int DivideTree::findSurvivingPeak(int peakId) {
+  while (mSurvivingPeaks[peakId] != Node::Null) {
+    peakId = mSurvivingPeaks[peakId];
   }
+  return peakId;
 }
 
-int DivideTree::getDepth(int nodeId) {
-  int depth = 0;
+int DivideTree::findParentEdge(int peakId) {
+  // Peaks merged together are joined by edges with no saddle
+  int numNodes = (int) mNodes.size();
+  while (true) {
+    int edgeNodeId = mForest->parent(peakId);
+    if (edgeNodeId == LinkCutForest::Null) {
+      return LinkCutForest::Null;
+    }
+    int parentId = mForest->parent(edgeNodeId);
+    if (parentId == LinkCutForest::Null) {
+      return LinkCutForest::Null;  // Edge removed by removeForestEdge
+    }
+    if (mForestEdgeSaddles[edgeNodeId - numNodes] != Node::Null) {
+      return edgeNodeId;
+    }
+    peakId = parentId;
+  }
+}
 
-  do {
-    depth += 1;
-    nodeId = mNodes[nodeId].parentId;
-  } while (nodeId != Node::Null);
-  
-  return depth;
+int DivideTree::updateRunoffEdge(int runoffId) {
+  int peakId = mRunoffEdges[runoffId];
+  if (mForest == nullptr) {
+    return peakId;  // No peaks removed yet
+  }
+  int survivingPeakId = findSurvivingPeak(peakId);
+  if (survivingPeakId != peakId) {
+    mRunoffEdges[runoffId] = survivingPeakId;
+    // When a runoff is pointed at a new peak, we should mark
+    // it as no longer inside the flat area of a peak (since
+    // that applied only to its old peak).  The flat areas
+    // of two peaks obviously can't touch.
+    mRunoffs[runoffId].insidePeakArea = false;
+  }
+  return survivingPeakId;
 }
 
-void DivideTree::spliceAllRunoffs() {
+void DivideTree::spliceAllRunoffs(bool firstPeakLocations) {
   unordered_set<int> removedRunoffs;
 
   int pixelsAroundGlobe = 360 * mCoordinateSystem.pixelsPerDegreeLongitude();
@@ -666,7 +1198,7 @@ void DivideTree::spliceAllRunoffs() {
           int otherRunoffIndex = it->second;
           // Other runoff can't be deleted, and can't be us
           if (otherRunoffIndex != i && removedRunoffs.find(otherRunoffIndex) == removedRunoffs.end()) {
-            spliceTwoRunoffs(i, otherRunoffIndex, &removedRunoffs);
+            spliceTwoRunoffs(i, otherRunoffIndex, firstPeakLocations, &removedRunoffs);
             break;
           }
         }
@@ -677,14 +1209,17 @@ void DivideTree::spliceAllRunoffs() {
   // Actually remove dead runoffs
   removeVectorElementsByIndices(&mRunoffs, removedRunoffs);
   removeVectorElementsByIndices(&mRunoffEdges, removedRunoffs);
+
+  finishAddingEdges();
 }
 
-void DivideTree::spliceTwoRunoffs(int index1, int index2, unordered_set<int> *removedRunoffs) {
+void DivideTree::spliceTwoRunoffs(int index1, int index2, bool firstPeakLocations,
+                                  unordered_set<int> *removedRunoffs) {
   VLOG(3) << "Splicing runoffs " << index1 << " and " << index2;
 
   // Runoffs pointing at different peaks?
-  int peak1 = mRunoffEdges[index1];
-  int peak2 = mRunoffEdges[index2];
+  int peak1 = updateRunoffEdge(index1);
+  int peak2 = updateRunoffEdge(index2);
   bool wasRunoff1InsidePeakArea = mRunoffs[index1].insidePeakArea;
   bool wasRunoff2InsidePeakArea = mRunoffs[index2].insidePeakArea;
   if (peak1 != peak2) {
@@ -702,9 +1237,17 @@ void DivideTree::spliceTwoRunoffs(int index1, int index2, unordered_set<int> *re
     // other side of the boundary, or it's bogus.  Either way,
     // it's safe to remove one side.
     if (mRunoffs[index1].insidePeakArea) {
-      removePeak(mRunoffEdges[index1], mRunoffEdges[index2]);
+      if (firstPeakLocations && mRunoffs[index2].insidePeakArea) {
+        // Both peaks are the same flat area.  Location values are in row order.
+        Offsets location1 = mPeaks[peak1 - 1].location;
+        Offsets &location2 = mPeaks[peak2 - 1].location;
+        if (location1.value() < location2.value()) {
+          location2 = location1;
+        }
+      }
+      removePeak(peak1, peak2);
     } else if (mRunoffs[index2].insidePeakArea) {
-      removePeak(mRunoffEdges[index2], mRunoffEdges[index1]);
+      removePeak(peak2, peak1);
     }
   }
 
@@ -728,92 +1271,67 @@ void DivideTree::spliceTwoRunoffs(int index1, int index2, unordered_set<int> *re
 void DivideTree::removePeak(int peakId, int neighborPeakId) {
   VLOG(3) << "Removing peak " << peakId << " with neighbor " << neighborPeakId;
 
+  int numNodes = (int) mNodes.size();
+  
   // See if one peak is a child of the other.  If so, the saddle
   // between them is the one to remove.
-  int removedSaddleId = mNodes[peakId].saddleId;
-  if (mNodes[peakId].parentId != neighborPeakId) {
-    bool saddleOwnerIsChild = true;
-    if (mNodes[neighborPeakId].parentId != peakId) {
-      // There isn't a saddle between us and neighbor.  Remove our
-      // highest neighboring saddle, which is somewhat expensive to
-      // find.
-      VLOG(3) << "Rare case of removing peak with no saddle to neighbor";
-      int highestSaddleElevation = 0;
-      // Saddle to parent?
-      if (mNodes[peakId].parentId != Node::Null) {
-        neighborPeakId = mNodes[peakId].parentId;
-        highestSaddleElevation = getSaddle(mNodes[peakId].saddleId).elevation;
-        saddleOwnerIsChild = false;
-      }
-      // Saddle from child?
-      for (int nodeId = 1; nodeId < (int) mNodes.size(); ++nodeId) {
-        const Node &node = mNodes[nodeId];
-        if (node.parentId == peakId) {
-          int elevation = getSaddle(node.saddleId).elevation;
-          if (elevation > highestSaddleElevation) {
-            highestSaddleElevation = elevation;
-            neighborPeakId = nodeId;
-            saddleOwnerIsChild = true;
-          }
-        }
-      }
-
-      VLOG(3) << "Now removing peak " << peakId << " with neighbor " << neighborPeakId;
-    }
-
-    if (saddleOwnerIsChild) {
-      // Saddle owner is child of peakId: preserve previous saddle between peakId and its parent
-      removedSaddleId = mNodes[neighborPeakId].saddleId;
-      mNodes[neighborPeakId].parentId = mNodes[peakId].parentId;
-      mNodes[neighborPeakId].saddleId = mNodes[peakId].saddleId;
+  int removedEdgeId = LinkCutForest::Null;
+  int parentEdgeId = findParentEdge(peakId);
+  if (parentEdgeId != LinkCutForest::Null &&
+      findSurvivingPeak(mForest->parent(parentEdgeId)) == neighborPeakId) {
+    removedEdgeId = parentEdgeId;
+  } else {
+    int neighborEdgeId = findParentEdge(neighborPeakId);
+    if (neighborEdgeId != LinkCutForest::Null &&
+        findSurvivingPeak(mForest->parent(neighborEdgeId)) == peakId) {
+      removedEdgeId = neighborEdgeId;
     }
   }
 
-  assert(removedSaddleId != Node::Null);
-  
-  // Remove dead peak's node
-  mNodes.erase(mNodes.begin() + peakId);
-
-  // Remove dead peak and saddle
-  mPeaks.erase(mPeaks.begin() + peakId - 1);
-  mSaddles.erase(mSaddles.begin() + removedSaddleId - 1);
-  
-  // neighbor's ID may have changed by removal of peakId
-  if (neighborPeakId > peakId) {
-    neighborPeakId -= 1;
-  }
-  
-  // Update node pointers
-  for (Node &node : mNodes) {
-    if (node.parentId == peakId) {
-      node.parentId = neighborPeakId;
-    } else if (node.parentId > peakId) {
-      node.parentId -= 1;
+  if (removedEdgeId == LinkCutForest::Null) {
+    // There isn't a saddle between us and neighbor.  Remove our
+    // highest neighboring saddle, which is somewhat expensive to
+    // find.
+    VLOG(3) << "Rare case of removing peak with no saddle to neighbor";
+    int highestSaddleElevation = 0;
+    bool saddleOwnerIsChild = false;
+    // Saddle to parent?
+    if (parentEdgeId != LinkCutForest::Null) {
+      removedEdgeId = parentEdgeId;
+      neighborPeakId = findSurvivingPeak(mForest->parent(parentEdgeId));
+      highestSaddleElevation = mForest->value(parentEdgeId);
     }
-
-    if (node.saddleId > removedSaddleId) {
-      node.saddleId -= 1;
+    // Saddle from child?  Of equal saddles, the lowest peak ID wins.
+    for (int childId = 1; childId < numNodes; ++childId) {
+      int edgeId = mForest->parent(childId);
+      if (edgeId == LinkCutForest::Null ||
+          mForestEdgeSaddles[edgeId - numNodes] == Node::Null ||
+          findSurvivingPeak(mForest->parent(edgeId)) != peakId) {
+        continue;
+      }
+      int survivingChildId = findSurvivingPeak(childId);
+      int elevation = mForest->value(edgeId);
+      if (elevation > highestSaddleElevation ||
+          (elevation == highestSaddleElevation && saddleOwnerIsChild &&
+           survivingChildId < neighborPeakId)) {
+        highestSaddleElevation = elevation;
+        removedEdgeId = edgeId;
+        neighborPeakId = survivingChildId;
+        saddleOwnerIsChild = true;
+      }
     }
+
+    VLOG(3) << "Now removing peak " << peakId << " with neighbor " << neighborPeakId;
   }
 
-  // Update runoff edge pointers
-  int index = 0;
-  for (int &runoffEdgeId : mRunoffEdges) {
-    if (runoffEdgeId == peakId) {
-      runoffEdgeId = neighborPeakId;
-
-      // When a runoff is pointed at a new peak, we should mark
-      // it as no longer inside the flat area of a peak (since
-      // that applied only to its old peak).  The flat areas
-      // of two peaks obviously can't touch.
-      mRunoffs[index].insidePeakArea = false;
-    
-    } else if (runoffEdgeId > peakId) {
-      runoffEdgeId -= 1;
-    }
+  assert(removedEdgeId != LinkCutForest::Null);
 
-    index += 1;
-  }
+  // Merge the peak into its neighbor by leaving the edge between them
+  // in mForest, with no value and no saddle
+  mRemovedSaddleIds.push_back(mForestEdgeSaddles[removedEdgeId - numNodes]);
+  mForestEdgeSaddles[removedEdgeId - numNodes] = Node::Null;
+  mForest->setValue(removedEdgeId, LinkCutForest::NO_VALUE);
+  mSurvivingPeaks[peakId] = neighborPeakId;
 }
 
 const Peak &DivideTree::getPeak(int peakId) const {
@@ -845,6 +1363,7 @@ const std::vector<int> &DivideTree::runoffEdges() const {
 }
 
 const vector<DivideTree::Node> &DivideTree::nodes() const {
+  assert(mForest == nullptr);
   return mNodes;
 }
 
@@ -852,6 +1371,21 @@ void DivideTree::setSaddles(const std::vector<Saddle> saddles) {
   mSaddles = saddles;
 }
 
+size_t DivideTree::memoryBytes() const {
+  size_t forestBytes = 0;
+  if (mForest != nullptr) {
+    forestBytes = mForest->memoryBytes() +
+      mForestEdgeSaddles.capacity() * sizeof(int) +
+      mSurvivingPeaks.capacity() * sizeof(int) +
+      mRemovedSaddleIds.capacity() * sizeof(int);
+  }
+  return mPeaks.size() * sizeof(Peak) +
+    mSaddles.size() * sizeof(Saddle) +
+    mRunoffs.size() * sizeof(Runoff) +
+    mNodes.size() * sizeof(Node) +
+    mRunoffEdges.size() * sizeof(int) + forestBytes;
+}
+
 void DivideTree::debugPrint() const {
   int index = 0;
   for (const Node &node : mNodes) {
@@ -32,6 +32,7 @@
 #include <unordered_set>
 
 class IslandTree;
+class LinkCutForest;
 
 // Edges in the divide tree connect peaks that have a saddle between
 // them, where a walk up the two divides leaving the saddle reach the
@@ -58,6 +59,7 @@ public:
   DivideTree(const CoordinateSystem &coords,
              const std::vector<Peak> &peaks, const std::vector<Saddle> &saddles,
              const std::vector<Runoff> &runoffs);
+  ~DivideTree();
   
   // Attempt to add an edge between peak1 and peak2, going through the
   // given saddle.
@@ -66,8 +68,21 @@ public:
   // the lowest saddle is removed (potentially the given edge).
   //
   // Return the index of saddle that was removed (a basin saddle), or Node::Null if none.
+  //
+  // While edges are being added, the tree is kept in a LinkCutForest,
+  // so that each one takes O(log n) time, however deep the tree.  Call
+  // finishAddingEdges after the last one, before using the tree in any
+  // other way.
   int maybeAddEdge(int peakId1, int peakId2, int saddleId);
 
+  // Bring the nodes up to date after calls to maybeAddEdge
+  void finishAddingEdges();
+
+  // Make rootPeakId, which must be the root of its tree, a child of
+  // parentPeakId through the given saddle.  The peaks must be in
+  // different trees; unlike maybeAddEdge, this doesn't look for a cycle.
+  void addEdgeFromRoot(int rootPeakId, int parentPeakId, int saddleId);
+
   // Add an edge between the given peak and runoff.
   void addRunoffEdge(int peakId, int runoffId);
 
@@ -81,12 +96,22 @@ public:
 
   // Merge otherTree into this tree, splicing any matching runoffs.  The two trees
   // must already be in the same coordinate system (i.e. all location values are
-  // consistent with each other).
-  void merge(const DivideTree &otherTree);
+  // consistent with each other).  If firstPeakLocations is true, a peak whose
+  // flat area is split between the trees is placed at the first location of
+  // its copies in row order, rather than at the location of the copy kept.
+  void merge(const DivideTree &otherTree, bool firstPeakLocations = false);
   
   // Change the geographic origin of the tree
   bool setOrigin(const CoordinateSystem &coordinateSystem);
 
+  // Move every peak, saddle and runoff by the given number of pixels,
+  // without changing the coordinate system.
+  void offsetLocations(int dx, int dy);
+
+  // Renumber peaks in row order of their locations, the order in which
+  // TreeBuilder finds them
+  void sortPeaks();
+
   // Delete any false saddles.  This is an optimization to save space.
   void compact();
 
@@ -97,9 +122,30 @@ public:
   // Flip elevations so that depressions and mountains are swapped.
   void flipElevations();
 
+  // Memory used by the tree's elements, in bytes.  Spare capacity in
+  // its vectors isn't counted, so this doesn't jump when they grow.
+  size_t memoryBytes() const;
+
+  // Files whose names end in BINARY_EXTENSION are written and read in
+  // the binary format below; others are text.
   bool writeToFile(const std::string &filename) const;
 
   static DivideTree *readFromFile(const std::string &filename);
+
+  // The binary format holds the same fields as the text one, in native
+  // byte order: a header, then arrays of fixed-size peak, saddle,
+  // runoff, node and runoff edge records, each starting on an 8-byte
+  // boundary.  A memory-mapped file can be read with no parsing.
+  bool writeToBinaryFile(const std::string &filename) const;
+
+  static DivideTree *readFromBinaryFile(const std::string &filename);
+
+  // Read just the coordinate system of the tree in the given file, text
+  // or binary, without loading the tree.  Return false on error.
+  static bool readCoordinateSystem(const std::string &filename,
+                                   CoordinateSystem *coordinateSystem);
+
+  static const char BINARY_EXTENSION[];
   
   void debugPrint() const;
 
@@ -116,32 +162,40 @@ public:
   
 private:
 
-  // Make the given node the root of its tree by reversing parent links.
-  void makeNodeIntoRoot(int nodeId);
+  // Load mNodes into mForest
+  void startAddingEdges();
 
-  // Return the ID of the peak with the lowest saddle between the
-  // child and ancestor peak IDs, or Node::Null if the traversal reaches
-  // the root of the tree before reaching the ancestor (an error),
-  // or if the child and ancestor are the same.
-  int findLowestSaddleOnPath(int childPeakId, int ancestorPeakId);
+  // Add an edge between the given peaks, which must be in different
+  // trees of mForest.  peakId1 becomes a child of peakId2.
+  void addForestEdge(int peakId1, int peakId2, int saddleId);
 
-  // Return the lowest node that is the common ancestor of the two given nodes,
-  // or Node::Null if there isn't one.
-  int findCommonAncestor(int nodeId1, int nodeId2);
+  // Remove the given edge node from mForest
+  void removeForestEdge(int edgeNodeId);
 
-  // Return the depth of the given node in the tree.  A node with no parent has depth 1.
-  int getDepth(int nodeId);
+  // Return the peak that peakId has been merged into by removePeak, or
+  // peakId if it hasn't been
+  int findSurvivingPeak(int peakId);
+
+  // Return the edge node of mForest joining peakId (or a peak merged
+  // into it) to its parent peak, or LinkCutForest::Null if it has none
+  int findParentEdge(int peakId);
+
+  // Return the peak of the given runoff, first pointing the runoff at
+  // the surviving peak if its own was removed by removePeak
+  int updateRunoffEdge(int runoffId);
 
   // Convert pairs of runoffs at the same location into saddles
-  void spliceAllRunoffs();
+  void spliceAllRunoffs(bool firstPeakLocations);
   
   // Splice the two given runoffs together.  removedRunoffs is updated to contain the indices
   // of any runoffs that are deleted.
-  void spliceTwoRunoffs(int index1, int index2, std::unordered_set<int> *removedRunoffs);
+  void spliceTwoRunoffs(int index1, int index2, bool firstPeakLocations,
+                        std::unordered_set<int> *removedRunoffs);
 
-  // Remove the given peak.  neighborPeakId gives the neighboring peak whose connecting saddle
-  // edge in the tree should be removed.  If there's no saddle between them, then peakId's
-  // highest neighboring saddle will be removed.
+  // Remove the given peak, merging it into neighborPeakId, along with
+  // the saddle between them.  If there's no edge between them, the
+  // peak is merged into the neighbor with its highest saddle instead.
+  // The peak's node and the saddle are removed by finishAddingEdges.
   void removePeak(int peakId, int neighborPeakId);
   
   std::string getKmlForSaddle(const Saddle &saddle, const char *styleUrl, int index) const;
@@ -161,6 +215,23 @@ private:
   std::vector<Node> mNodes;
   // Holds peak ID connected to each runoff (parallel array to mRunoffs)
   std::vector<int> mRunoffEdges;
+
+  // While edges are being added, the tree is in mForest instead of
+  // mNodes.  Its first nodes are the peaks, with the same IDs, and the
+  // rest stand for edges, each one between its two peaks, with the
+  // elevation of its saddle as its value.
+  LinkCutForest *mForest;  // nullptr if mNodes is up to date
+  // Saddle ID of each edge node of mForest, starting with the first
+  // one; Node::Null for removed edges
+  std::vector<int> mForestEdgeSaddles;
+  // Peak that each peak was merged into by removePeak, or Node::Null
+  std::vector<int> mSurvivingPeaks;
+  // Saddles of the edges removed by removePeak
+  std::vector<int> mRemovedSaddleIds;
+
+  // Not copyable
+  DivideTree(const DivideTree &);
+  void operator=(const DivideTree &);
 };
 
 #endif  // _DIVIDE_TREE_H_
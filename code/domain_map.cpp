@@ -25,31 +25,44 @@
 #include "domain_map.h"
 #include "easylogging++.h"
 
+#include <algorithm>
 #include <math.h>
+#include <stdlib.h>
 
 using std::stack;
 using std::vector;
 
+DomainMap::FloodScratch::FloodScratch(int width, int height) :
+    markers(width, height) {
+}
+
+size_t DomainMap::FloodScratch::memoryBytes() const {
+  return markers.memoryBytes() + markedRanges.capacity() * sizeof(Range);
+}
+
 DomainMap::DomainMap(const Tile *tile) :
-    mPixels(tile->width(), tile->height()),
-    mMarkers(tile->width(), tile->height()) {
+    mPixels(tile->width(), tile->height()) {
   mTile = tile;
-  mMarkerValue = 1;
- }
+  mFlatRuns = nullptr;
+}
 
-void DomainMap::findFlatArea(int x, int y, Boundary *boundary) {
-  // Use a new marker value so we don't see the results of any previous operations
-  mMarkerValue += 1;
+void DomainMap::reset(const Tile *tile) {
+  mTile = tile;
+  mFlatRuns = nullptr;
+  mPixels.clear();
+}
+
+void DomainMap::findFlatArea(int x, int y, Boundary *boundary, FloodScratch *scratch) const {
   boundary->higherPoints.clear();
 
   Elevation elev = mTile->get(x, y);
 
   // Flood fill
-  mPendingRanges.push(Range(x, x, y));
+  scratch->pendingRanges.push(Range(x, x, y));
   
-  while (!mPendingRanges.empty()) {
-    Range range(mPendingRanges.top());
-    mPendingRanges.pop();
+  while (!scratch->pendingRanges.empty()) {
+    Range range(scratch->pendingRanges.top());
+    scratch->pendingRanges.pop();
 
     // Extend range to the left
     while (true) {
@@ -66,7 +79,7 @@ void DomainMap::findFlatArea(int x, int y, Boundary *boundary) {
         }
         break;
       }
-      range.xmin = leftx;
+      range.xmin = runStart(leftx, range.y);
     }
 
     // Extend range to the right
@@ -84,45 +97,50 @@ void DomainMap::findFlatArea(int x, int y, Boundary *boundary) {
         }
         break;
       }
-      range.xmax = rightx;
+      range.xmax = runEnd(rightx, range.y);
     }
 
     // Mark range as visited
-    for (Coord rx = range.xmin; rx <= range.xmax; ++rx) {
-      mMarkers.set(rx, range.y, mMarkerValue);
-    }
+    scratch->markers.setRange(range.xmin, range.xmax, range.y);
+    scratch->markedRanges.push_back(range);
 
     // Find adjacent ranges above
     if (range.y > 0) {
       Coord lo = -1;
       Coord topy = range.y - 1;
       Coord maxx = std::min(range.xmax + 1, mTile->width() - 1);
+      FlatRuns::RowCursor runs(mFlatRuns, topy, range.xmin - 1);
       for (Coord topx = range.xmin - 1; topx <= maxx; ++topx) {
         if (mTile->isInExtents(topx, topy)) {
           Elevation neighbor_elev = mTile->get(topx, topy);
+          // The rest of a run is the same as its first point
+          Coord lastx = stretchEnd(&runs, topx, maxx);
           if (neighbor_elev == elev) {
             if (lo == -1) {
               lo = topx;  // start of a range
             }
           } else {
             if (neighbor_elev != Tile::NODATA_ELEVATION && neighbor_elev > elev) {
-              boundary->higherPoints.push_back(Offsets(topx, topy).value());
+              for (Coord x = topx; x <= lastx; ++x) {
+                boundary->higherPoints.push_back(Offsets(x, topy).value());
+              }
             }
             if (lo != -1) {
               // End of a range.  Add it if it hasn't been filled before.
               // It's enough to check the leftmost pixel, since the whole
               // range is either empty or non-empty.
-              if (mMarkers.get(lo, topy) != mMarkerValue) {
-                mPendingRanges.push(Range(lo, topx - 1, topy));
+              if (!scratch->markers.get(lo, topy)) {
+                scratch->pendingRanges.push(Range(lo, topx - 1, topy));
               }
               lo = -1;
             }
           }
+          topx = lastx;
         }
       }
       // Didn't encounter end of range
-      if (lo != -1 && mMarkers.get(lo, topy) != mMarkerValue) {
-        mPendingRanges.push(Range(lo, maxx, topy));
+      if (lo != -1 && !scratch->markers.get(lo, topy)) {
+        scratch->pendingRanges.push(Range(lo, maxx, topy));
       }
     }
 
@@ -131,38 +149,54 @@ void DomainMap::findFlatArea(int x, int y, Boundary *boundary) {
       Coord lo = -1;
       Coord bottomy = range.y + 1;
       Coord maxx = std::min(range.xmax + 1, mTile->width() - 1);
+      FlatRuns::RowCursor runs(mFlatRuns, bottomy, range.xmin - 1);
       for (Coord bottomx = range.xmin - 1; bottomx <= maxx; ++bottomx) {
         if (mTile->isInExtents(bottomx, bottomy)) {
           Elevation neighbor_elev = mTile->get(bottomx, bottomy);
+          // The rest of a run is the same as its first point
+          Coord lastx = stretchEnd(&runs, bottomx, maxx);
           if (neighbor_elev == elev) {
             if (lo == -1) {
               lo = bottomx;  // start of a range
             }
           } else {
             if (neighbor_elev != Tile::NODATA_ELEVATION && neighbor_elev > elev) {
-              boundary->higherPoints.push_back(Offsets(bottomx, bottomy).value());
+              for (Coord x = bottomx; x <= lastx; ++x) {
+                boundary->higherPoints.push_back(Offsets(x, bottomy).value());
+              }
             }
             if (lo != -1) {
               // End of a range.  Add it if it hasn't been filled before.
               // It's enough to check the leftmost pixel, since the whole
               // range is either empty or non-empty.
-              if (mMarkers.get(lo, bottomy) != mMarkerValue) {
-                mPendingRanges.push(Range(lo, bottomx - 1, bottomy));
+              if (!scratch->markers.get(lo, bottomy)) {
+                scratch->pendingRanges.push(Range(lo, bottomx - 1, bottomy));
               }
               lo = -1;
             }
           }
+          bottomx = lastx;
         }
       }
       // Didn't encounter end of range
-      if (lo != -1 && mMarkers.get(lo, bottomy) != mMarkerValue) {
-        mPendingRanges.push(Range(lo, maxx, bottomy));
+      if (lo != -1 && !scratch->markers.get(lo, bottomy)) {
+        scratch->pendingRanges.push(Range(lo, maxx, bottomy));
       }
     }
   }
+
+  // Leave the markers clear for the next operation
+  for (const Range &range : scratch->markedRanges) {
+    scratch->markers.resetRange(range.xmin, range.xmax, range.y);
+  }
+  scratch->markedRanges.clear();
 }
 
-void DomainMap::fillFlatArea(int x, int y, Pixel value) {
+void DomainMap::fillFlatArea(int x, int y, Pixel value, vector<Range> *filledRanges) {
+  if (filledRanges != nullptr) {
+    filledRanges->clear();
+  }
+
   // Flood fill based on horizontal ranges
   Elevation elev = mTile->get(x, y);
 
@@ -178,7 +212,7 @@ void DomainMap::fillFlatArea(int x, int y, Pixel value) {
       if (leftx < 0 || mTile->get(leftx, range.y) != elev) {
         break;
       }
-      range.xmin = leftx;
+      range.xmin = runStart(leftx, range.y);
     }
 
     // Extend range to the right
@@ -187,18 +221,22 @@ void DomainMap::fillFlatArea(int x, int y, Pixel value) {
       if (rightx >= mTile->width() || mTile->get(rightx, range.y) != elev) {
         break;
       }
-      range.xmax = rightx;
+      range.xmax = runEnd(rightx, range.y);
     }
 
     // Fill range
     for (Coord rx = range.xmin; rx <= range.xmax; ++rx) {
       mPixels.set(rx, range.y, value);
     }
+    if (filledRanges != nullptr) {
+      filledRanges->push_back(range);
+    }
 
     // Find adjacent ranges above
     if (range.y > 0) {
       Coord lo = -1;
       Coord topy = range.y - 1;
+      FlatRuns::RowCursor runs(mFlatRuns, topy, range.xmin - 1);
       for (Coord topx = range.xmin - 1; topx <= range.xmax + 1; ++topx) {
         if (!mTile->isInExtents(topx, topy) || mTile->get(topx, topy) != elev) {
           if (lo != -1) {
@@ -214,6 +252,8 @@ void DomainMap::fillFlatArea(int x, int y, Pixel value) {
           if (lo == -1) {
             lo = topx;  // start of a range
           }
+          // The rest of a run is at the same elevation
+          topx = stretchEnd(&runs, topx, range.xmax + 1);
         }
       }
       // Didn't encounter end of range
@@ -226,6 +266,7 @@ void DomainMap::fillFlatArea(int x, int y, Pixel value) {
     if (range.y < mTile->height() - 1) {
       Coord lo = -1;
       Coord bottomy = range.y + 1;
+      FlatRuns::RowCursor runs(mFlatRuns, bottomy, range.xmin - 1);
       for (Coord bottomx = range.xmin - 1; bottomx <= range.xmax + 1; ++bottomx) {
         if (!mTile->isInExtents(bottomx, bottomy) || mTile->get(bottomx, bottomy) != elev) {
           if (lo != -1) {
@@ -239,6 +280,8 @@ void DomainMap::fillFlatArea(int x, int y, Pixel value) {
           if (lo == -1) {
             lo = bottomx;  // start of a range
           }
+          // The rest of a run is at the same elevation
+          bottomx = stretchEnd(&runs, bottomx, range.xmax + 1);
         }
       }
       // Didn't encounter end of range
@@ -247,50 +290,115 @@ void DomainMap::fillFlatArea(int x, int y, Pixel value) {
       }
     }
   }
+
+  if (filledRanges != nullptr) {
+    std::sort(filledRanges->begin(), filledRanges->end(), [](const Range &a, const Range &b) {
+        return a.y < b.y || (a.y == b.y && a.xmin < b.xmin);
+      });
+  }
 }
 
-Offsets DomainMap::findClosePointWithValue(Offsets location, Pixel value) const {
-  if (mPixels.get(location.x(), location.y()) == value) {
-    return location;
+Coord DomainMap::runStart(Coord x, Coord y) const {
+  const FlatRuns::Run *run = (mFlatRuns == nullptr) ? nullptr : mFlatRuns->find(x, y);
+  return (run == nullptr) ? x : run->xmin;
+}
+
+Coord DomainMap::runEnd(Coord x, Coord y) const {
+  const FlatRuns::Run *run = (mFlatRuns == nullptr) ? nullptr : mFlatRuns->find(x, y);
+  return (run == nullptr) ? x : run->xmax;
+}
+
+Coord DomainMap::stretchEnd(FlatRuns::RowCursor *runs, Coord x, Coord maxx) {
+  const FlatRuns::Run *run = runs->find(x);
+  return (run == nullptr) ? x : std::min(run->xmax, maxx);
+}
+
+// Return the position of (x, y) in the order of a search of square rings
+// around center: first the center, then each ring clockwise from its top
+// left corner.
+static int64 ringSearchOrder(Offsets center, Coord x, Coord y) {
+  int64 radius = std::max(abs(x - center.x()), abs(y - center.y()));
+  if (radius == 0) {
+    return 0;
   }
 
-  // This isn't particularly efficient, but for the kind of local searches we're doing
-  // it should be good enough.
-  for (int radius = 1; radius < mTile->width(); ++radius) {
-    int x = location.x() - radius;
-    int y = location.y() - radius;
-    int dx = 1;
-    int dy = 0;
-    while (true) {
-      if (mTile->isInExtents(x, y) && mPixels.get(x, y) == value) {
-        return Offsets(x, y);
-      }
+  Coord left = center.x() - radius;
+  Coord top = center.y() - radius;
+  int64 position;
+  if (y == top) {
+    position = x - left;  // Top edge, going right
+  } else if (x == center.x() + radius) {
+    position = 2 * radius + (y - top);  // Right edge, going down
+  } else if (y == center.y() + radius) {
+    position = 4 * radius + (center.x() + radius - x);  // Bottom edge, going left
+  } else {
+    position = 6 * radius + (center.y() + radius - y);  // Left edge, going up
+  }
 
-      if (x == location.x() + radius && y == location.y() - radius) {
-        // Top right corner: go down
-        dx = 0;
-        dy = 1;
-      } else if (x == location.x() + radius && y == location.y() + radius) {
-        // Bottom right corner: go left
-        dx = -1;
-        dy = 0;
-      } else if (x == location.x() - radius && y == location.y() + radius) {
-        // Bottom left corner: go up
-        dx = 0;
-        dy = -1;
-      }
+  // Smaller rings hold (2 * radius - 1)^2 points
+  return (2 * radius - 1) * (2 * radius - 1) + position;
+}
+
+Offsets DomainMap::findClosePointInRanges(Offsets location, const vector<Range> &ranges) {
+  if (ranges.empty()) {
+    LOG(ERROR) << "Failed to find point near " << location.x() << " " << location.y();
+    return location;
+  }
+
+  Coord minY = ranges.front().y;
+  Coord maxY = ranges.back().y;
+  int64 bestOrder = -1;
+  Offsets bestPoint = location;
 
-      x += dx;
-      y += dy;
+  // Visit rows outward from location.  Points in rows distance rows away
+  // are at least in ring distance, so stop once the best point comes before
+  // that ring, which starts after (2 * distance - 1)^2 points.
+  for (Coord distance = 0; ; ++distance) {
+    int64 ringStart = (2 * (int64) distance - 1) * (2 * (int64) distance - 1);
+    if (bestOrder >= 0 && distance > 0 && bestOrder < ringStart) {
+      break;
+    }
+    if (location.y() - distance < minY && location.y() + distance > maxY) {
+      break;
+    }
 
-      if (x == location.x() - radius && y == location.y() - radius) {
-        // Return to top left corner: done
+    for (int side = 0; side < 2; ++side) {
+      if (side == 1 && distance == 0) {
         break;
       }
+      Coord y = (side == 0) ? location.y() - distance : location.y() + distance;
+      if (y < minY || y > maxY) {
+        continue;
+      }
+
+      auto row = std::lower_bound(ranges.begin(), ranges.end(), y,
+                                  [](const Range &range, Coord y) { return range.y < y; });
+      for (; row != ranges.end() && row->y == y; ++row) {
+        // The points of the range closest to location are at its ends, or
+        // at the ends of the part of it in the smallest ring it reaches
+        Coord gap = 0;
+        if (location.x() < row->xmin) {
+          gap = row->xmin - location.x();
+        } else if (location.x() > row->xmax) {
+          gap = location.x() - row->xmax;
+        }
+        Coord radius = std::max(distance, gap);
+        Coord ends[2] = { std::max(row->xmin, location.x() - radius),
+                          std::min(row->xmax, location.x() + radius) };
+        for (Coord x : ends) {
+          int64 order = ringSearchOrder(location, x, y);
+          if (bestOrder < 0 || order < bestOrder) {
+            bestOrder = order;
+            bestPoint = Offsets(x, y);
+          }
+        }
+      }
     }
   }
 
-  LOG(ERROR) << "Failed to find point near " << location.x() << " " << location.y()
-             << " with value " << value;
-  return location;
+  return bestPoint;
+}
+
+size_t DomainMap::memoryBytes() const {
+  return mPixels.memoryBytes();
 }
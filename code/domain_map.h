@@ -35,6 +35,7 @@
 #ifndef _DOMAIN_MAP_H_
 #define _DOMAIN_MAP_H_
 
+#include "flat_runs.h"
 #include "tile.h"
 #include "pixel_array.h"
 
@@ -45,6 +46,19 @@ class DomainMap {
 public:
   explicit DomainMap(const Tile *tile);
 
+  // Empty the map and associate it with another tile of the same size
+  void reset(const Tile *tile);
+
+  // Use the given runs of mTile, which must outlive their use, to
+  // handle runs of equal samples as a unit in flood fills.  May be
+  // nullptr, the default.
+  void setFlatRuns(const FlatRuns *runs) {
+    mFlatRuns = runs;
+  }
+
+  int width() const { return mPixels.width(); }
+  int height() const { return mPixels.height(); }
+
   typedef int32 Pixel;
   static const Pixel EmptyPixel = PixelArray<Pixel>::EmptyPixel;
 
@@ -52,17 +66,48 @@ public:
   // is neither a peak nor a saddle.
   static const Pixel GenericFlatArea = -999999;
   
+  // A Range is the set of pixels at [xmin,y] through [xmax,y] inclusive.
+  struct Range {
+    Range(Coord minx, Coord maxx, Coord ycoord) {
+      xmin = minx;
+      xmax = maxx;
+      y = ycoord;
+    }
+    
+    Coord xmin, xmax;
+    Coord y;
+  };
+
   struct Boundary {
     std::vector<Offsets::Value> higherPoints;
   };
+
+  // Working memory for findFlatArea.  Each thread searching the same
+  // map needs its own.
+  struct FloodScratch {
+    FloodScratch(int width, int height);
+
+    size_t memoryBytes() const;
+
+    // Used to detect whether a given pixel has already been touched
+    // during a search.  All clear between searches.
+    PixelBitArray markers;
+    // Backed by a vector so that its memory is kept from one search to the next
+    std::stack<Range, std::vector<Range>> pendingRanges;
+    // Ranges set in markers during the current search, to be cleared
+    // at the end of it
+    std::vector<Range> markedRanges;
+  };
   
   // Find the flat region containing the given point, then fills in
   // boundary with the points on the boundary higher than the given
   // point.  A given point may appear in the boundary multiple times.
-  void findFlatArea(int x, int y, Boundary *boundary);
+  void findFlatArea(int x, int y, Boundary *boundary, FloodScratch *scratch) const;
 
   // Fill the 8-connected flat region at (x, y) with the given value.
-  void fillFlatArea(int x, int y, Pixel value);
+  // If filledRanges isn't nullptr, set it to the ranges that were filled,
+  // sorted by y and then xmin.  A pixel may be in more than one range.
+  void fillFlatArea(int x, int y, Pixel value, std::vector<Range> *filledRanges = nullptr);
   
   Pixel get(Offsets offsets) const {
     return get(offsets.x(), offsets.y());
@@ -72,35 +117,37 @@ public:
     return mPixels.get(x, y);
   }
 
-  // Find the (approximately) closest point to the given location that
-  // has the given pixel value.
-  Offsets findClosePointWithValue(Offsets location, Pixel value) const;
+  // Used to mark points with the peak whose domain they're in, once
+  // it's known
+  void set(int x, int y, Pixel value) {
+    mPixels.set(x, y, value);
+  }
+
+  // Find the (approximately) closest point to the given location in
+  // ranges, which must be sorted as from fillFlatArea.  The first point
+  // found by searching square rings of increasing size around location
+  // is returned, without visiting the points that aren't in ranges.
+  static Offsets findClosePointInRanges(Offsets location, const std::vector<Range> &ranges);
+
+  // Memory used by the map, in bytes
+  size_t memoryBytes() const;
 
 private:
   const Tile *mTile;
+  const FlatRuns *mFlatRuns;  // May be nullptr
   PixelArray<Pixel> mPixels;
 
-  // Used internally to detect whether a given pixel has already been touched
-  // during a given operation.
-  PixelArray<Pixel> mMarkers;
+  // Backed by a vector so that its memory is kept from one fill to the next
+  std::stack<Range, std::vector<Range>> mPendingRanges;
 
-  // An unused marker value for use during the next operation
-  int mMarkerValue;  
-
-  // A Range is the set of pixels at [xmin,y] through [xmax,y] inclusive.
-  // All pixels in a Range are known to be at the target elevation and are marked.
-  struct Range {
-    Range(Coord minx, Coord maxx, Coord ycoord) {
-      xmin = minx;
-      xmax = maxx;
-      y = ycoord;
-    }
-    
-    Coord xmin, xmax;
-    Coord y;
-  };
+  // Return the first or last x of the run containing (x, y), or x if
+  // it isn't in a run
+  Coord runStart(Coord x, Coord y) const;
+  Coord runEnd(Coord x, Coord y) const;
 
-  std::stack<Range> mPendingRanges;
+  // Return the last x' <= maxx such that samples x through x' of the
+  // cursor's row are known to be equal
+  static Coord stretchEnd(FlatRuns::RowCursor *runs, Coord x, Coord maxx);
 };
 
 #endif  // _DOMAIN_MAP_H_
@@ -0,0 +1,91 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "flat_runs.h"
+
+#include <algorithm>
+
+using std::vector;
+
+FlatRuns::RowCursor::RowCursor(const FlatRuns *runs, Coord y, Coord x) {
+  if (runs == nullptr || runs->mRuns.empty()) {
+    mNext = mEnd = nullptr;
+    return;
+  }
+
+  const Run *begin = runs->mRuns.data() + runs->mRowStarts[y];
+  mEnd = runs->mRuns.data() + runs->mRowStarts[y + 1];
+  mNext = std::lower_bound(begin, mEnd, x, [](const Run &run, Coord x) {
+      return run.xmax < x;
+    });
+}
+
+FlatRuns::FlatRuns() {
+}
+
+bool FlatRuns::build(const Tile *tile) {
+  mRuns.clear();
+  mRowStarts.clear();
+
+  int width = tile->width();
+  int height = tile->height();
+  int64 samplesInRuns = 0;
+  mRowStarts.reserve(height + 1);
+  for (int y = 0; y < height; ++y) {
+    mRowStarts.push_back((int32) mRuns.size());
+    const Elevation *row = tile->row(y);
+    int start = 0;
+    for (int x = 1; x <= width; ++x) {
+      if (x == width || row[x] != row[start]) {
+        if (x - start >= MIN_RUN_LENGTH) {
+          mRuns.push_back(Run(start, x - 1));
+          samplesInRuns += x - start;
+        }
+        start = x;
+      }
+    }
+  }
+  mRowStarts.push_back((int32) mRuns.size());
+
+  if (samplesInRuns * MIN_COVERAGE_DIVISOR < (int64) width * height) {
+    mRuns.clear();
+    mRowStarts.clear();
+    return false;
+  }
+
+  return true;
+}
+
+const FlatRuns::Run *FlatRuns::find(Coord x, Coord y) const {
+  if (mRuns.empty()) {
+    return nullptr;
+  }
+
+  RowCursor cursor(this, y, x);
+  return cursor.find(x);
+}
+
+size_t FlatRuns::memoryBytes() const {
+  return mRuns.capacity() * sizeof(Run) + mRowStarts.capacity() * sizeof(int32);
+}
@@ -0,0 +1,104 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * A run-length encoding of the long runs of equal samples in each row of
+ * a tile, such as the surface of a lake or a stretch of missing data.
+ * Code that walks over samples one at a time can use it to handle each
+ * run as one unit.
+ */
+
+#ifndef _FLAT_RUNS_H_
+#define _FLAT_RUNS_H_
+
+#include "primitives.h"
+#include "tile.h"
+
+#include <vector>
+
+class FlatRuns {
+public:
+  // A run of equal samples from xmin through xmax inclusive
+  struct Run {
+    Run(Coord minx, Coord maxx) :
+        xmin(minx), xmax(maxx) {
+    }
+
+    Coord xmin, xmax;
+  };
+
+  // Visits the runs of one row in order of increasing x
+  class RowCursor {
+  public:
+    // Start with the first run that ends at or after x.  runs may be
+    // nullptr, for a tile without runs.
+    RowCursor(const FlatRuns *runs, Coord y, Coord x);
+
+    // Return the first run that ends at or after x, or nullptr if none.
+    // x must not decrease from one call to the next.
+    const Run *next(Coord x) {
+      while (mNext != mEnd && mNext->xmax < x) {
+        ++mNext;
+      }
+      return (mNext != mEnd) ? mNext : nullptr;
+    }
+
+    // Return the run containing x, or nullptr if none.  x must not
+    // decrease from one call to the next.
+    const Run *find(Coord x) {
+      const Run *run = next(x);
+      return (run != nullptr && run->xmin <= x) ? run : nullptr;
+    }
+
+  private:
+    const Run *mNext;
+    const Run *mEnd;
+  };
+
+  FlatRuns();
+
+  // Find the runs of tile.  Return false, and keep no runs, if they
+  // cover too little of the tile to be worth using.
+  bool build(const Tile *tile);
+
+  // Return the run of row y containing x, or nullptr if none
+  const Run *find(Coord x, Coord y) const;
+
+  // Memory used, in bytes
+  size_t memoryBytes() const;
+
+  // Shorter runs of equal samples aren't kept
+  static const int MIN_RUN_LENGTH = 16;
+
+  // Runs are only kept if they cover at least 1 / MIN_COVERAGE_DIVISOR
+  // of the tile's samples
+  static const int MIN_COVERAGE_DIVISOR = 8;
+
+private:
+  std::vector<Run> mRuns;  // Runs of all rows, one row after another
+  // Index in mRuns of the first run of each row, plus one for the end
+  std::vector<int32> mRowStarts;
+};
+
+#endif  // _FLAT_RUNS_H_
@@ -0,0 +1,409 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "inflater.h"
+
+#include <algorithm>
+#include <string.h>
+
+// Base values and number of extra bits for length symbols 257..285
+static const uint16 LENGTH_BASE[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const uint8 LENGTH_EXTRA[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+
+// Base values and number of extra bits for distance symbols 0..29
+static const uint16 DISTANCE_BASE[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+static const uint8 DISTANCE_EXTRA[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+// Order in which code length code lengths are stored in a dynamic block header
+static const uint8 CODE_LENGTH_ORDER[19] = {
+  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+};
+
+static const int NUM_LENGTH_SYMBOLS = 29;
+static const int NUM_DISTANCE_SYMBOLS = 30;
+
+bool Inflater::Huffman::build(const uint8 *lengths, int numSymbols) {
+  memset(count, 0, sizeof(count));
+  memset(fastLength, 0, sizeof(fastLength));
+  for (int s = 0; s < numSymbols; ++s) {
+    count[lengths[s]] += 1;
+  }
+
+  // No codes at all is legal, e.g. a distance code for a block of literals
+  if (count[0] == numSymbols) {
+    return true;
+  }
+
+  // Reject over-subscribed codes.  Incomplete codes are allowed; any
+  // unused bit pattern fails to decode.
+  int left = 1;
+  for (int len = 1; len <= MAX_BITS; ++len) {
+    left <<= 1;
+    left -= count[len];
+    if (left < 0) {
+      return false;
+    }
+  }
+
+  // Sort symbols by code length, then by symbol value, which is the
+  // order of the canonical codes
+  uint16 offsets[MAX_BITS + 1];
+  offsets[1] = 0;
+  for (int len = 1; len < MAX_BITS; ++len) {
+    offsets[len + 1] = offsets[len] + count[len];
+  }
+  for (int s = 0; s < numSymbols; ++s) {
+    if (lengths[s] != 0) {
+      symbol[offsets[lengths[s]]++] = s;
+    }
+  }
+
+  // Fill the lookup table for short codes.  Codes are stored most
+  // significant bit first, but the input is read least significant
+  // bit first, so table indices are bit-reversed codes.
+  int nextCode[MAX_BITS + 1];
+  nextCode[1] = 0;
+  for (int len = 2; len <= MAX_BITS; ++len) {
+    nextCode[len] = (nextCode[len - 1] + count[len - 1]) << 1;
+  }
+  for (int s = 0; s < numSymbols; ++s) {
+    int len = lengths[s];
+    if (len == 0) {
+      continue;
+    }
+    int code = nextCode[len]++;
+    if (len > FAST_BITS) {
+      continue;
+    }
+    int reversed = 0;
+    for (int i = 0; i < len; ++i) {
+      reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    for (int index = reversed; index < (1 << FAST_BITS); index += (1 << len)) {
+      fastSymbol[index] = s;
+      fastLength[index] = len;
+    }
+  }
+
+  return true;
+}
+
+Inflater::Inflater(const uint8 *data, size_t size) {
+  mData = data;
+  mSize = size;
+  mPos = 0;
+  mBitBuffer = 0;
+  mBitCount = 0;
+  mState = State::BLOCK_HEADER;
+  mLastBlock = false;
+  mStoredRemaining = 0;
+  mMatchRemaining = 0;
+  mMatchDistance = 0;
+  mTotalOut = 0;
+}
+
+size_t Inflater::read(uint8 *out, size_t len) {
+  const int windowMask = WINDOW_SIZE - 1;
+  size_t produced = 0;
+
+  while (produced < len) {
+    // Finish any back-reference left over from the last call
+    if (mMatchRemaining > 0) {
+      int n = (int) std::min((size_t) mMatchRemaining, len - produced);
+      for (int i = 0; i < n; ++i) {
+        uint8 b = mWindow[(mTotalOut - mMatchDistance) & windowMask];
+        mWindow[mTotalOut++ & windowMask] = b;
+        out[produced++] = b;
+      }
+      mMatchRemaining -= n;
+      continue;
+    }
+    
+    switch (mState) {
+    case State::BLOCK_HEADER:
+      if (!readBlockHeader()) {
+        fail();
+      }
+      break;
+
+    case State::STORED:
+      if (mStoredRemaining == 0) {
+        mState = State::BLOCK_HEADER;
+      } else if (mBitCount >= 8) {
+        // Drain whole bytes already pulled into the bit buffer
+        uint8 b = (uint8) getBits(8);
+        mWindow[mTotalOut++ & windowMask] = b;
+        out[produced++] = b;
+        mStoredRemaining -= 1;
+      } else {
+        size_t n = std::min(mStoredRemaining, std::min(len - produced, mSize - mPos));
+        if (n == 0) {
+          fail();
+          break;
+        }
+        memcpy(out + produced, mData + mPos, n);
+        for (size_t i = 0; i < n; ++i) {
+          mWindow[mTotalOut++ & windowMask] = mData[mPos + i];
+        }
+        mPos += n;
+        produced += n;
+        mStoredRemaining -= n;
+      }
+      break;
+
+    case State::COMPRESSED: {
+      int symbol = decodeSymbol(mLiteralCode);
+      if (symbol < 0) {
+        fail();
+      } else if (symbol < 256) {
+        uint8 b = (uint8) symbol;
+        mWindow[mTotalOut++ & windowMask] = b;
+        out[produced++] = b;
+      } else if (symbol == 256) {
+        // End of block
+        mState = State::BLOCK_HEADER;
+      } else {
+        symbol -= 257;
+        if (symbol >= NUM_LENGTH_SYMBOLS) {
+          fail();
+          break;
+        }
+        int length = LENGTH_BASE[symbol] + getBits(LENGTH_EXTRA[symbol]);
+        int distanceSymbol = decodeSymbol(mDistanceCode);
+        if (distanceSymbol < 0 || distanceSymbol >= NUM_DISTANCE_SYMBOLS) {
+          fail();
+          break;
+        }
+        int distance = DISTANCE_BASE[distanceSymbol] + getBits(DISTANCE_EXTRA[distanceSymbol]);
+        if ((uint64) distance > mTotalOut || failed()) {
+          fail();
+          break;
+        }
+        mMatchRemaining = length;
+        mMatchDistance = distance;
+      }
+      break;
+    }
+
+    case State::DONE:
+    case State::ERROR_STATE:
+      return produced;
+    }
+  }
+
+  return produced;
+}
+
+void Inflater::refill() {
+  while (mBitCount <= 56 && mPos < mSize) {
+    mBitBuffer |= ((uint64) mData[mPos++]) << mBitCount;
+    mBitCount += 8;
+  }
+}
+
+uint32 Inflater::getBits(int n) {
+  if (mBitCount < n) {
+    refill();
+    if (mBitCount < n) {
+      // Ran off the end of the input
+      fail();
+      return 0;
+    }
+  }
+  uint32 value = (uint32) (mBitBuffer & ((((uint64) 1) << n) - 1));
+  mBitBuffer >>= n;
+  mBitCount -= n;
+  return value;
+}
+
+int Inflater::decodeSymbol(const Huffman &code) {
+  if (mBitCount < Huffman::MAX_BITS) {
+    refill();
+  }
+
+  // Fast path: missing bits past the end of the input read as zeros,
+  // so check that the code didn't depend on them
+  int index = (int) (mBitBuffer & ((1 << Huffman::FAST_BITS) - 1));
+  int length = code.fastLength[index];
+  if (length != 0 && length <= mBitCount) {
+    mBitBuffer >>= length;
+    mBitCount -= length;
+    return code.fastSymbol[index];
+  }
+
+  // Slow path: decode one bit at a time
+  int first = 0;
+  int codeValue = 0;
+  int symbolIndex = 0;
+  for (int len = 1; len <= Huffman::MAX_BITS; ++len) {
+    codeValue |= getBits(1);
+    if (failed()) {
+      return -1;
+    }
+    int count = code.count[len];
+    if (codeValue - count < first) {
+      return code.symbol[symbolIndex + (codeValue - first)];
+    }
+    symbolIndex += count;
+    first += count;
+    first <<= 1;
+    codeValue <<= 1;
+  }
+  return -1;
+}
+
+bool Inflater::readBlockHeader() {
+  if (mLastBlock) {
+    mState = State::DONE;
+    return true;
+  }
+
+  mLastBlock = getBits(1) == 1;
+  int type = getBits(2);
+  if (failed()) {
+    return false;
+  }
+
+  switch (type) {
+  case 0: {
+    // Stored block: skip to byte boundary, then read length and its complement
+    getBits(mBitCount & 7);
+    uint32 length = getBits(16);
+    uint32 complement = getBits(16);
+    if (failed() || length != (~complement & 0xffff)) {
+      return false;
+    }
+    mStoredRemaining = length;
+    mState = State::STORED;
+    return true;
+  }
+
+  case 1:
+    buildFixedCodes();
+    mState = State::COMPRESSED;
+    return true;
+
+  case 2:
+    if (!readDynamicCodes()) {
+      return false;
+    }
+    mState = State::COMPRESSED;
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+bool Inflater::readDynamicCodes() {
+  int numLengthCodes = getBits(5) + 257;
+  int numDistanceCodes = getBits(5) + 1;
+  int numCodeLengthCodes = getBits(4) + 4;
+  if (failed() || numLengthCodes > 286 || numDistanceCodes > 30) {
+    return false;
+  }
+
+  // Code that encodes the code lengths of the two real codes
+  uint8 lengths[286 + 30];
+  memset(lengths, 0, sizeof(lengths));
+  for (int i = 0; i < numCodeLengthCodes; ++i) {
+    lengths[CODE_LENGTH_ORDER[i]] = (uint8) getBits(3);
+  }
+  // Borrow the distance code's storage; it's rebuilt below
+  Huffman &codeLengthCode = mDistanceCode;
+  if (failed() || !codeLengthCode.build(lengths, 19)) {
+    return false;
+  }
+
+  int numLengths = numLengthCodes + numDistanceCodes;
+  int index = 0;
+  while (index < numLengths) {
+    int symbol = decodeSymbol(codeLengthCode);
+    if (symbol < 0) {
+      return false;
+    }
+    if (symbol < 16) {
+      lengths[index++] = (uint8) symbol;
+      continue;
+    }
+
+    // Run of repeated lengths
+    uint8 repeatedLength = 0;
+    int repeat;
+    if (symbol == 16) {
+      if (index == 0) {
+        return false;
+      }
+      repeatedLength = lengths[index - 1];
+      repeat = 3 + getBits(2);
+    } else if (symbol == 17) {
+      repeat = 3 + getBits(3);
+    } else {
+      repeat = 11 + getBits(7);
+    }
+    if (failed() || index + repeat > numLengths) {
+      return false;
+    }
+    while (repeat-- > 0) {
+      lengths[index++] = repeatedLength;
+    }
+  }
+
+  // A block must be able to end
+  if (lengths[256] == 0) {
+    return false;
+  }
+
+  return mLiteralCode.build(lengths, numLengthCodes) &&
+      mDistanceCode.build(lengths + numLengthCodes, numDistanceCodes);
+}
+
+void Inflater::buildFixedCodes() {
+  uint8 lengths[288];
+  int s = 0;
+  for (; s < 144; ++s) lengths[s] = 8;
+  for (; s < 256; ++s) lengths[s] = 9;
+  for (; s < 280; ++s) lengths[s] = 7;
+  for (; s < 288; ++s) lengths[s] = 8;
+  mLiteralCode.build(lengths, 288);
+
+  for (s = 0; s < 30; ++s) lengths[s] = 5;
+  mDistanceCode.build(lengths, 30);
+}
+
+void Inflater::fail() {
+  mState = State::ERROR_STATE;
+}
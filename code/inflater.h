@@ -0,0 +1,120 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * A streaming decoder for raw DEFLATE data (RFC 1951), as stored in zip files.
+ *
+ * The entire compressed stream must be in memory (typically a memory-mapped
+ * file), but the uncompressed data is produced incrementally, so that
+ * callers can process very large entries a piece at a time.
+ */
+
+#ifndef _INFLATER_H_
+#define _INFLATER_H_
+
+#include "primitives.h"
+
+#include <stddef.h>
+
+class Inflater {
+public:
+  // data must remain valid for the lifetime of the Inflater
+  Inflater(const uint8 *data, size_t size);
+
+  // Decompress up to len bytes into out.  Returns the number of bytes
+  // produced, which is less than len only at the end of the stream or
+  // on error.
+  size_t read(uint8 *out, size_t len);
+
+  // true if the stream was found to be corrupt
+  bool failed() const { return mState == State::ERROR_STATE; }
+
+  // true if the end of the stream has been reached
+  bool finished() const { return mState == State::DONE; }
+
+private:
+  // Canonical Huffman code, with a lookup table for short codes
+  struct Huffman {
+    static const int MAX_BITS = 15;
+    static const int FAST_BITS = 10;
+    static const int MAX_SYMBOLS = 288;
+
+    uint16 count[MAX_BITS + 1];  // Number of codes of each length
+    uint16 symbol[MAX_SYMBOLS];  // Symbols ordered by code
+    // Indexed by the next FAST_BITS bits of input.  Length 0 means the
+    // code is longer than FAST_BITS and must be decoded slowly.
+    uint16 fastSymbol[1 << FAST_BITS];
+    uint8 fastLength[1 << FAST_BITS];
+
+    // Returns false if the lengths don't describe a valid code
+    bool build(const uint8 *lengths, int numSymbols);
+  };
+
+  enum class State {
+    BLOCK_HEADER,  // Expecting the start of a new block
+    STORED,        // Inside an uncompressed block
+    COMPRESSED,    // Inside a Huffman-coded block
+    DONE,
+    ERROR_STATE,
+  };
+
+  const uint8 *mData;
+  size_t mSize;
+  size_t mPos;  // Next unread byte of mData
+
+  uint64 mBitBuffer;
+  int mBitCount;
+
+  State mState;
+  bool mLastBlock;
+  size_t mStoredRemaining;
+
+  Huffman mLiteralCode;
+  Huffman mDistanceCode;
+
+  // Back-reference that didn't fit in the caller's buffer
+  int mMatchRemaining;
+  int mMatchDistance;
+
+  // The last 32K of output, needed to resolve back-references
+  static const int WINDOW_SIZE = 1 << 15;
+  uint8 mWindow[WINDOW_SIZE];
+  uint64 mTotalOut;
+
+  void refill();
+  uint32 getBits(int n);
+  int decodeSymbol(const Huffman &code);
+
+  bool readBlockHeader();
+  bool readDynamicCodes();
+  void buildFixedCodes();
+
+  void fail();
+
+  // Not copyable
+  Inflater(const Inflater &);
+  void operator=(const Inflater &);
+};
+
+#endif  // _INFLATER_H_
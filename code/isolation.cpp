@@ -28,6 +28,8 @@
 #include "ThreadPool.h"
 #include "tile.h"
 #include "tile_loading_policy.h"
+#include "tile_pack.h"
+#include "tile_summary.h"
 
 #include "easylogging++.h"
 
@@ -50,16 +52,29 @@ using std::vector;
 
 INITIALIZE_EASYLOGGINGPP
 
+// Threads that load tiles ahead of the threads doing computation
+static const int NUM_PREFETCH_THREADS = 2;
+
 static void usage() {
   printf("Usage:\n");
   printf("  isolation min_lat max_lat min_lng max_lng\n");
   printf("  where coordinates are integer degrees\n");
   printf("\n");
   printf("  Options:\n");
-  printf("  -i directory     Directory with terrain data\n");
+  printf("  -c megabytes     Limit cache of neighboring tiles by size, default = 50 tiles\n");
+  printf("  -e policy        Cache eviction policy, \"LRU\" or \"2Q\", default = 2Q\n");
+  printf("  -i directory     Directory with terrain data, or tile pack file for PACK\n");
+  printf("  -f format        \"SRTM\" input files (the default), or \"PACK\" for a tile\n");
+  printf("                   pack from make_tile_pack\n");
+  printf("  -j filename      Write tile cache statistics to filename as JSON\n");
+  printf("  -l seconds       Report tile cache statistics every so many seconds\n");
   printf("  -m min_isolation Minimum isolation threshold for output, default = 1km\n");
   printf("  -o directory     Directory for output data\n");
   printf("  -p filename      Peakbagger peak database file for matching\n");
+  printf("  -r megabytes     Memory for tiles read ahead of computation, default = 512;\n");
+  printf("                   0 disables read-ahead\n");
+  printf("  -s filename      Tile summary from make_tile_summary, to skip tiles\n");
+  printf("                   without loading them\n");
   printf("  -t num_threads   Number of threads, default = 1\n");
   exit(1);
 }
@@ -68,19 +83,55 @@ int main(int argc, char **argv) {
   string terrain_directory(".");
   string output_directory(".");
   string peakbagger_filename;
+  string statsFilename;
+  int statsIntervalSeconds = 0;
+  string summary_filename;
 
   float minIsolation = 1;
   int numThreads = 1;
+  int prefetchMegabytes = 512;
+  int cacheMegabytes = 0;
+  string evictionPolicyName("2Q");
+  bool usePack = false;
   
   // Parse options
   START_EASYLOGGINGPP(argc, argv);
   int ch;
-  while ((ch = getopt(argc, argv, "i:m:o:p:t:")) != -1) {
+  string str;
+  while ((ch = getopt(argc, argv, "c:e:f:i:j:l:m:o:p:r:s:t:")) != -1) {
     switch (ch) {
+    case 'c':
+      cacheMegabytes = atoi(optarg);
+      break;
+
+    case 'e':
+      evictionPolicyName = optarg;
+      break;
+
+    case 'f':
+      str = optarg;
+      if (str == "SRTM") {
+        usePack = false;
+      } else if (str == "PACK") {
+        usePack = true;
+      } else {
+        printf("Unknown file format %s\n", optarg);
+        usage();
+      }
+      break;
+
     case 'i':
       terrain_directory = optarg;
       break;
 
+    case 'j':
+      statsFilename = optarg;
+      break;
+
+    case 'l':
+      statsIntervalSeconds = atoi(optarg);
+      break;
+
     case 'm':
       minIsolation = (float) atof(optarg);
       break;
@@ -93,6 +144,14 @@ int main(int argc, char **argv) {
       peakbagger_filename = optarg;
       break;
 
+    case 'r':
+      prefetchMegabytes = atoi(optarg);
+      break;
+
+    case 's':
+      summary_filename = optarg;
+      break;
+
     case 't':
       numThreads = atoi(optarg);
       break;
@@ -133,20 +192,50 @@ int main(int argc, char **argv) {
     }
   }
 
-  BasicTileLoadingPolicy policy(terrain_directory, FileFormat::HGT);
+  TileLoadingPolicy *policy = nullptr;
+  TilePack *pack = nullptr;
+  if (usePack) {
+    pack = new TilePack();
+    if (!pack->open(terrain_directory)) {
+      printf("Couldn't open tile pack %s\n", terrain_directory.c_str());
+      exit(1);
+    }
+    policy = new TilePackLoadingPolicy(pack);
+  } else {
+    BasicTileLoadingPolicy *basicPolicy = new BasicTileLoadingPolicy(terrain_directory, FileFormat::HGT);
+    basicPolicy->enableMemoryMappedLoading(true);
+    policy = basicPolicy;
+  }
+  CacheEvictionPolicy *evictionPolicy = CacheEvictionPolicy::create(evictionPolicyName);
+  if (evictionPolicy == nullptr) {
+    printf("Unknown cache eviction policy %s\n", evictionPolicyName.c_str());
+    usage();
+  }
   const int CACHE_SIZE = 50;
-  TileCache *cache = new TileCache(&policy, peakbagger_peaks, CACHE_SIZE);
+  TileCache *cache = new TileCache(policy, peakbagger_peaks, CACHE_SIZE);
+  cache->setEvictionPolicy(evictionPolicy);
+  if (cacheMegabytes > 0) {
+    cache->setMaxBytes((size_t) cacheMegabytes * 1024 * 1024);
+  }
+  TileSummary *summary = nullptr;
+  if (!summary_filename.empty()) {
+    summary = new TileSummary();
+    if (!summary->readFromFile(summary_filename)) {
+      printf("Couldn't load tile summary from %s\n", summary_filename.c_str());
+      exit(1);
+    }
+    cache->setSummary(summary);
+  }
 
   set<Offsets::Value> tilesToSkip;
   tilesToSkip.insert(Offsets(47, -87).value());  // in Lake Superior; lots of fake peaks
 
   VLOG(2) << "Using " << numThreads << " threads";
   
-  ThreadPool *threadPool = new ThreadPool(numThreads);
-  int num_tiles_processed = 0;
-  vector<std::future<bool>> results;
+  // Decide which tiles to process up front, so that they can be prefetched
+  vector<std::pair<int, int>> tiles;
   for (int lat = (int) floor(bounds[0]); lat < (int) ceil(bounds[1]); ++lat) {
-     for (int lng = (int) floor(bounds[2]); lng < (int) ceil(bounds[3]); ++lng) {
+    for (int lng = (int) floor(bounds[2]); lng < (int) ceil(bounds[3]); ++lng) {
       // Skip some very slow tiles known to have no peaks
       Offsets coords(lat, lng);
       if (tilesToSkip.find(coords.value()) != tilesToSkip.end()) {
@@ -154,13 +243,29 @@ int main(int argc, char **argv) {
         continue;
       }
 
-      IsolationTask *task = new IsolationTask(cache, output_directory, bounds, minIsolation);
-      results.push_back(threadPool->enqueue([=] {
-            return task->run(lat, lng, peakbagger_peaks);
-          }));
+      tiles.push_back(std::make_pair(lat, lng));
     }
   }
 
+  if (prefetchMegabytes > 0) {
+    cache->startPrefetching(tiles, NUM_PREFETCH_THREADS, (size_t) prefetchMegabytes * 1024 * 1024);
+  }
+  
+  CacheStatsReporter statsReporter(cache->stats(), statsIntervalSeconds, statsFilename);
+  statsReporter.start();
+
+  ThreadPool *threadPool = new ThreadPool(numThreads);
+  int num_tiles_processed = 0;
+  vector<std::future<bool>> results;
+  for (auto &coords : tiles) {
+    int lat = coords.first;
+    int lng = coords.second;
+    IsolationTask *task = new IsolationTask(cache, output_directory, bounds, minIsolation);
+    results.push_back(threadPool->enqueue([=] {
+          return task->run(lat, lng, peakbagger_peaks);
+        }));
+  }
+
   for (auto && result : results) {
     if (result.get()) {
       num_tiles_processed += 1;
@@ -168,9 +273,19 @@ int main(int argc, char **argv) {
   }
     
   printf("Tiles processed = %d\n", num_tiles_processed);
+  printf("Duplicate tile loads avoided = %d\n", cache->numDuplicateLoadsAvoided());
+  if (prefetchMegabytes > 0) {
+    TileCache::PrefetchStats stats = cache->prefetchStats();
+    printf("Tiles read ahead = %d, load time = %.1fs, compute waited %.1fs for %d tiles\n",
+           stats.numPrefetched, stats.loadSeconds, stats.stallSeconds, stats.numStalls);
+  }
+  statsReporter.stop();
 
   delete threadPool;
   delete cache;
+  delete summary;
+  delete policy;
+  delete pack;
   delete peakbagger_peaks;
 
   return 0;
@@ -112,6 +112,13 @@ IsolationRecord IsolationFinder::findIsolation(Offsets peak) const {
         LatLng *locationToUse = nullptr;
         if (lat != peakLat || lng != peakLng) {
           locationToUse = &peakLocation;
+
+          // Skip the tile if the summary shows it can't have anything closer
+          if (record.foundHigherGround &&
+              mCache->minDistanceToHigherGround(lat, neighborLng, peakLocation, elev) >=
+              record.distance) {
+            continue;
+          }
         }
         IsolationRecord neighborRecord = checkNeighboringTile(lat, neighborLng, locationToUse,
                                                               Offsets(seedx, seedy), elev);
@@ -339,10 +346,10 @@ IsolationRecord IsolationFinder::checkNeighboringTile(int lat, int lng, const La
   }
   
   // Look in neighbor for nearest higher ground to close point
-  Tile *neighbor = mCache->getOrLoad(lat, lng);
-  if (neighbor != nullptr) {
+  TileHandle neighbor = mCache->getOrLoad(lat, lng);
+  if (neighbor.get() != nullptr) {
     // TODO: This asssumes that neighbor tile has same size as this tile.  Could use lat/lng instead.
-    return findIsolation(neighbor, peakLocation, seedCoords, elev);
+    return findIsolation(neighbor.get(), peakLocation, seedCoords, elev);
   }
   return IsolationRecord();  // Nothing found
 }
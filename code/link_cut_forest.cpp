@@ -0,0 +1,247 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "link_cut_forest.h"
+
+#include <limits.h>
+#include <utility>
+
+const int LinkCutForest::NO_VALUE = INT_MAX;
+
+LinkCutForest::LinkCutForest() {
+}
+
+int LinkCutForest::addNode(int value) {
+  Node node;
+  node.left = Null;
+  node.right = Null;
+  node.parent = Null;
+  node.reversed = false;
+  node.value = value;
+  node.minValue = value;
+  node.firstMinId = static_cast<int>(mNodes.size());
+  node.lastMinId = node.firstMinId;
+  mNodes.push_back(node);
+  return node.firstMinId;
+}
+
+void LinkCutForest::setValue(int nodeId, int value) {
+  access(nodeId);
+  mNodes[nodeId].value = value;
+  update(nodeId);
+}
+
+void LinkCutForest::link(int childId, int parentId) {
+  makeRoot(childId);
+  mNodes[childId].parent = parentId;
+}
+
+void LinkCutForest::cut(int nodeId) {
+  access(nodeId);
+  int leftId = mNodes[nodeId].left;
+  if (leftId != Null) {
+    mNodes[leftId].parent = Null;
+    mNodes[nodeId].left = Null;
+    update(nodeId);
+  }
+}
+
+void LinkCutForest::makeRoot(int nodeId) {
+  access(nodeId);
+  reverse(nodeId);
+}
+
+int LinkCutForest::parent(int nodeId) {
+  access(nodeId);
+  // The parent is the deepest node above this one on its path
+  int parentId = mNodes[nodeId].left;
+  if (parentId == Null) {
+    return Null;
+  }
+  pushDown(parentId);
+  while (mNodes[parentId].right != Null) {
+    parentId = mNodes[parentId].right;
+    pushDown(parentId);
+  }
+  splay(parentId);
+  return parentId;
+}
+
+int LinkCutForest::findRoot(int nodeId) {
+  access(nodeId);
+  int rootId = nodeId;
+  pushDown(rootId);
+  while (mNodes[rootId].left != Null) {
+    rootId = mNodes[rootId].left;
+    pushDown(rootId);
+  }
+  splay(rootId);
+  return rootId;
+}
+
+int LinkCutForest::findCommonAncestor(int nodeId1, int nodeId2) {
+  if (findRoot(nodeId1) != findRoot(nodeId2)) {
+    return Null;
+  }
+  // The path from the root to nodeId2 leaves the one to nodeId1 at the
+  // common ancestor
+  access(nodeId1);
+  return access(nodeId2);
+}
+
+int LinkCutForest::findLowestBelow(int nodeId, int ancestorId) {
+  // After this, the nodes below the ancestor on the path are its right subtree
+  access(nodeId);
+  splay(ancestorId);
+  int belowId = mNodes[ancestorId].right;
+  if (belowId == Null || mNodes[belowId].minValue == NO_VALUE) {
+    return Null;
+  }
+  return mNodes[belowId].lastMinId;
+}
+
+bool LinkCutForest::isSplayRoot(int nodeId) const {
+  int parentId = mNodes[nodeId].parent;
+  return parentId == Null ||
+    (mNodes[parentId].left != nodeId && mNodes[parentId].right != nodeId);
+}
+
+void LinkCutForest::reverse(int nodeId) {
+  Node &node = mNodes[nodeId];
+  std::swap(node.left, node.right);
+  std::swap(node.firstMinId, node.lastMinId);
+  node.reversed = !node.reversed;
+}
+
+void LinkCutForest::pushDown(int nodeId) {
+  Node &node = mNodes[nodeId];
+  if (node.reversed) {
+    if (node.left != Null) {
+      reverse(node.left);
+    }
+    if (node.right != Null) {
+      reverse(node.right);
+    }
+    node.reversed = false;
+  }
+}
+
+void LinkCutForest::update(int nodeId) {
+  Node &node = mNodes[nodeId];
+  node.minValue = node.value;
+  node.firstMinId = nodeId;
+  node.lastMinId = nodeId;
+  if (node.left != Null) {
+    const Node &left = mNodes[node.left];
+    if (left.minValue < node.minValue) {
+      node.minValue = left.minValue;
+      node.firstMinId = left.firstMinId;
+      node.lastMinId = left.lastMinId;
+    } else if (left.minValue == node.minValue) {
+      node.firstMinId = left.firstMinId;
+    }
+  }
+  if (node.right != Null) {
+    const Node &right = mNodes[node.right];
+    if (right.minValue < node.minValue) {
+      node.minValue = right.minValue;
+      node.firstMinId = right.firstMinId;
+      node.lastMinId = right.lastMinId;
+    } else if (right.minValue == node.minValue) {
+      node.lastMinId = right.lastMinId;
+    }
+  }
+}
+
+void LinkCutForest::rotate(int nodeId) {
+  int parentId = mNodes[nodeId].parent;
+  int grandparentId = mNodes[parentId].parent;
+  bool parentWasSplayRoot = isSplayRoot(parentId);
+
+  if (mNodes[parentId].left == nodeId) {
+    int movedId = mNodes[nodeId].right;
+    mNodes[parentId].left = movedId;
+    if (movedId != Null) {
+      mNodes[movedId].parent = parentId;
+    }
+    mNodes[nodeId].right = parentId;
+  } else {
+    int movedId = mNodes[nodeId].left;
+    mNodes[parentId].right = movedId;
+    if (movedId != Null) {
+      mNodes[movedId].parent = parentId;
+    }
+    mNodes[nodeId].left = parentId;
+  }
+  mNodes[parentId].parent = nodeId;
+  mNodes[nodeId].parent = grandparentId;
+
+  // Otherwise grandparentId is a path parent, which keeps no child link
+  if (!parentWasSplayRoot) {
+    if (mNodes[grandparentId].left == parentId) {
+      mNodes[grandparentId].left = nodeId;
+    } else {
+      mNodes[grandparentId].right = nodeId;
+    }
+  }
+
+  update(parentId);
+  update(nodeId);
+}
+
+void LinkCutForest::splay(int nodeId) {
+  // Apply pending reversals from the top of the splay tree down
+  mSplayPath.clear();
+  int id = nodeId;
+  mSplayPath.push_back(id);
+  while (!isSplayRoot(id)) {
+    id = mNodes[id].parent;
+    mSplayPath.push_back(id);
+  }
+  for (auto it = mSplayPath.rbegin(); it != mSplayPath.rend(); ++it) {
+    pushDown(*it);
+  }
+
+  while (!isSplayRoot(nodeId)) {
+    int parentId = mNodes[nodeId].parent;
+    if (!isSplayRoot(parentId)) {
+      int grandparentId = mNodes[parentId].parent;
+      bool zigZig = (mNodes[grandparentId].left == parentId) == (mNodes[parentId].left == nodeId);
+      rotate(zigZig ? parentId : nodeId);
+    }
+    rotate(nodeId);
+  }
+}
+
+int LinkCutForest::access(int nodeId) {
+  int lastId = Null;
+  for (int id = nodeId; id != Null; id = mNodes[id].parent) {
+    splay(id);
+    mNodes[id].right = lastId;
+    update(id);
+    lastId = id;
+  }
+  splay(nodeId);
+  return lastId;
+}
@@ -0,0 +1,122 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LINK_CUT_FOREST_H_
+#define _LINK_CUT_FOREST_H_
+
+#include <stddef.h>
+#include <vector>
+
+// A forest of rooted trees that can be linked, cut and rerooted, and
+// queried for the node with the lowest value on a path, each in
+// O(log n) amortized time.  This is a link-cut tree: each tree is split
+// into paths, each of which is kept in a splay tree ordered by depth.
+//
+// Nodes are identified by consecutive integers starting at 0, in the
+// order they were added.
+
+class LinkCutForest {
+public:
+  LinkCutForest();
+
+  // Value of nodes that never count as lowest on a path
+  static const int NO_VALUE;
+
+  static const int Null = -1;
+
+  // Add a node, in a tree of its own, and return its ID
+  int addNode(int value);
+
+  int numNodes() const { return static_cast<int>(mNodes.size()); }
+
+  int value(int nodeId) const { return mNodes[nodeId].value; }
+  void setValue(int nodeId, int value);
+
+  // Make child, which must not be in the same tree as parent, a child of
+  // parent.  The child's tree is rerooted at child first.
+  void link(int childId, int parentId);
+
+  // Separate nodeId and its subtree from its parent
+  void cut(int nodeId);
+
+  // Make nodeId the root of its tree, reversing the parent links on the
+  // way from it to the old root
+  void makeRoot(int nodeId);
+
+  // Return the parent of nodeId, or Null if it's a root
+  int parent(int nodeId);
+
+  int findRoot(int nodeId);
+
+  // Return the deepest node that's an ancestor of both nodes (or one of
+  // the nodes itself), or Null if they're in different trees
+  int findCommonAncestor(int nodeId1, int nodeId2);
+
+  // Return the node with the lowest value on the path from nodeId up to
+  // ancestorId, not counting ancestorId.  Of nodes with the same value,
+  // the one closest to nodeId wins.  Return Null if every node on the
+  // path has NO_VALUE.  ancestorId must be an ancestor of nodeId.
+  int findLowestBelow(int nodeId, int ancestorId);
+
+  size_t memoryBytes() const {
+    return mNodes.capacity() * sizeof(Node);
+  }
+
+private:
+  struct Node {
+    // Children in the splay tree of this node's path; left is toward
+    // the root of the tree
+    int left;
+    int right;
+    // Parent in the splay tree, or if this is the root of its splay
+    // tree, the parent in the forest of the path's top node
+    int parent;
+    // The children of this node are swapped, and the left and right of
+    // everything below them are still to be swapped
+    bool reversed;
+    int value;
+    // Lowest value in this node's splay subtree, and its shallowest and
+    // deepest nodes with that value
+    int minValue;
+    int firstMinId;
+    int lastMinId;
+  };
+
+  std::vector<Node> mNodes;
+  // Member var to avoid frequent allocations
+  std::vector<int> mSplayPath;
+
+  bool isSplayRoot(int nodeId) const;
+  void reverse(int nodeId);
+  void pushDown(int nodeId);
+  void update(int nodeId);
+  void rotate(int nodeId);
+  void splay(int nodeId);
+
+  // Make the path from the root to nodeId a single splay tree, with
+  // nodeId at its root.  Return the last node where a path was joined.
+  int access(int nodeId);
+};
+
+#endif  // _LINK_CUT_FOREST_H_
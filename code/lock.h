@@ -42,6 +42,11 @@ public:
       pthread_mutex_lock(&mLock);
    }
 
+   // Return true if the lock was acquired without waiting
+   bool tryLock() {
+      return pthread_mutex_trylock(&mLock) == 0;
+   }
+
    void unlock() {
       pthread_mutex_unlock(&mLock);
    }
@@ -69,6 +74,11 @@ public:
       EnterCriticalSection(&mLock);
    }
 
+   // Return true if the lock was acquired without waiting
+   bool tryLock() {
+      return TryEnterCriticalSection(&mLock) != 0;
+   }
+
    void unlock() {
       LeaveCriticalSection(&mLock);
    }
@@ -48,6 +48,12 @@ public:
   lru_cache(size_t max_size) :
       _max_size(max_size) {
   }
+
+  ~lru_cache() {
+    for (auto &item : _cache_items_list) {
+      delete item.second;
+    }
+  }
   
   void put(const key_t& key, const value_t& value) {
     auto it = _cache_items_map.find(key);
@@ -0,0 +1,166 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// A tool to convert a directory of terrain tiles into a tile pack (see
+// tile_pack.h), doing the expensive preprocessing once so that repeated
+// prominence and isolation runs over the same region load tiles quickly.
+
+#include "tile.h"
+#include "tile_loading_policy.h"
+#include "tile_pack.h"
+
+#include "easylogging++.h"
+
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#ifdef PLATFORM_LINUX
+#include <unistd.h>
+#endif
+#ifdef PLATFORM_WINDOWS
+#include "getopt-win.h"
+#endif
+
+using std::string;
+
+INITIALIZE_EASYLOGGINGPP
+
+static void usage() {
+  printf("Usage:\n");
+  printf("  make_tile_pack output_file min_lat max_lat min_lng max_lng\n");
+  printf("  where coordinates are integer degrees\n");
+  printf("\n");
+  printf("  Options:\n");
+  printf("  -i directory      Directory with terrain data\n");
+  printf("  -f format         \"SRTM\", \"NED13-ZIP\", \"NED1-ZIP\" input files\n");
+  printf("  -e                Don't stitch tile edges to neighbors (faster, but\n");
+  printf("                    pack isn't suitable for prominence)\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  string terrain_directory(".");
+  FileFormat fileFormat = FileFormat::HGT;
+  bool stitchEdges = true;
+  
+  // Parse options
+  START_EASYLOGGINGPP(argc, argv);
+  int ch;
+  string str;
+  while ((ch = getopt(argc, argv, "ef:i:")) != -1) {
+    switch (ch) {
+    case 'e':
+      stitchEdges = false;
+      break;
+
+    case 'f':
+      str = optarg;
+      if (str == "SRTM") {
+        fileFormat = FileFormat::HGT;
+      } else if (str == "NED1-ZIP") {
+        fileFormat = FileFormat::NED1_ZIP;
+      } else if (str == "NED13-ZIP") {
+        fileFormat = FileFormat::NED13_ZIP;
+      } else {
+        printf("Unknown file format %s\n", optarg);
+        usage();
+      }
+      break;
+
+    case 'i':
+      terrain_directory = optarg;
+      break;
+    }
+  }
+
+  argc -= optind;
+  argv += optind;
+
+  if (argc < 5) {
+    usage();
+  }
+
+  string output_filename = argv[0];
+  float bounds[4];
+  for (int i = 0; i < 4; ++i) {
+    char *endptr;
+    bounds[i] = strtof(argv[i + 1], &endptr);
+    if (*endptr != 0) {
+      printf("Couldn't parse argument %d as number: %s\n", i + 2, argv[i + 1]);
+      usage();
+    }
+  }
+
+  BasicTileLoadingPolicy policy(terrain_directory, fileFormat);
+  policy.enableNeighborEdgeLoading(stitchEdges);
+  policy.enableMemoryMappedLoading(true);
+
+  uint32 flags = TilePack::SPIKES_REMOVED;
+  if (stitchEdges) {
+    flags |= TilePack::EDGES_STITCHED;
+  }
+  
+  TilePackWriter writer;
+  if (!writer.open(output_filename, flags)) {
+    exit(1);
+  }
+
+  // East to west within each row, so that stitched edges come from the
+  // policy's cache rather than being read again from neighbor files
+  int num_tiles = 0;
+  for (int lat = (int) floor(bounds[0]); lat < (int) ceil(bounds[1]); ++lat) {
+    for (int lng = (int) ceil(bounds[3]) - 1; lng >= (int) floor(bounds[2]); --lng) {
+      // Allow specifying longitude ranges that span the antimeridian (lng > 180)
+      int wrappedLng = lng;
+      if (wrappedLng >= 180) {
+        wrappedLng -= 360;
+      }
+
+      Tile *tile = policy.loadTile(lat, wrappedLng);
+      if (tile == nullptr) {
+        continue;
+      }
+
+      // Same cleanup that TileCache does on load
+      tile->removeSpikes();
+      tile->recomputeMaxElevation();
+      
+      VLOG(1) << "Adding tile " << lat << " " << wrappedLng;
+      bool success = writer.addTile(lat, wrappedLng, *tile);
+      delete tile;
+      if (!success) {
+        exit(1);
+      }
+      num_tiles += 1;
+    }
+  }
+
+  if (!writer.close()) {
+    exit(1);
+  }
+
+  printf("Tiles written = %d\n", num_tiles);
+  return 0;
+}
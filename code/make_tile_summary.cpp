@@ -0,0 +1,159 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// A tool to build a tile summary (see tile_summary.h) for a region, so
+// that isolation can skip tiles that are missing or too low without
+// opening them.  If the output file already exists, tiles in the region
+// are added to it, so a global summary can be built up piece by piece.
+
+#include "tile.h"
+#include "tile_loading_policy.h"
+#include "tile_summary.h"
+
+#include "easylogging++.h"
+
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#ifdef PLATFORM_LINUX
+#include <unistd.h>
+#endif
+#ifdef PLATFORM_WINDOWS
+#include "getopt-win.h"
+#endif
+
+using std::string;
+
+INITIALIZE_EASYLOGGINGPP
+
+static void usage() {
+  printf("Usage:\n");
+  printf("  make_tile_summary output_file min_lat max_lat min_lng max_lng\n");
+  printf("  where coordinates are integer degrees\n");
+  printf("\n");
+  printf("  Options:\n");
+  printf("  -i directory      Directory with terrain data\n");
+  printf("  -f format         \"SRTM\", \"NED13-ZIP\", \"NED1-ZIP\" input files\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  string terrain_directory(".");
+  FileFormat fileFormat = FileFormat::HGT;
+  
+  // Parse options
+  START_EASYLOGGINGPP(argc, argv);
+  int ch;
+  string str;
+  while ((ch = getopt(argc, argv, "f:i:")) != -1) {
+    switch (ch) {
+    case 'f':
+      str = optarg;
+      if (str == "SRTM") {
+        fileFormat = FileFormat::HGT;
+      } else if (str == "NED1-ZIP") {
+        fileFormat = FileFormat::NED1_ZIP;
+      } else if (str == "NED13-ZIP") {
+        fileFormat = FileFormat::NED13_ZIP;
+      } else {
+        printf("Unknown file format %s\n", optarg);
+        usage();
+      }
+      break;
+
+    case 'i':
+      terrain_directory = optarg;
+      break;
+    }
+  }
+
+  argc -= optind;
+  argv += optind;
+
+  if (argc < 5) {
+    usage();
+  }
+
+  string output_filename = argv[0];
+  float bounds[4];
+  for (int i = 0; i < 4; ++i) {
+    char *endptr;
+    bounds[i] = strtof(argv[i + 1], &endptr);
+    if (*endptr != 0) {
+      printf("Couldn't parse argument %d as number: %s\n", i + 2, argv[i + 1]);
+      usage();
+    }
+  }
+
+  TileSummary summary;
+  FILE *existing = fopen(output_filename.c_str(), "rb");
+  if (existing != nullptr) {
+    fclose(existing);
+    if (!summary.readFromFile(output_filename)) {
+      exit(1);
+    }
+    printf("Adding to existing summary of %d tiles\n", summary.numTiles());
+  }
+
+  BasicTileLoadingPolicy policy(terrain_directory, fileFormat);
+  policy.enableMemoryMappedLoading(true);
+
+  int num_tiles = 0;
+  int num_missing = 0;
+  for (int lat = (int) floor(bounds[0]); lat < (int) ceil(bounds[1]); ++lat) {
+    for (int lng = (int) floor(bounds[2]); lng < (int) ceil(bounds[3]); ++lng) {
+      // Allow specifying longitude ranges that span the antimeridian (lng > 180)
+      int wrappedLng = lng;
+      if (wrappedLng >= 180) {
+        wrappedLng -= 360;
+      }
+
+      Tile *tile = policy.loadTile(lat, wrappedLng);
+      if (tile == nullptr) {
+        summary.setTile(lat, wrappedLng, nullptr);
+        num_missing += 1;
+        continue;
+      }
+
+      // Same cleanup that TileCache does on load
+      tile->removeSpikes();
+      tile->recomputeMaxElevation();
+
+      VLOG(1) << "Summarizing tile " << lat << " " << wrappedLng
+              << " with max elevation " << tile->maxElevation();
+      summary.setTile(lat, wrappedLng, tile);
+      delete tile;
+      num_tiles += 1;
+    }
+  }
+
+  if (!summary.writeToFile(output_filename)) {
+    exit(1);
+  }
+
+  printf("Tiles summarized = %d, missing = %d, total in summary = %d\n",
+         num_tiles, num_missing, summary.numTiles());
+  return 0;
+}
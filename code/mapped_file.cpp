@@ -0,0 +1,154 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "mapped_file.h"
+#include "easylogging++.h"
+
+#ifdef PLATFORM_LINUX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using std::string;
+
+#ifdef PLATFORM_LINUX
+
+MappedFile::MappedFile() {
+  mData = nullptr;
+  mSize = 0;
+}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+bool MappedFile::open(const string &filename) {
+  close();
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    VLOG(3) << "Failed to open file " << filename;
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+
+  void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    LOG(ERROR) << "Failed to map file " << filename;
+    return false;
+  }
+
+  // Callers generally stream through the whole file once, so start
+  // reading it in right away
+  madvise(data, info.st_size, MADV_SEQUENTIAL);
+  madvise(data, info.st_size, MADV_WILLNEED);
+
+  mData = data;
+  mSize = info.st_size;
+  return true;
+}
+
+void MappedFile::close() {
+  if (mData != nullptr) {
+    munmap(const_cast<void *>(mData), mSize);
+    mData = nullptr;
+    mSize = 0;
+  }
+}
+
+#endif  // PLATFORM_LINUX
+
+#ifdef PLATFORM_WINDOWS
+
+MappedFile::MappedFile() {
+  mData = nullptr;
+  mSize = 0;
+  mFile = INVALID_HANDLE_VALUE;
+  mMapping = nullptr;
+}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+bool MappedFile::open(const string &filename) {
+  close();
+
+  mFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                      OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (mFile == INVALID_HANDLE_VALUE) {
+    VLOG(3) << "Failed to open file " << filename;
+    return false;
+  }
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart == 0) {
+    close();
+    return false;
+  }
+
+  mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mMapping == nullptr) {
+    LOG(ERROR) << "Failed to map file " << filename;
+    close();
+    return false;
+  }
+
+  mData = MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+  if (mData == nullptr) {
+    LOG(ERROR) << "Failed to map view of file " << filename;
+    close();
+    return false;
+  }
+
+  mSize = static_cast<size_t>(fileSize.QuadPart);
+  return true;
+}
+
+void MappedFile::close() {
+  if (mData != nullptr) {
+    UnmapViewOfFile(mData);
+    mData = nullptr;
+  }
+  if (mMapping != nullptr) {
+    CloseHandle(mMapping);
+    mMapping = nullptr;
+  }
+  if (mFile != INVALID_HANDLE_VALUE) {
+    CloseHandle(mFile);
+    mFile = INVALID_HANDLE_VALUE;
+  }
+  mSize = 0;
+}
+
+#endif  // PLATFORM_WINDOWS
@@ -0,0 +1,67 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * A read-only view of an entire file mapped into memory.
+ */
+
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <stddef.h>
+#include <string>
+
+#ifdef PLATFORM_WINDOWS
+#include <windows.h>
+#endif
+
+class MappedFile {
+public:
+  MappedFile();
+  ~MappedFile();
+
+  // Map the given file.  Returns false if the file can't be opened or mapped.
+  bool open(const std::string &filename);
+
+  // Unmap the file, if any.
+  void close();
+
+  const void *data() const { return mData; }
+  size_t size() const { return mSize; }
+
+private:
+  const void *mData;
+  size_t mSize;
+
+#ifdef PLATFORM_WINDOWS
+  HANDLE mFile;
+  HANDLE mMapping;
+#endif
+
+  // Not copyable
+  MappedFile(const MappedFile &);
+  void operator=(const MappedFile &);
+};
+
+#endif  // _MAPPED_FILE_H_
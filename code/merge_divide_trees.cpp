@@ -26,6 +26,10 @@
 
 #include "divide_tree.h"
 #include "island_tree.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
 #ifdef PLATFORM_LINUX
 #include <unistd.h>
 #endif
@@ -43,12 +47,18 @@ using std::vector;
 static void usage() {
   printf("Usage:\n");
   printf("  merge_divide_trees output_file_prefix input_file [...]\n");
-  printf("  Input file should have .dvt extension\n");
+  printf("  Input file should have .dvt or .dvtb (binary) extension\n");
   printf("  Output file prefix should have no extension\n");
   printf("\n");
   printf("  Options:\n");
+  printf("  -b                Write the merged divide tree in binary (.dvtb) format\n");
   printf("  -f                Finalize output tree: delete all runoffs and then prune\n");
   printf("  -m min_prominence Minimum prominence threshold for output, default = 300ft\n");
+  printf("  -p num_merges     Prune the merged tree after every so many merges\n");
+  printf("  -s megabytes      Prune the merged tree whenever it's bigger than this\n");
+  printf("  -t num_threads    Merge neighboring trees in pairs on this many threads,\n");
+  printf("                    pruning each merged tree, instead of one by one;\n");
+  printf("                    can't be combined with -p or -s\n");
   exit(1);
 }
 
@@ -84,21 +94,207 @@ static bool mergeTrees(DivideTree *tree1, DivideTree *tree2) {
   return true;
 }
 
+// Prune tree to minProminence, keeping what later merges need
+static void pruneTree(DivideTree *tree, float minProminence) {
+  IslandTree islandTree(*tree);
+  islandTree.build();
+  tree->prune(minProminence, islandTree);
+}
+
+// Merge the trees in the given files one by one, in order.  The merged
+// tree is pruned to minProminence after every pruneInterval merges (if
+// it's > 0) and whenever it uses more than pruneBytes (if it's > 0).
+static DivideTree *mergeTreesInOrder(const vector<string> &inputFilenames,
+                                     float minProminence, int pruneInterval, size_t pruneBytes) {
+  DivideTree *divideTree = nullptr;
+  int numMerges = 0;
+  for (const string &inputFilename : inputFilenames) {
+    VLOG(1) << "Loading tree from " << inputFilename;
+    
+    DivideTree *newTree = DivideTree::readFromFile(inputFilename);
+    if (newTree == nullptr) {
+      LOG(ERROR) << "Failed to load divide tree from " << inputFilename;
+      delete divideTree;
+      return nullptr;
+    }
+
+    if (divideTree == nullptr) {
+      divideTree = newTree;
+    } else {
+      mergeTrees(divideTree, newTree);
+      delete newTree;
+      numMerges += 1;
+    }
+
+    // Nuke any basin saddles created during merge
+    divideTree->compact();
+
+    // The final tree is pruned anyway
+    if (&inputFilename == &inputFilenames.back()) {
+      break;
+    }
+    bool pruneNow = pruneInterval > 0 && numMerges > 0 && numMerges % pruneInterval == 0;
+    if (pruneBytes > 0 && divideTree->memoryBytes() > pruneBytes) {
+      VLOG(1) << "Merged tree uses " << divideTree->memoryBytes() << " bytes";
+      pruneNow = true;
+    }
+    if (pruneNow) {
+      VLOG(1) << "Pruning merged tree with " << divideTree->peaks().size() << " peaks";
+      pruneTree(divideTree, minProminence);
+    }
+  }
+
+  return divideTree;
+}
+
+// Return a key that sorts trees in quadtree (Z) order of the whole
+// degrees of their SW corners, so that trees close together in the
+// order are close together on the ground
+static uint32 getQuadtreeKey(const CoordinateSystem &coords) {
+  uint32 x = static_cast<uint32>(floor(coords.minLongitude()) + 360);
+  uint32 y = static_cast<uint32>(floor(coords.minLatitude()) + 90);
+  uint32 key = 0;
+  for (int bit = 0; bit < 16; ++bit) {
+    key |= ((x >> bit) & 1) << (2 * bit);
+    key |= ((y >> bit) & 1) << (2 * bit + 1);
+  }
+  return key;
+}
+
+static DivideTree *loadTree(const string &inputFilename) {
+  VLOG(1) << "Loading tree from " << inputFilename;
+  DivideTree *tree = DivideTree::readFromFile(inputFilename);
+  if (tree == nullptr) {
+    LOG(ERROR) << "Failed to load divide tree from " << inputFilename;
+  }
+  return tree;
+}
+
+// A tree waiting to be merged in mergeTreesInPairs: an input file that
+// hasn't been loaded yet, or the result of an earlier merge
+struct PendingTree {
+  string filename;
+  DivideTree *tree;  // nullptr until loaded
+};
+
+// Merge the trees in the given files in pairs, in quadtree order, so that
+// each merge joins neighboring regions.  The merges at each level of the
+// quadtree are spread over numThreads threads, and each merged tree but
+// the last is pruned to minProminence before the next level.  Input
+// files are loaded only when their pair is merged, so at most
+// 2 * numThreads unpruned trees are in memory at once.
+static DivideTree *mergeTreesInPairs(const vector<string> &inputFilenames,
+                                     int numThreads, float minProminence) {
+  // Sort by location, reading only the trees' coordinate systems
+  vector<std::pair<uint32, string>> keyedFilenames;
+  for (const string &inputFilename : inputFilenames) {
+    CoordinateSystem coords(0, 0, 0, 0);
+    if (!DivideTree::readCoordinateSystem(inputFilename, &coords)) {
+      LOG(ERROR) << "Failed to load divide tree from " << inputFilename;
+      return nullptr;
+    }
+    keyedFilenames.push_back(std::make_pair(getQuadtreeKey(coords), inputFilename));
+  }
+  std::stable_sort(keyedFilenames.begin(), keyedFilenames.end(),
+                   [](const std::pair<uint32, string> &a, const std::pair<uint32, string> &b) {
+                     return a.first < b.first;
+                   });
+
+  vector<PendingTree> trees;
+  for (auto &keyedFilename : keyedFilenames) {
+    PendingTree pending;
+    pending.filename = keyedFilename.second;
+    pending.tree = nullptr;
+    trees.push_back(pending);
+  }
+
+  ThreadPool threadPool(numThreads);
+  while (trees.size() > 1) {
+    VLOG(1) << "Merging " << trees.size() << " trees in pairs";
+    bool lastLevel = trees.size() == 2;
+    vector<std::future<DivideTree *>> mergeResults;
+    for (size_t i = 0; i + 1 < trees.size(); i += 2) {
+      PendingTree pending1 = trees[i];
+      PendingTree pending2 = trees[i + 1];
+      mergeResults.push_back(threadPool.enqueue([=] {
+            DivideTree *tree1 = pending1.tree;
+            if (tree1 == nullptr) {
+              tree1 = loadTree(pending1.filename);
+            }
+            DivideTree *tree2 = pending2.tree;
+            if (tree2 == nullptr) {
+              tree2 = loadTree(pending2.filename);
+            }
+            if (tree1 == nullptr || tree2 == nullptr) {
+              delete tree1;
+              delete tree2;
+              return (DivideTree *) nullptr;
+            }
+            
+            mergeTrees(tree1, tree2);
+            delete tree2;
+
+            // Nuke any basin saddles created during merge
+            tree1->compact();
+
+            if (!lastLevel) {
+              pruneTree(tree1, minProminence);
+            }
+            return tree1;
+          }));
+    }
+
+    // Odd one out goes up a level as is
+    vector<PendingTree> mergedTrees;
+    bool merged = true;
+    for (auto &&result : mergeResults) {
+      PendingTree pending;
+      pending.tree = result.get();
+      merged = merged && pending.tree != nullptr;
+      mergedTrees.push_back(pending);
+    }
+    if (trees.size() % 2 == 1) {
+      mergedTrees.push_back(trees.back());
+    }
+    trees.swap(mergedTrees);
+    
+    if (!merged) {
+      for (PendingTree &pending : trees) {
+        delete pending.tree;
+      }
+      return nullptr;
+    }
+  }
+
+  if (trees.empty()) {
+    return nullptr;
+  }
+  return (trees[0].tree != nullptr) ? trees[0].tree : loadTree(trees[0].filename);
+}
+
 int main(int argc, char **argv) {
   float minProminence = 300;
   bool finalize = false;
   bool flipElevations = false;
+  bool binaryOutput = false;
+  int numThreads = 0;
+  int pruneInterval = 0;
+  int pruneMegabytes = 0;
 
   // Parse options
   START_EASYLOGGINGPP(argc, argv);
 
   int ch;
   string str;
-  while ((ch = getopt(argc, argv, "afm:")) != -1) {
+  while ((ch = getopt(argc, argv, "abfm:p:s:t:")) != -1) {
     switch (ch) {
     case 'a':
       flipElevations = true;
       break;
+
+    case 'b':
+      binaryOutput = true;
+      break;
       
     case 'f':
       finalize = true;
@@ -107,6 +303,18 @@ int main(int argc, char **argv) {
     case 'm':
       minProminence = static_cast<float>(atof(optarg));
       break;
+
+    case 'p':
+      pruneInterval = atoi(optarg);
+      break;
+
+    case 's':
+      pruneMegabytes = atoi(optarg);
+      break;
+
+    case 't':
+      numThreads = atoi(optarg);
+      break;
     }
   }
   argc -= optind;
@@ -116,27 +324,22 @@ int main(int argc, char **argv) {
     usage();
   }
 
+  if (numThreads > 0 && (pruneInterval > 0 || pruneMegabytes > 0)) {
+    printf("Merging in pairs already prunes every merged tree\n");
+    usage();
+  }
+
   string outputFilename = argv[0];
+  vector<string> inputFilenames(argv + 1, argv + argc);
   DivideTree *divideTree = nullptr;
-  for (int arg = 1; arg < argc; ++arg) {
-    string inputFilename = argv[arg];
-    VLOG(1) << "Loading tree from " << inputFilename;
-    
-    DivideTree *newTree = DivideTree::readFromFile(inputFilename);
-    if (newTree == nullptr) {
-      LOG(ERROR) << "Failed to load divide tree from " << inputFilename;
-      return 1;
-    }
-
-    if (divideTree == nullptr) {
-      divideTree = newTree;
-    } else {
-      mergeTrees(divideTree, newTree);
-      delete newTree;
-    }
-
-    // Nuke any basin saddles created during merge
-    divideTree->compact();
+  if (numThreads > 0) {
+    divideTree = mergeTreesInPairs(inputFilenames, numThreads, minProminence);
+  } else {
+    divideTree = mergeTreesInOrder(inputFilenames, minProminence, pruneInterval,
+                                   (size_t) pruneMegabytes * 1024 * 1024);
+  }
+  if (divideTree == nullptr) {
+    return 1;
   }
 
   //
@@ -151,7 +354,6 @@ int main(int argc, char **argv) {
   if (finalize) {
     divideTree->deleteRunoffs();  // Does not affect island tree
   }
-  // TODO: For performance, could prune periodically during a big merge, maybe every N merges
   divideTree->prune(minProminence, *unprunedIslandTree);
 
   //
@@ -160,8 +362,9 @@ int main(int argc, char **argv) {
   
   VLOG(1) << "Writing outputs";
   
-  // Write .dvt
-  if (!divideTree->writeToFile(outputFilename + ".dvt")) {
+  // Write .dvt or .dvtb
+  string treeExtension = binaryOutput ? DivideTree::BINARY_EXTENSION : ".dvt";
+  if (!divideTree->writeToFile(outputFilename + treeExtension)) {
     LOG(ERROR) << "Failed to write merged divide tree to " << outputFilename;
   }
 
@@ -27,6 +27,9 @@
 
 #include "tile.h"
 
+#include <algorithm>
+#include <string.h>
+
 // A 2D array of integer values
 
 template<typename Pixel> class PixelArray {
@@ -44,6 +47,9 @@ public:
 
   static const Pixel EmptyPixel = 0;
 
+  int width() const { return mWidth; }
+  int height() const { return mHeight; }
+
   Pixel get(int x, int y) const {
     return mPixels[y * mWidth + x];
   }
@@ -60,10 +66,89 @@ public:
     memset(mPixels, 0, mWidth * mHeight * sizeof(Pixel));
   }
 
+  size_t memoryBytes() const {
+    return (size_t) mWidth * mHeight * sizeof(Pixel);
+  }
+
 private:
   int mWidth;
   int mHeight;
   Pixel *mPixels;
 };
 
+// A 2D array of bits, for marking pixels with an eighth of the memory
+// of a PixelArray<uint8>.  Ranges within a row can be set or reset a
+// word at a time.
+
+class PixelBitArray {
+public:
+  PixelBitArray(int width, int height) :
+    mWidth(width),
+    mHeight(height) {
+      // Initialize to all false
+      mWords = new uint64[numWords()]();
+  }
+
+  ~PixelBitArray() {
+    delete [] mWords;
+  }
+
+  bool get(int x, int y) const {
+    size_t bit = index(x, y);
+    return ((mWords[bit / 64] >> (bit % 64)) & 1) != 0;
+  }
+
+  void set(int x, int y) {
+    size_t bit = index(x, y);
+    mWords[bit / 64] |= ((uint64) 1) << (bit % 64);
+  }
+
+  void reset(int x, int y) {
+    size_t bit = index(x, y);
+    mWords[bit / 64] &= ~(((uint64) 1) << (bit % 64));
+  }
+
+  // Set or reset the pixels from xmin through xmax (inclusive) of row y
+  void setRange(int xmin, int xmax, int y) {
+    updateRange(index(xmin, y), index(xmax, y), true);
+  }
+
+  void resetRange(int xmin, int xmax, int y) {
+    updateRange(index(xmin, y), index(xmax, y), false);
+  }
+
+  size_t memoryBytes() const {
+    return numWords() * sizeof(uint64);
+  }
+
+private:
+  int mWidth;
+  int mHeight;
+  uint64 *mWords;
+
+  size_t numWords() const {
+    return ((size_t) mWidth * mHeight + 63) / 64;
+  }
+
+  size_t index(int x, int y) const {
+    return (size_t) y * mWidth + x;
+  }
+
+  void updateRange(size_t first, size_t last, bool value) {
+    while (first <= last) {
+      size_t word = first / 64;
+      size_t bit = first % 64;
+      // Bits first through the end of the word, or through last
+      size_t numBits = std::min<size_t>(64 - bit, last - first + 1);
+      uint64 mask = (numBits == 64) ? ~((uint64) 0) : ((((uint64) 1) << numBits) - 1) << bit;
+      if (value) {
+        mWords[word] |= mask;
+      } else {
+        mWords[word] &= ~mask;
+      }
+      first += numBits;
+    }
+  }
+};
+
 #endif  // _PIXEL_ARRAY_H_
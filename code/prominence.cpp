@@ -30,6 +30,8 @@
 #include "tile.h"
 #include "tile_cache.h"
 #include "tile_loading_policy.h"
+#include "tile_pack.h"
+#include "tree_builder.h"
 
 #include "easylogging++.h"
 
@@ -42,30 +44,42 @@
 #include "getopt-win.h"
 #endif
 #include <cmath>
-#include <set>
 
 using std::ceil;
 using std::floor;
-using std::set;
 using std::string;
 using std::vector;
 
 INITIALIZE_EASYLOGGINGPP
 
+// Threads that load tiles ahead of the threads doing computation
+static const int NUM_PREFETCH_THREADS = 2;
+
 static void usage() {
   printf("Usage:\n");
   printf("  prominence min_lat max_lat min_lng max_lng\n");
   printf("  where coordinates are integer degrees\n");
   printf("\n");
   printf("  Options:\n");
-  printf("  -i directory      Directory with terrain data\n");
+  printf("  -i directory      Directory with terrain data, or tile pack file for PACK\n");
   printf("  -o directory      Directory for output data\n");
-  printf("  -f format         \"SRTM\", \"NED13-ZIP\", \"NED1-ZIP\" input files\n");
+  printf("  -f format         \"SRTM\", \"NED13-ZIP\", \"NED1-ZIP\" input files,\n");
+  printf("                    or \"PACK\" for a tile pack from make_tile_pack\n");
+  printf("  -j filename       Write tile cache statistics to filename as JSON\n");
   printf("  -k filename       File with KML polygon to filter input tiles\n");
+  printf("  -l seconds        Report tile cache statistics every so many seconds\n");
   printf("  -m min_prominence Minimum prominence threshold for output, default = 300ft\n");
   printf("  -p filename       Peakbagger peak database file for matching\n");
+  printf("  -r megabytes      Memory for tiles read ahead of computation, default = 512;\n");
+  printf("                    0 disables read-ahead\n");
   printf("  -t num_threads    Number of threads, default = 1\n");
   printf("  -a                Compute anti-prominence instead of prominence\n");
+  printf("  -b num_bands      Split each tile into this many bands, built on\n");
+  printf("                    separate threads, default = 1\n");
+  printf("  -s                Build divide trees by sweeping samples in elevation\n");
+  printf("                    order; can't be combined with -b\n");
+  printf("  -w num_threads    Walk uphill from each tile's saddles on this many\n");
+  printf("                    threads, default = 1; can't be combined with -b or -s\n");
   exit(1);
 }
 
@@ -73,22 +87,33 @@ int main(int argc, char **argv) {
   string terrain_directory(".");
   string output_directory(".");
   string peakbagger_filename;
+  string statsFilename;
+  int statsIntervalSeconds = 0;
   string polygonFilename;
 
   float minProminence = 300;
   int numThreads = 1;
+  int numBands = 1;
+  int numWalkThreads = 1;
+  int prefetchMegabytes = 512;
   FileFormat fileFormat = FileFormat::HGT;
+  bool usePack = false;
   
   // Parse options
   START_EASYLOGGINGPP(argc, argv);
   int ch;
   string str;
   bool antiprominence = false;
-  while ((ch = getopt(argc, argv, "af:i:k:m:o:p:t:")) != -1) {
+  bool sweep = false;
+  while ((ch = getopt(argc, argv, "ab:f:i:j:k:l:m:o:p:r:st:w:")) != -1) {
     switch (ch) {
     case 'a':
       antiprominence = true;
       break;
+
+    case 'b':
+      numBands = atoi(optarg);
+      break;
       
     case 'f':
       str = optarg;
@@ -98,6 +123,8 @@ int main(int argc, char **argv) {
         fileFormat = FileFormat::NED1_ZIP;
       } else if (str == "NED13-ZIP") {
         fileFormat = FileFormat::NED13_ZIP;
+      } else if (str == "PACK") {
+        usePack = true;
       } else {
         printf("Unknown file format %s\n", optarg);
         usage();
@@ -108,10 +135,18 @@ int main(int argc, char **argv) {
       terrain_directory = optarg;
       break;
 
+    case 'j':
+      statsFilename = optarg;
+      break;
+
     case 'k':
       polygonFilename = optarg;
       break;
 
+    case 'l':
+      statsIntervalSeconds = atoi(optarg);
+      break;
+
     case 'm':
       minProminence = static_cast<float>(atof(optarg));
       break;
@@ -124,9 +159,21 @@ int main(int argc, char **argv) {
       peakbagger_filename = optarg;
       break;
 
+    case 'r':
+      prefetchMegabytes = atoi(optarg);
+      break;
+
+    case 's':
+      sweep = true;
+      break;
+
     case 't':
       numThreads = atoi(optarg);
       break;
+
+    case 'w':
+      numWalkThreads = atoi(optarg);
+      break;
     }
   }
 
@@ -137,6 +184,16 @@ int main(int argc, char **argv) {
     usage();
   }
 
+  if (sweep && numBands > 1) {
+    printf("Can't build divide trees in bands by sweeping\n");
+    usage();
+  }
+
+  if (numWalkThreads > 1 && (sweep || numBands > 1)) {
+    printf("Can't walk on multiple threads when building in bands or by sweeping\n");
+    usage();
+  }
+
   // Load Peakbagger database?
   PeakbaggerCollection pb_collection;
   PointMap *peakbagger_peaks = new PointMap();
@@ -173,22 +230,39 @@ int main(int argc, char **argv) {
     }
   }
 
+  TileLoadingPolicy *policy = nullptr;
+  TilePack *pack = nullptr;
+  if (usePack) {
+    pack = new TilePack();
+    if (!pack->open(terrain_directory)) {
+      printf("Couldn't open tile pack %s\n", terrain_directory.c_str());
+      exit(1);
+    }
+    if (!(pack->flags() & TilePack::EDGES_STITCHED)) {
+      printf("Warning: tile pack %s doesn't have stitched edges; results may be wrong\n",
+             terrain_directory.c_str());
+    }
+    policy = new TilePackLoadingPolicy(pack);
+  } else {
+    BasicTileLoadingPolicy *basicPolicy = new BasicTileLoadingPolicy(terrain_directory, fileFormat);
+    basicPolicy->enableNeighborEdgeLoading(true);
+    basicPolicy->enableMemoryMappedLoading(true);
+    policy = basicPolicy;
+  }
+  
   // Caching doesn't do anything for our calculation and the tiles are huge
-  BasicTileLoadingPolicy policy(terrain_directory, fileFormat);
-  policy.enableNeighborEdgeLoading(true);
   const int CACHE_SIZE = 2;
-  TileCache *cache = new TileCache(&policy, peakbagger_peaks, CACHE_SIZE);
+  TileCache *cache = new TileCache(policy, peakbagger_peaks, CACHE_SIZE);
   
-  set<Offsets::Value> tilesToSkip;
-  tilesToSkip.insert(Offsets(47, -87).value());  // in Lake Superior; lots of fake peaks
-
   VLOG(2) << "Using " << numThreads << " threads";
   
-  ThreadPool *threadPool = new ThreadPool(numThreads);
-  int num_tiles_processed = 0;
-  vector<std::future<bool>> results;
+  // Decide which tiles to process up front, so that they can be prefetched.
+  // Rows go south to north and each row east to west, so that a tile's
+  // bottom and right neighbors have usually been loaded already, and the
+  // edges stitched into it come from the tile loading policy's cache.
+  vector<std::pair<int, int>> tiles;
   for (int lat = floor(bounds[0]); lat < ceil(bounds[1]); ++lat) {
-    for (int lng = floor(bounds[2]); lng < ceil(bounds[3]); ++lng) {
+    for (int lng = (int) ceil(bounds[3]) - 1; lng >= (int) floor(bounds[2]); --lng) {
       // Allow specifying longitude ranges that span the antimeridian (lng > 180)
       int wrappedLng = lng;
       if (wrappedLng >= 180) {
@@ -201,21 +275,37 @@ int main(int argc, char **argv) {
         continue;
       }
 
-      // Skip some very slow tiles known to have no peaks
-      Offsets coords(lat, lng);
-      if (tilesToSkip.find(coords.value()) != tilesToSkip.end()) {
-        VLOG(1) << "Skipping slow tile " << lat << " " << lng;
-        continue;
-      }
-
-      ProminenceTask *task = new ProminenceTask(cache, output_directory, bounds, minProminence);
-      task->setAntiprominence(antiprominence);
-      results.push_back(threadPool->enqueue([=] {
-            return task->run(lat, wrappedLng);
-          }));
+      tiles.push_back(std::make_pair(lat, wrappedLng));
     }
   }
 
+  if (prefetchMegabytes > 0) {
+    cache->startPrefetching(tiles, NUM_PREFETCH_THREADS, (size_t) prefetchMegabytes * 1024 * 1024);
+  }
+  
+  CacheStatsReporter statsReporter(cache->stats(), statsIntervalSeconds, statsFilename);
+  statsReporter.start();
+
+  TileMemoryStats memoryStats;
+  TreeBuilderPool *builderPool = new TreeBuilderPool();
+  ThreadPool *threadPool = new ThreadPool(numThreads);
+  int num_tiles_processed = 0;
+  vector<std::future<bool>> results;
+  for (auto &coords : tiles) {
+    int lat = coords.first;
+    int lng = coords.second;
+    ProminenceTask *task = new ProminenceTask(cache, output_directory, bounds, minProminence);
+    task->setAntiprominence(antiprominence);
+    task->setNumBands(numBands);
+    task->setSweep(sweep);
+    task->setNumWalkThreads(numWalkThreads);
+    task->setMemoryStats(&memoryStats);
+    task->setBuilderPool(builderPool);
+    results.push_back(threadPool->enqueue([=] {
+          return task->run(lat, lng);
+        }));
+  }
+
   for (auto && result : results) {
     if (result.get()) {
       num_tiles_processed += 1;
@@ -223,9 +313,19 @@ int main(int argc, char **argv) {
   }
     
   printf("Tiles processed = %d\n", num_tiles_processed);
+  memoryStats.print(stdout, numThreads);
+  if (prefetchMegabytes > 0) {
+    TileCache::PrefetchStats stats = cache->prefetchStats();
+    printf("Tiles read ahead = %d, load time = %.1fs, compute waited %.1fs for %d tiles\n",
+           stats.numPrefetched, stats.loadSeconds, stats.stallSeconds, stats.numStalls);
+  }
+  statsReporter.stop();
 
   delete threadPool;
+  delete builderPool;
   delete cache;
+  delete policy;
+  delete pack;
   delete peakbagger_peaks;
 
   return 0;
@@ -25,6 +25,7 @@
 #include "prominence_task.h"
 #include "divide_tree.h"
 #include "island_tree.h"
+#include "sweep_tree_builder.h"
 #include "tree_builder.h"
 
 #include "easylogging++.h"
@@ -46,6 +47,11 @@ ProminenceTask::ProminenceTask(TileCache *cache, const string &output_dir,
   mBounds = bounds;
   mMinProminence = minProminence;
   mAntiprominence = false;
+  mNumBands = 1;
+  mSweep = false;
+  mNumWalkThreads = 1;
+  mMemoryStats = nullptr;
+  mBuilderPool = nullptr;
 }
 
 bool ProminenceTask::run(int lat, int lng) {
@@ -65,9 +71,35 @@ bool ProminenceTask::run(int lat, int lng) {
   }
 
   // Build divide tree
-  TreeBuilder *builder = new TreeBuilder(tile.get());
-  DivideTree *divideTree = builder->buildDivideTree();
-  delete builder;
+  DivideTree *divideTree = nullptr;
+  size_t builderBytes = 0;
+  if (mSweep) {
+    SweepTreeBuilder *builder = new SweepTreeBuilder(tile.get());
+    divideTree = builder->buildDivideTree();
+    builderBytes = builder->memoryBytes();
+    delete builder;
+  } else if (mNumBands > 1) {
+    divideTree = TreeBuilder::buildDivideTreeInBands(tile.get(), mNumBands, &builderBytes);
+  } else if (mBuilderPool != nullptr) {
+    TreeBuilder *builder = mBuilderPool->acquire(tile.get());
+    builder->setNumWalkThreads(mNumWalkThreads);
+    divideTree = builder->buildDivideTree();
+    builderBytes = builder->memoryBytes();
+    mBuilderPool->release(builder);
+  } else {
+    TreeBuilder *builder = new TreeBuilder(tile.get());
+    builder->setNumWalkThreads(mNumWalkThreads);
+    divideTree = builder->buildDivideTree();
+    builderBytes = builder->memoryBytes();
+    delete builder;
+  }
+
+  VLOG(1) << "Tile " << lat << " " << lng << " used "
+          << tile->sampleBytes() / (1024 * 1024) << " MB for samples, "
+          << builderBytes / (1024 * 1024) << " MB to build divide tree";
+  if (mMemoryStats != nullptr) {
+    mMemoryStats->record(tile->sampleBytes(), builderBytes);
+  }
 
   //
   // Write full divide tree
@@ -107,6 +139,26 @@ void ProminenceTask::setAntiprominence(bool value) {
   mAntiprominence = value;
 }
 
+void ProminenceTask::setNumBands(int numBands) {
+  mNumBands = numBands;
+}
+
+void ProminenceTask::setSweep(bool value) {
+  mSweep = value;
+}
+
+void ProminenceTask::setNumWalkThreads(int numThreads) {
+  mNumWalkThreads = numThreads;
+}
+
+void ProminenceTask::setMemoryStats(TileMemoryStats *stats) {
+  mMemoryStats = stats;
+}
+
+void ProminenceTask::setBuilderPool(TreeBuilderPool *pool) {
+  mBuilderPool = pool;
+}
+
 bool ProminenceTask::writeStringToOutputFile(const string &filename, const string &str) const {
   string fullFilename = getFilenamePrefix() + "-" + filename;
   FILE *file = fopen(fullFilename.c_str(), "wb");
@@ -123,3 +175,35 @@ string ProminenceTask::getFilenamePrefix() const {
   sprintf(filename, "prominence-%02d-%03d", mCurrentLatitude, mCurrentLongitude);
   return mOutputDir + "/" + filename;
 }
+
+TileMemoryStats::TileMemoryStats() :
+    mNumTiles(0),
+    mMaxSampleBytes(0),
+    mMaxBuilderBytes(0),
+    mMaxTileBytes(0) {
+}
+
+static void updateMax(std::atomic<uint64> *max, uint64 value) {
+  uint64 oldMax = max->load();
+  while (value > oldMax && !max->compare_exchange_weak(oldMax, value)) {
+  }
+}
+
+void TileMemoryStats::record(size_t sampleBytes, size_t builderBytes) {
+  mNumTiles += 1;
+  updateMax(&mMaxSampleBytes, sampleBytes);
+  updateMax(&mMaxBuilderBytes, builderBytes);
+  updateMax(&mMaxTileBytes, sampleBytes + builderBytes);
+}
+
+void TileMemoryStats::print(FILE *file, int numThreads) const {
+  if (mNumTiles.load() == 0) {
+    return;
+  }
+  const double MB = 1024 * 1024;
+  fprintf(file, "Tile memory: largest %.1f MB (samples up to %.1f MB, "
+          "divide tree building up to %.1f MB); %d threads need about %.1f MB\n",
+          mMaxTileBytes.load() / MB, mMaxSampleBytes.load() / MB,
+          mMaxBuilderBytes.load() / MB, numThreads,
+          numThreads * (mMaxTileBytes.load() / MB));
+}
@@ -28,8 +28,33 @@
 
 #include "tile_cache.h"
 
+#include <atomic>
+#include <stdio.h>
 #include <string>
 
+class TreeBuilderPool;
+
+// Memory used by ProminenceTasks to process tiles, for choosing how many
+// tasks can run at once.  Safe to update from several threads.
+class TileMemoryStats {
+public:
+  TileMemoryStats();
+
+  // Record the memory used for one tile: its samples, and the working
+  // memory of building its divide tree
+  void record(size_t sampleBytes, size_t builderBytes);
+
+  // Print the largest tile, and an estimate of memory needed by the given
+  // number of threads
+  void print(FILE *file, int numThreads) const;
+
+private:
+  std::atomic<uint64> mNumTiles;
+  std::atomic<uint64> mMaxSampleBytes;
+  std::atomic<uint64> mMaxBuilderBytes;
+  std::atomic<uint64> mMaxTileBytes;
+};
+
 // Calculate prominence for all peaks in one tile
 class ProminenceTask {
 public:
@@ -44,6 +69,28 @@ public:
   // Determine whether this task computes prominence (value=false, the default),
   // or anti-prominence, which is the "prominence" of low points.
   void setAntiprominence(bool value);
+
+  // Build the divide tree for the tile in this many bands in parallel
+  // (default 1).  Peaks, prominences and runoffs are the same, but saddles
+  // in flat areas that cross a seam may be placed differently, and a
+  // different one of several saddles at the same elevation may be kept.
+  void setNumBands(int numBands);
+
+  // Build the divide tree with SweepTreeBuilder instead of TreeBuilder
+  // (default false).  Can't be combined with bands.
+  void setSweep(bool value);
+
+  // Walk uphill from saddles on this many threads when building the
+  // divide tree with TreeBuilder and no bands (default 1).  The result
+  // is the same.
+  void setNumWalkThreads(int numThreads);
+
+  // Record memory used for each tile in stats, which must outlive the task
+  void setMemoryStats(TileMemoryStats *stats);
+
+  // Get tree builders from pool, which must outlive the task, instead of
+  // allocating a new one for each tile
+  void setBuilderPool(TreeBuilderPool *pool);
   
 private:
   TileCache *mCache;
@@ -55,6 +102,11 @@ private:
   int mCurrentLongitude;
 
   bool mAntiprominence;
+  int mNumBands;
+  bool mSweep;
+  int mNumWalkThreads;
+  TileMemoryStats *mMemoryStats;  // May be nullptr
+  TreeBuilderPool *mBuilderPool;   // May be nullptr
 
   std::string getFilenamePrefix() const;
   bool writeStringToOutputFile(const std::string &filename, const std::string &str) const;
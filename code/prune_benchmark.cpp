@@ -0,0 +1,188 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// A tool to measure how long it takes to prune a large synthetic divide
+// tree, like the ones merge_divide_trees builds for big regions.
+
+#include "divide_tree.h"
+#include "island_tree.h"
+
+#include "easylogging++.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef PLATFORM_WINDOWS
+#include "getopt-win.h"
+#endif
+
+INITIALIZE_EASYLOGGINGPP
+
+using std::vector;
+
+static void usage() {
+  printf("Usage:\n");
+  printf("  prune_benchmark\n");
+  printf("\n");
+  printf("  Options:\n");
+  printf("  -p peaks          Number of peaks in the tree, default = 1000000\n");
+  printf("  -o runoffs        Number of runoffs in the tree, default = peaks / 1000\n");
+  printf("  -m min_prominence Prune to this prominence, default = 300ft\n");
+  printf("  -n iterations     Number of times to prune the tree, default = 3\n");
+  printf("  -r seed           Random seed for the tree, default = 1\n");
+  exit(1);
+}
+
+static const int PIXELS_PER_DEGREE = 3600;
+
+// Create a random tree: every peak but the first hangs off an earlier
+// one, a little higher or lower than it, through a saddle somewhat lower
+// than both.  Most peaks have little prominence, as in real terrain.
+static DivideTree *createRandomTree(int numPeaks, int numRunoffs, unsigned seed) {
+  std::mt19937 random(seed);
+  std::uniform_int_distribution<int> locationDistribution(0, PIXELS_PER_DEGREE - 1);
+  std::uniform_int_distribution<int> climbDistribution(-200, 200);
+  std::uniform_int_distribution<int> dropDistribution(1, 200);
+
+  // IDs are 1-based; saddle peakId - 1 joins peakId to its parent
+  vector<Peak> peaks;
+  vector<Saddle> saddles;
+  vector<int> parentIds(numPeaks + 1, (int) DivideTree::Node::Null);
+  peaks.reserve(numPeaks);
+  saddles.reserve(numPeaks);
+  for (int peakId = 1; peakId <= numPeaks; ++peakId) {
+    Offsets location(locationDistribution(random), locationDistribution(random));
+    if (peakId == 1) {
+      peaks.push_back(Peak(location, 5000));
+      continue;
+    }
+
+    std::uniform_int_distribution<int> parentDistribution(1, peakId - 1);
+    int parentId = parentDistribution(random);
+    parentIds[peakId] = parentId;
+    int parentElevation = peaks[parentId - 1].elevation;
+    int elevation = parentElevation + climbDistribution(random);
+    peaks.push_back(Peak(location, (Elevation) elevation));
+    
+    int saddleElevation = std::min(elevation, parentElevation) - dropDistribution(random);
+    Offsets saddleLocation(locationDistribution(random), locationDistribution(random));
+    saddles.push_back(Saddle(saddleLocation, (Elevation) saddleElevation));
+  }
+
+  vector<Runoff> runoffs;
+  vector<int> runoffPeakIds;
+  std::uniform_int_distribution<int> peakDistribution(1, numPeaks);
+  for (int i = 0; i < numRunoffs; ++i) {
+    int peakId = peakDistribution(random);
+    int elevation = peaks[peakId - 1].elevation - dropDistribution(random);
+    Offsets location(locationDistribution(random), locationDistribution(random));
+    runoffs.push_back(Runoff(location, (Elevation) elevation, 1));
+    runoffPeakIds.push_back(peakId);
+  }
+
+  CoordinateSystem coords(0, 0, PIXELS_PER_DEGREE, PIXELS_PER_DEGREE);
+  DivideTree *tree = new DivideTree(coords, peaks, saddles, runoffs);
+  for (int peakId = 2; peakId <= numPeaks; ++peakId) {
+    tree->addEdgeFromRoot(peakId, parentIds[peakId], peakId - 1);
+  }
+  for (int runoffId = 0; runoffId < numRunoffs; ++runoffId) {
+    tree->addRunoffEdge(runoffPeakIds[runoffId], runoffId);
+  }
+  return tree;
+}
+
+int main(int argc, char **argv) {
+  int numPeaks = 1000000;
+  int numRunoffs = -1;
+  float minProminence = 300;
+  int numIterations = 3;
+  unsigned seed = 1;
+
+  // Parse options
+  START_EASYLOGGINGPP(argc, argv);
+  int ch;
+  while ((ch = getopt(argc, argv, "m:n:o:p:r:")) != -1) {
+    switch (ch) {
+    case 'm':
+      minProminence = static_cast<float>(atof(optarg));
+      break;
+
+    case 'n':
+      numIterations = atoi(optarg);
+      break;
+
+    case 'o':
+      numRunoffs = atoi(optarg);
+      break;
+
+    case 'p':
+      numPeaks = atoi(optarg);
+      break;
+
+    case 'r':
+      seed = (unsigned) atoi(optarg);
+      break;
+
+    default:
+      usage();
+    }
+  }
+
+  argc -= optind;
+  if (numRunoffs < 0) {
+    numRunoffs = numPeaks / 1000;
+  }
+  if (argc != 0 || numPeaks < 1 || numIterations < 1) {
+    usage();
+  }
+
+  double totalSeconds = 0;
+  for (int i = 0; i < numIterations; ++i) {
+    // Pruning changes the tree, so every pass needs a fresh one
+    DivideTree *divideTree = createRandomTree(numPeaks, numRunoffs, seed);
+
+    auto start = std::chrono::steady_clock::now();
+    IslandTree *islandTree = new IslandTree(*divideTree);
+    islandTree->build();
+    auto built = std::chrono::steady_clock::now();
+    divideTree->prune(minProminence, *islandTree);
+    auto end = std::chrono::steady_clock::now();
+    double buildSeconds = std::chrono::duration<double>(built - start).count();
+    double pruneSeconds = std::chrono::duration<double>(end - built).count();
+    totalSeconds += pruneSeconds;
+
+    printf("Pass %d: island tree %.3f s, prune %.3f s, %d peaks left, %d saddles left\n",
+           i + 1, buildSeconds, pruneSeconds,
+           (int) divideTree->peaks().size(), (int) divideTree->saddles().size());
+    delete islandTree;
+    delete divideTree;
+  }
+
+  printf("%d peaks, %d runoffs: %.3f s per prune\n", numPeaks, numRunoffs,
+         totalSeconds / numIterations);
+
+  return 0;
+}
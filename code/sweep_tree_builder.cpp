@@ -0,0 +1,250 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "sweep_tree_builder.h"
+#include "divide_tree.h"
+#include "tree_builder.h"
+#include "easylogging++.h"
+
+#include <algorithm>
+
+using std::vector;
+
+SweepTreeBuilder::SweepTreeBuilder(const Tile *tile) :
+    mCoordinateSystem(tile->minLatitude(), tile->minLongitude(),
+                      tile->height() - 1,  // Remove overlap with neighbors
+                      tile->width() - 1) {
+  mTile = tile;
+  mSamples = tile->row(0);
+}
+
+DivideTree *SweepTreeBuilder::buildDivideTree() {
+  VLOG(1) << "Sorting samples";
+  sortSamples();
+
+  TreeBuilder::findTileRunoffs(mTile, &mRunoffs);
+  mRunoffCandidates.resize(mRunoffs.size());
+  mRunoffOrder.resize(mRunoffs.size());
+  for (int i = 0; i < (int) mRunoffs.size(); ++i) {
+    mRunoffOrder[i] = i;
+  }
+  std::stable_sort(mRunoffOrder.begin(), mRunoffOrder.end(), [this](int32 a, int32 b) {
+      return mRunoffs[a].elevation > mRunoffs[b].elevation;
+    });
+
+  VLOG(1) << "Sweeping samples";
+  mParents.assign(mTile->width() * mTile->height(), (int32) UNVISITED);
+  size_t nextRunoff = 0;
+  for (size_t i = 0; i < mOrder.size(); ++i) {
+    sweepSample(mOrder[i]);
+
+    // Once all samples at an elevation are swept, runoffs there know
+    // which component they're in
+    Elevation elev = mSamples[mOrder[i]];
+    if (i + 1 == mOrder.size() || mSamples[mOrder[i + 1]] != elev) {
+      connectRunoffs(elev, &nextRunoff);
+    }
+  }
+
+  VLOG(1) << "Building divide tree";
+  return generateDivideTree();
+}
+
+void SweepTreeBuilder::sortSamples() {
+  // Counting sort, with a bucket for each elevation.  Bucket 0 is the
+  // highest possible elevation.
+  const int numBuckets = 65536;
+  vector<int32> bucketStarts(numBuckets + 1, 0);
+  int numSamples = mTile->width() * mTile->height();
+  for (int index = 0; index < numSamples; ++index) {
+    Elevation elev = mSamples[index];
+    if (elev != Tile::NODATA_ELEVATION) {
+      bucketStarts[32767 - elev + 1] += 1;
+    }
+  }
+  for (int bucket = 1; bucket <= numBuckets; ++bucket) {
+    bucketStarts[bucket] += bucketStarts[bucket - 1];
+  }
+
+  // Samples are placed in scan order, which keeps ties in scan order
+  mOrder.resize(bucketStarts[numBuckets]);
+  for (int index = 0; index < numSamples; ++index) {
+    Elevation elev = mSamples[index];
+    if (elev != Tile::NODATA_ELEVATION) {
+      mOrder[bucketStarts[32767 - elev]++] = index;
+    }
+  }
+}
+
+void SweepTreeBuilder::sweepSample(int32 index) {
+  int width = mTile->width();
+  int x = index % width;
+  int y = index / width;
+  Elevation elev = mSamples[index];
+
+  // Find the distinct components around the sample
+  int32 roots[8];
+  int numRoots = 0;
+  for (int dy = -1; dy <= 1; ++dy) {
+    for (int dx = -1; dx <= 1; ++dx) {
+      if ((dx == 0 && dy == 0) || !mTile->isInExtents(x + dx, y + dy)) {
+        continue;
+      }
+
+      int32 neighbor = index + dy * width + dx;
+      if (mParents[neighbor] == UNVISITED) {
+        continue;
+      }
+
+      int32 root = findRoot(neighbor);
+      if (std::find(roots, roots + numRoots, root) == roots + numRoots) {
+        roots[numRoots++] = root;
+      }
+    }
+  }
+
+  if (numRoots == 0) {
+    // Nothing higher or equal around: start a new component
+    mParents[index] = encodeRoot((int32) mCandidates.size());
+    mCandidates.push_back(Peak(Offsets(x, y), elev));
+    mDiscarded.push_back(false);
+    return;
+  }
+
+  // The component with the highest peak absorbs the others.  Candidates
+  // are found highest first, so its candidate has the lowest index.
+  int32 mainRoot = roots[0];
+  for (int i = 1; i < numRoots; ++i) {
+    if (decodeRoot(mParents[roots[i]]) < decodeRoot(mParents[mainRoot])) {
+      mainRoot = roots[i];
+    }
+  }
+  int32 mainCandidate = decodeRoot(mParents[mainRoot]);
+
+  mParents[index] = mainRoot;
+  for (int i = 0; i < numRoots; ++i) {
+    int32 root = roots[i];
+    if (root == mainRoot) {
+      continue;
+    }
+
+    int32 candidate = decodeRoot(mParents[root]);
+    if (mCandidates[candidate].elevation == elev) {
+      // Part of the same flat area as this sample, which either rises to
+      // the main component or is the main component's peak
+      mDiscarded[candidate] = true;
+    } else {
+      // Both components rise above this sample, so it's a saddle between them
+      mSaddles.push_back(Saddle(Offsets(x, y), elev));
+      mEdges.push_back(Edge(candidate, mainCandidate, (int32) mSaddles.size()));
+    }
+    mParents[root] = mainRoot;
+  }
+}
+
+void SweepTreeBuilder::connectRunoffs(Elevation elevation, size_t *next) {
+  int width = mTile->width();
+  while (*next < mRunoffOrder.size()) {
+    int32 runoffIndex = mRunoffOrder[*next];
+    Runoff &runoff = mRunoffs[runoffIndex];
+    if (runoff.elevation != elevation) {
+      break;
+    }
+
+    int32 root = findRoot(runoff.location.y() * width + runoff.location.x());
+    int32 candidate = decodeRoot(mParents[root]);
+    // If nothing in the component is higher, it's all the flat area of a peak
+    runoff.insidePeakArea = (mCandidates[candidate].elevation == elevation);
+    mRunoffCandidates[runoffIndex] = candidate;
+    *next += 1;
+  }
+}
+
+int32 SweepTreeBuilder::findRoot(int32 index) {
+  // Path halving: point every other sample on the way at its grandparent
+  while (mParents[index] >= 0) {
+    int32 parent = mParents[index];
+    int32 grandparent = mParents[parent];
+    if (grandparent < 0) {
+      return parent;
+    }
+    mParents[index] = grandparent;
+    index = grandparent;
+  }
+  return index;
+}
+
+DivideTree *SweepTreeBuilder::generateDivideTree() {
+  // Number peaks in scan order, as TreeBuilder does
+  vector<int32> peakCandidates;
+  for (int32 candidate = 0; candidate < (int32) mCandidates.size(); ++candidate) {
+    if (!mDiscarded[candidate]) {
+      peakCandidates.push_back(candidate);
+    }
+  }
+  std::sort(peakCandidates.begin(), peakCandidates.end(), [this](int32 a, int32 b) {
+      return mCandidates[a].location.value() < mCandidates[b].location.value();
+    });
+
+  vector<int32> peakIds(mCandidates.size(), 0);  // 0 for discarded candidates
+  vector<Peak> peaks;
+  peaks.reserve(peakCandidates.size());
+  for (int32 candidate : peakCandidates) {
+    peaks.push_back(mCandidates[candidate]);
+    peakIds[candidate] = (int32) peaks.size();  // Peaks are 1-indexed
+  }
+
+  DivideTree *tree = new DivideTree(mCoordinateSystem, peaks, mSaddles, mRunoffs);
+
+  // Each edge's child was the root of its tree when the edge was found,
+  // and edges are added in the same order
+  for (const Edge &edge : mEdges) {
+    tree->addEdgeFromRoot(peakIds[edge.child], peakIds[edge.parent], edge.saddleId);
+  }
+
+  for (int index = 0; index < (int) mRunoffs.size(); ++index) {
+    tree->addRunoffEdge(peakIds[mRunoffCandidates[index]], index);
+  }
+
+  if (VLOG_IS_ON(2)) {
+    tree->debugPrint();
+  }
+
+  VLOG(1) << "Found " << peaks.size() << " peaks, " << mSaddles.size() << " prom saddles, "
+          << mRunoffs.size() << " runoffs";
+
+  return tree;
+}
+
+size_t SweepTreeBuilder::memoryBytes() const {
+  return mOrder.capacity() * sizeof(int32) +
+    mParents.capacity() * sizeof(int32) +
+    mCandidates.capacity() * sizeof(Peak) +
+    mDiscarded.capacity() / 8 +
+    mEdges.capacity() * sizeof(Edge) +
+    mSaddles.capacity() * sizeof(Saddle) +
+    mRunoffs.capacity() * sizeof(Runoff) +
+    mRunoffCandidates.capacity() * sizeof(int32) +
+    mRunoffOrder.capacity() * sizeof(int32);
+}
@@ -0,0 +1,131 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _SWEEP_TREE_BUILDER_H_
+#define _SWEEP_TREE_BUILDER_H_
+
+// An alternative to TreeBuilder that converts a terrain tile into a
+// divide tree in one pass over the samples.  The algorithm is:
+//
+// * Sort the samples by elevation, highest first.  Samples of equal
+// elevation are kept in scan order.
+//
+// * Sweep the samples in that order, keeping the connected components
+// of the samples seen so far in a union-find forest.  Each component
+// remembers its highest peak, which is always the root of the
+// component's part of the divide tree.
+//
+// * A sample with no neighbors seen yet starts a new component, whose
+// first sample is a candidate peak.  A sample that touches several
+// components joins them.  If two of them rise above the sample, it's a
+// saddle, and the lower of their two peaks becomes a child of the
+// higher one.  A component that doesn't rise above the sample is part
+// of the same flat area, so its candidate peak is discarded.
+//
+// * Runoffs are found the same way as TreeBuilder, and connected to the
+// peak of their component once all samples at their elevation are seen.
+//
+// Since edges only ever join two separate trees, the divide tree never
+// needs to be searched for cycles, and there are no basin or false
+// saddles.  Peaks are the same as TreeBuilder's, in the same order.
+// Saddles in flat areas may be at different places, but the resulting
+// prominence values are the same.
+
+#include "primitives.h"
+#include "coordinate_system.h"
+#include "tile.h"
+
+#include <vector>
+
+class DivideTree;
+
+class SweepTreeBuilder {
+public:
+  explicit SweepTreeBuilder(const Tile *tile);
+
+  DivideTree *buildDivideTree();
+
+  // Memory used while building the divide tree, not counting the tile
+  // itself, in bytes.  Call after buildDivideTree.
+  size_t memoryBytes() const;
+
+private:
+  // Value in mParents of a sample that hasn't been swept yet
+  static const int32 UNVISITED = -1;
+
+  // An edge of the divide tree, in terms of indices into mCandidates
+  struct Edge {
+    Edge(int32 c, int32 p, int32 s) :
+        child(c), parent(p), saddleId(s) {
+    }
+
+    int32 child;
+    int32 parent;
+    int32 saddleId;
+  };
+
+  const Tile *mTile;
+  const Elevation *mSamples;  // All of mTile's samples, one row after another
+  CoordinateSystem mCoordinateSystem;
+
+  // Sample indices (y * width + x), highest elevation first
+  std::vector<int32> mOrder;
+  // Union-find forest of the samples.  UNVISITED for a sample not swept
+  // yet, the index of the parent sample for a swept sample that isn't
+  // a root, or encodeRoot(candidate) for a root.
+  std::vector<int32> mParents;
+
+  // Candidate peaks, in the order they were found
+  std::vector<Peak> mCandidates;
+  // Parallel array with mCandidates; true if not a peak after all
+  std::vector<bool> mDiscarded;
+  std::vector<Edge> mEdges;
+  std::vector<Saddle> mSaddles;
+  std::vector<Runoff> mRunoffs;
+  // Parallel array with mRunoffs; the candidate each runoff flows to
+  std::vector<int32> mRunoffCandidates;
+  // Indices into mRunoffs, highest elevation first
+  std::vector<int32> mRunoffOrder;
+
+  static int32 encodeRoot(int32 candidate) { return -2 - candidate; }
+  static int32 decodeRoot(int32 parent) { return -2 - parent; }
+
+  // Sort the samples into mOrder
+  void sortSamples();
+
+  // Add the given sample to the components of its swept neighbors
+  void sweepSample(int32 index);
+
+  // Connect the runoffs at the given elevation, starting at
+  // mRunoffOrder[*next], to the peaks of their components, and advance
+  // *next past them
+  void connectRunoffs(Elevation elevation, size_t *next);
+
+  // Return the root of the component containing the given swept sample
+  int32 findRoot(int32 index);
+
+  DivideTree *generateDivideTree();
+};
+
+#endif  // _SWEEP_TREE_BUILDER_H_
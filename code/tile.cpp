@@ -23,15 +23,19 @@
  */
 
 #include "tile.h"
+#include "mapped_file.h"
 #include "math_util.h"
 #include "util.h"
+#include "zip_file.h"
 
 #include "easylogging++.h"
 
 #include <algorithm>
 #include <assert.h>
+#include <memory>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 using std::string;
 using std::vector;
@@ -51,6 +55,32 @@ static uint16 swapByteOrder16(uint16 us) {
   return (us >> 8) | (us << 8);
 }
 
+// Convert big-endian SRTM samples in meters to native samples in feet.
+// There are no branches or calls in the loop body, so that the
+// compiler can vectorize it.
+static void convertHgtSamples(const uint16 *in, Elevation *out, int numSamples) {
+  for (int i = 0; i < numSamples; ++i) {
+    Elevation meters = (Elevation) swapByteOrder16(in[i]);
+    // Use feet internally; small unit avoids losing precision with external data
+    Elevation feet = (Elevation) (int32) metersToFeet(meters);
+    out[i] = (meters == Tile::NODATA_ELEVATION) ? meters : feet;
+  }
+}
+
+// Convert a row of NED samples in meters to native samples in feet.
+static void convertFltRow(const float *in, Elevation *out, int numSamples) {
+  for (int i = 0; i < numSamples; ++i) {
+    float sample = in[i];
+    // Convert NED nodata to SRTM nodata
+    if (fabs(sample - NED_NODATA_ELEVATION) < 0.01) {
+      out[i] = Tile::NODATA_ELEVATION;
+    } else {
+      // Use feet internally; small unit avoids losing precision with external data
+      out[i] = (Elevation) metersToFeet(sample);
+    }
+  }
+}
+
 Tile::Tile() {
   mSamples = nullptr;
   mLngDistanceScale = nullptr;
@@ -99,14 +129,78 @@ void Tile::flipElevations() {
   
 }
 
+void Tile::getEdges(TileEdges *edges) const {
+  edges->topRow.assign(mSamples, mSamples + mWidth);
+  edges->leftColumn.resize(mHeight);
+  for (int y = 0; y < mHeight; ++y) {
+    edges->leftColumn[y] = get(0, y);
+  }
+}
+
+Tile *Tile::createBand(int minY, int maxY) const {
+  assert(minY >= 0 && maxY < mHeight && minY < maxY);
+  int height = maxY - minY + 1;
+  Elevation *samples = (Elevation *) malloc(sizeof(Elevation) * mWidth * height);
+  memcpy(samples, mSamples + minY * mWidth, sizeof(Elevation) * mWidth * height);
+
+  Tile *band = new Tile();
+  band->mWidth = mWidth;
+  band->mHeight = height;
+  band->mSamples = samples;
+  band->mArcsecondsPerSample = mArcsecondsPerSample;
+  band->mMinLng = mMinLng;
+  band->mMaxLng = mMaxLng;
+  band->mMaxLat = latlng(Offsets(0, minY)).latitude();
+  band->mMinLat = latlng(Offsets(0, maxY)).latitude();
+
+  precomputeTileAfterLoad(band);
+  return band;
+}
+
+void Tile::removeSpikes() {
+  static const Elevation MAX_LEGAL_ELEVATION_DIFF = 1000;
+  for (int y = 0; y < mHeight; ++y) {
+    for (int x = 0; x < mWidth; ++x) {
+      Elevation elev = get(x, y);
+      if (elev != NODATA_ELEVATION) {
+        // Enough to check the 4-neighbors.  Kill the higher point.
+        if (isInExtents(Offsets(x + 1, y))) {
+          Elevation neighborElev = get(x + 1, y);
+          if (neighborElev != NODATA_ELEVATION && elev - neighborElev > MAX_LEGAL_ELEVATION_DIFF) {
+            set(x, y, NODATA_ELEVATION);
+          }
+        }
+        if (isInExtents(Offsets(x, y + 1))) {
+          Elevation neighborElev = get(x, y + 1);
+          if (neighborElev != NODATA_ELEVATION && elev - neighborElev > MAX_LEGAL_ELEVATION_DIFF) {
+            set(x, y, NODATA_ELEVATION);
+          }
+        }
+        if (isInExtents(Offsets(x - 1, y))) {
+          Elevation neighborElev = get(x - 1, y);
+          if (neighborElev != NODATA_ELEVATION && elev - neighborElev > MAX_LEGAL_ELEVATION_DIFF) {
+            set(x, y, NODATA_ELEVATION);
+          }
+        }
+        if (isInExtents(Offsets(x, y - 1))) {
+          Elevation neighborElev = get(x, y - 1);
+          if (neighborElev != NODATA_ELEVATION && elev - neighborElev > MAX_LEGAL_ELEVATION_DIFF) {
+            set(x, y, NODATA_ELEVATION);
+          }
+        }
+
+        // Print out spikes
+        if (get(x, y) == NODATA_ELEVATION && VLOG_IS_ON(1)) {
+          LatLng pos = latlng(Offsets(x, y));
+          LOG(INFO) << "Removed possible spike at " << pos.latitude() << ", " << pos.longitude();
+        }
+      }
+    }
+  }
+}
+
 Tile *Tile::loadFromHgtFile(const string &directory, int minLat, int minLng) {
-  char buf[100];
-  sprintf(buf, "%c%02d%c%03d.hgt",
-          (minLat >= 0) ? 'N' : 'S',
-          abs(minLat),
-          (minLng >= 0) ? 'E' : 'W',
-          abs(minLng));
-  string filename(buf);
+  string filename = getHgtFilename(minLat, minLng);
   if (!directory.empty()) {
     filename = directory + "/" + filename;
   }
@@ -139,20 +233,7 @@ Tile *Tile::loadFromHgtFile(const string &directory, int minLat, int minLng) {
       }
     }
     
-    retval = new Tile();
-    Tile *tile = retval;
-    tile->mWidth = HGT_TILE_SIZE;
-    tile->mHeight = HGT_TILE_SIZE;
-    tile->mSamples = samples;
-    tile->mArcsecondsPerSample = 3.0f;
-
-    // Tile is 1 square degree
-    tile->mMinLat = minLat;
-    tile->mMinLng = minLng;
-    tile->mMaxLat = tile->mMinLat + 1;
-    tile->mMaxLng = tile->mMinLng + 1;
-
-    precomputeTileAfterLoad(tile);
+    retval = createOneDegreeTile(minLat, minLng, HGT_TILE_SIZE, 3.0f, samples);
   }
   
   fclose(infile);
@@ -160,75 +241,28 @@ Tile *Tile::loadFromHgtFile(const string &directory, int minLat, int minLng) {
   return retval;
 }
 
-Tile *Tile::loadFromFltFile(const string &directory, int minLat, int minLng, FileFormat format) {
-  string filename = getFltFilename(minLat, minLng, format);
+Tile *Tile::loadFromMappedHgtFile(const string &directory, int minLat, int minLng) {
+  string filename = getHgtFilename(minLat, minLng);
   if (!directory.empty()) {
     filename = directory + "/" + filename;
   }
-  
-  FILE *infile = fopen(filename.c_str(), "rb");
-  if (infile == nullptr) {
-    VLOG(3) << "Failed to open file " << filename;
+
+  MappedFile file;
+  if (!file.open(filename)) {
     return nullptr;
   }
 
-  const int rawSideLength = (format == FileFormat::NED13_ZIP ? FLT_13_RAW_SIZE : FLT_1_RAW_SIZE);
-  const int tileSideLength = rawSideLength - 2 * FLT_EXTRA_BORDER + 1;
-  int num_raw_samples = rawSideLength * rawSideLength;
-  
-  Elevation *samples = (Elevation *) malloc(sizeof(Elevation) * tileSideLength * tileSideLength);
-  float *inbuf = new float[num_raw_samples];
-  
-  Tile *retval = nullptr;
-  int num_read = fread(inbuf, sizeof(float), num_raw_samples, infile);
-  if (num_read != num_raw_samples) {
+  int num_samples = HGT_TILE_SIZE * HGT_TILE_SIZE;
+  if (file.size() < sizeof(int16) * num_samples) {
     fprintf(stderr, "Couldn't read tile file: %s, got %d samples expecting %d\n",
-            filename.c_str(), num_read, num_raw_samples);
-    free(samples);
-    samples = nullptr;
-  } else {
-    // Discard extra overlap so that just 1 pixel remains around the outsides.
-    // Overwrites samples array in-place
-    for (int i = 0; i < rawSideLength; ++i) {
-      for (int j = 0; j < rawSideLength; ++j) {
-        float sample = inbuf[i * rawSideLength + j];
-        
-        // Convert NED nodata to SRTM nodata
-        if (i >= FLT_EXTRA_BORDER && i < tileSideLength + FLT_EXTRA_BORDER &&
-            j >= FLT_EXTRA_BORDER && j < tileSideLength + FLT_EXTRA_BORDER) {
-          int index = ((i - FLT_EXTRA_BORDER) * tileSideLength) + (j - FLT_EXTRA_BORDER);
-          if (fabs(sample - NED_NODATA_ELEVATION) < 0.01) {
-            samples[index] = NODATA_ELEVATION;
-          } else {
-            // Use feet internally; small unit avoids losing precision with external data
-            samples[index] = (Elevation) metersToFeet(sample);
-          }
-        }
-      }
-    }
-  }
-  
-  if (samples != nullptr) {
-    retval = new Tile();
-    Tile *tile = retval;
-    tile->mWidth = tileSideLength;
-    tile->mHeight = tileSideLength;
-    tile->mSamples = samples;
-    tile->mArcsecondsPerSample = (format == FileFormat::NED1_ZIP ? 1.0f : (1.0f / 3.0f));
-
-    // Tile is 1 square degree
-    tile->mMinLat = minLat;
-    tile->mMinLng = minLng;
-    tile->mMaxLat = tile->mMinLat + 1;
-    tile->mMaxLng = tile->mMinLng + 1;
-
-    precomputeTileAfterLoad(tile);
+            filename.c_str(), (int) (file.size() / sizeof(int16)), num_samples);
+    return nullptr;
   }
 
-  delete [] inbuf;
-  fclose(infile);
+  Elevation *samples = (Elevation *) malloc(sizeof(Elevation) * num_samples);
+  convertHgtSamples(static_cast<const uint16 *>(file.data()), samples, num_samples);
 
-  return retval;  
+  return createOneDegreeTile(minLat, minLng, HGT_TILE_SIZE, 3.0f, samples);
 }
 
 Tile *Tile::loadFromNED13ZipFile(const string &directory, int minLat, int minLng) {
@@ -239,6 +273,24 @@ Tile *Tile::loadFromNED1ZipFile(const string &directory, int minLat, int minLng)
   return loadFromNEDZipFileInternal(directory, minLat, minLng, FileFormat::NED1_ZIP);
 }
 
+Tile *Tile::createOneDegreeTile(int minLat, int minLng, int sideLength,
+                               float arcsecondsPerSample, Elevation *samples) {
+  Tile *tile = new Tile();
+  tile->mWidth = sideLength;
+  tile->mHeight = sideLength;
+  tile->mSamples = samples;
+  tile->mArcsecondsPerSample = arcsecondsPerSample;
+
+  // Tile is 1 square degree
+  tile->mMinLat = minLat;
+  tile->mMinLng = minLng;
+  tile->mMaxLat = tile->mMinLat + 1;
+  tile->mMaxLng = tile->mMinLng + 1;
+
+  precomputeTileAfterLoad(tile);
+  return tile;
+}
+
 void Tile::precomputeTileAfterLoad(Tile *tile) {
   // Precompute max elevation
   tile->recomputeMaxElevation();
@@ -281,6 +333,117 @@ Elevation Tile::computeMaxElevation() const {
 
 Tile *Tile::loadFromNEDZipFileInternal(const std::string &directory,
                                        int minLat, int minLng, FileFormat format) {
+  // Inflate the .flt file straight out of the zip file, a row at a time
+  ZipFile zipFile;
+  std::unique_ptr<ZipEntryReader> reader(
+      openNEDZipEntry(directory, minLat, minLng, format, &zipFile));
+  if (reader.get() == nullptr) {
+    return nullptr;
+  }
+
+  const int rawSideLength = (format == FileFormat::NED13_ZIP ? FLT_13_RAW_SIZE : FLT_1_RAW_SIZE);
+  const int tileSideLength = rawSideLength - 2 * FLT_EXTRA_BORDER + 1;
+
+  Elevation *samples = (Elevation *) malloc(sizeof(Elevation) * tileSideLength * tileSideLength);
+  vector<float> inbuf(rawSideLength);
+
+  for (int i = 0; i < rawSideLength; ++i) {
+    size_t rowBytes = sizeof(float) * rawSideLength;
+    if (reader->read(&inbuf[0], rowBytes) != rowBytes) {
+      fprintf(stderr, "Couldn't read tile file: %s, got %d rows expecting %d\n",
+              getFltFilename(minLat, minLng, format).c_str(), i, rawSideLength);
+      free(samples);
+      return nullptr;
+    }
+
+    // Discard extra overlap so that just 1 pixel remains around the outsides.
+    if (i >= FLT_EXTRA_BORDER && i < tileSideLength + FLT_EXTRA_BORDER) {
+      convertFltRow(&inbuf[FLT_EXTRA_BORDER],
+                    samples + (i - FLT_EXTRA_BORDER) * tileSideLength, tileSideLength);
+    }
+  }
+
+  return createOneDegreeTile(minLat, minLng, tileSideLength,
+                             (format == FileFormat::NED1_ZIP ? 1.0f : (1.0f / 3.0f)),
+                             samples);
+}
+
+bool Tile::loadEdgesFromHgtFile(const string &directory, int minLat, int minLng,
+                                TileEdges *edges) {
+  string filename = getHgtFilename(minLat, minLng);
+  if (!directory.empty()) {
+    filename = directory + "/" + filename;
+  }
+
+  MappedFile file;
+  if (!file.open(filename)) {
+    return false;
+  }
+
+  if (file.size() < sizeof(int16) * HGT_TILE_SIZE * HGT_TILE_SIZE) {
+    fprintf(stderr, "Couldn't read tile file: %s, size %d\n", filename.c_str(), (int) file.size());
+    return false;
+  }
+
+  const uint16 *in = static_cast<const uint16 *>(file.data());
+  edges->topRow.resize(HGT_TILE_SIZE);
+  convertHgtSamples(in, &edges->topRow[0], HGT_TILE_SIZE);
+  edges->leftColumn.resize(HGT_TILE_SIZE);
+  for (int y = 0; y < HGT_TILE_SIZE; ++y) {
+    convertHgtSamples(in + y * HGT_TILE_SIZE, &edges->leftColumn[y], 1);
+  }
+
+  return true;
+}
+
+bool Tile::loadEdgesFromNED13ZipFile(const string &directory, int minLat, int minLng,
+                                     TileEdges *edges) {
+  return loadEdgesFromNEDZipFileInternal(directory, minLat, minLng, FileFormat::NED13_ZIP, edges);
+}
+
+bool Tile::loadEdgesFromNED1ZipFile(const string &directory, int minLat, int minLng,
+                                    TileEdges *edges) {
+  return loadEdgesFromNEDZipFileInternal(directory, minLat, minLng, FileFormat::NED1_ZIP, edges);
+}
+
+bool Tile::loadEdgesFromNEDZipFileInternal(const string &directory, int minLat, int minLng,
+                                           FileFormat format, TileEdges *edges) {
+  ZipFile zipFile;
+  std::unique_ptr<ZipEntryReader> reader(
+      openNEDZipEntry(directory, minLat, minLng, format, &zipFile));
+  if (reader.get() == nullptr) {
+    return false;
+  }
+
+  const int rawSideLength = (format == FileFormat::NED13_ZIP ? FLT_13_RAW_SIZE : FLT_1_RAW_SIZE);
+  const int tileSideLength = rawSideLength - 2 * FLT_EXTRA_BORDER + 1;
+
+  edges->topRow.resize(tileSideLength);
+  edges->leftColumn.resize(tileSideLength);
+  vector<float> inbuf(rawSideLength);
+
+  // Rows after the last one in the tile aren't needed
+  for (int i = 0; i < tileSideLength + FLT_EXTRA_BORDER; ++i) {
+    size_t rowBytes = sizeof(float) * rawSideLength;
+    if (reader->read(&inbuf[0], rowBytes) != rowBytes) {
+      fprintf(stderr, "Couldn't read tile file: %s, got %d rows expecting %d\n",
+              getFltFilename(minLat, minLng, format).c_str(), i, rawSideLength);
+      return false;
+    }
+
+    if (i == FLT_EXTRA_BORDER) {
+      convertFltRow(&inbuf[FLT_EXTRA_BORDER], &edges->topRow[0], tileSideLength);
+    }
+    if (i >= FLT_EXTRA_BORDER) {
+      convertFltRow(&inbuf[FLT_EXTRA_BORDER], &edges->leftColumn[i - FLT_EXTRA_BORDER], 1);
+    }
+  }
+
+  return true;
+}
+
+ZipEntryReader *Tile::openNEDZipEntry(const string &directory, int minLat, int minLng,
+                                      FileFormat format, ZipFile *zipFile) {
   char buf[100];
   sprintf(buf, "%c%02d%c%03d.zip",
           (minLat >= 0) ? 'n' : 's',
@@ -296,30 +459,27 @@ Tile *Tile::loadFromNEDZipFileInternal(const std::string &directory,
     VLOG(1) << "Input tile " << filename << " doesn't exist; skipping";
     return nullptr;
   }
-  
-  string tempDirectory = getTempDir();
-  string fltFilename = getFltFilename(minLat, minLng, format);
 
-  // Unzip flt file from zip to temp dir
-#ifdef PLATFORM_WINDOWS
-  string command = "7z x \"" + filename + "\" " + fltFilename + " -y -o" + tempDirectory
-    + " > nul";
-#else  
-  string command = "unzip -o \"" + filename + "\" " + fltFilename + " -d " + tempDirectory;
-#endif
-  VLOG(2) << "Unzip command is " << command;
-  int retval = system(command.c_str());
-  if (retval != 0) {
-    LOG(ERROR) << "Command failed: " << command;
+  if (!zipFile->open(filename)) {
+    LOG(ERROR) << "Couldn't open zip file " << filename;
+    return nullptr;
   }
-  
-  Tile *tile = loadFromFltFile(tempDirectory, minLat, minLng, format);
+  string fltFilename = getFltFilename(minLat, minLng, format);
+  ZipEntryReader *reader = zipFile->openEntry(fltFilename);
+  if (reader == nullptr) {
+    LOG(ERROR) << "Couldn't find " << fltFilename << " in " << filename;
+  }
+  return reader;
+}
 
-  // Delete temp file
-  string fltFullFilename = tempDirectory + "/" + fltFilename;
-  remove(fltFullFilename.c_str());
-  
-  return tile;  
+string Tile::getHgtFilename(int minLat, int minLng) {
+  char buf[100];
+  sprintf(buf, "%c%02d%c%03d.hgt",
+          (minLat >= 0) ? 'N' : 'S',
+          abs(minLat),
+          (minLng >= 0) ? 'E' : 'W',
+          abs(minLng));
+  return buf;
 }
 
 string Tile::getFltFilename(int minLat, int minLng, FileFormat format) {
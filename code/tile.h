@@ -46,6 +46,17 @@ enum DataType {
   SRTM, NED,
 };
 
+class ZipFile;
+class ZipEntryReader;
+
+// The first row and first column of a tile's samples.  Since samples
+// are edge-centered, these duplicate the last row of the tile above and
+// the last column of the tile to the left.
+struct TileEdges {
+  std::vector<Elevation> topRow;
+  std::vector<Elevation> leftColumn;
+};
+
 class Tile {
 public:
 
@@ -78,6 +89,11 @@ public:
     return mSamples[y * mWidth + x];
   }
 
+  // The samples of row y, for loops over whole rows
+  const Elevation *row(int y) const {
+    return mSamples + y * mWidth;
+  }
+
   void set(int x, int y, Elevation elevation) {
     mSamples[y * mWidth + x] = elevation;
   }
@@ -112,17 +128,52 @@ public:
   // Nominal arcseconds per data sample
   float arcsecondsPerSample() const;
 
+  // Memory used by the samples, in bytes
+  size_t sampleBytes() const {
+    return sizeof(Elevation) * mWidth * mHeight;
+  }
+
   // Flip elevations so that depressions and mountains are swapped.
   // No-data values are left unchanged.
   void flipElevations();
+
+  // Look for big spikes, which are assumed to be errors in the data,
+  // and replace them with NODATA.
+  void removeSpikes();
+
+  // Copy this tile's top row and left column into edges.
+  void getEdges(TileEdges *edges) const;
+
+  // Create a tile holding a copy of rows minY through maxY (inclusive)
+  // of this tile, with its extents adjusted to match.
+  Tile *createBand(int minY, int maxY) const;
   
   // minLat and minLng name the SW corner of the tile, in degrees
   static Tile *loadFromHgtFile(const std::string &directory, int minLat, int minLng);
+  // Same as loadFromHgtFile, but memory-maps the file and converts the samples
+  // directly out of the mapping, avoiding a copy through an intermediate buffer.
+  static Tile *loadFromMappedHgtFile(const std::string &directory, int minLat, int minLng);
   // NED 1/3 arcsecond zip file containing a .flt file
   static Tile *loadFromNED13ZipFile(const std::string &directory, int minLat, int minLng);
   // NED 1 arcsecond zip file containing a .flt file
   static Tile *loadFromNED1ZipFile(const std::string &directory, int minLat, int minLng);
 
+  // Read just the top row and left column of a tile into edges, without
+  // loading the rest of it.  Return false if the tile doesn't exist.
+  // NED .flt data is compressed, so the whole file still has to be
+  // inflated, but no other samples are converted or kept.
+  static bool loadEdgesFromHgtFile(const std::string &directory, int minLat, int minLng,
+                                   TileEdges *edges);
+  static bool loadEdgesFromNED13ZipFile(const std::string &directory, int minLat, int minLng,
+                                        TileEdges *edges);
+  static bool loadEdgesFromNED1ZipFile(const std::string &directory, int minLat, int minLng,
+                                       TileEdges *edges);
+
+  // Create a tile covering 1 square degree with the given SW corner,
+  // taking ownership of samples (allocated with malloc).
+  static Tile *createOneDegreeTile(int minLat, int minLng, int sideLength,
+                                   float arcsecondsPerSample, Elevation *samples);
+
   // Missing data in source
   static const Elevation NODATA_ELEVATION = -32768;
   
@@ -152,16 +203,23 @@ private:
 
   // Precompute some internal values after tile is loaded with samples
   static void precomputeTileAfterLoad(Tile *tile);
+
+  // Return the filename for the .hgt file for the given coordinates
+  static std::string getHgtFilename(int minLat, int minLng);
   
   Elevation computeMaxElevation() const;
 
   static Tile *loadFromNEDZipFileInternal(const std::string &directory, int minLat, int minLng,
                                           FileFormat format);
 
-  // format gives the resolution of the NED data
-  static Tile *loadFromFltFile(const std::string &directory, int minLat, int minLng,
-                               FileFormat format);
-  
+  static bool loadEdgesFromNEDZipFileInternal(const std::string &directory, int minLat, int minLng,
+                                              FileFormat format, TileEdges *edges);
+
+  // Open the .flt entry of the NED zip file for the given coordinates.
+  // Return nullptr if the file doesn't exist or is bad.
+  static ZipEntryReader *openNEDZipEntry(const std::string &directory, int minLat, int minLng,
+                                         FileFormat format, ZipFile *zipFile);
+
   // Return the filename for the .flt file for the given coordinates
   static std::string getFltFilename(int minLat, int minLng, FileFormat format);
 };
@@ -0,0 +1,257 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// A tool to measure how long it takes to load terrain tiles with the
+// different loading methods, with the OS page cache both cold and warm.
+
+#include "tile.h"
+#include "tile_loading_policy.h"
+#include "tile_pack.h"
+
+#include "easylogging++.h"
+
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#ifdef PLATFORM_LINUX
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef PLATFORM_WINDOWS
+#include "getopt-win.h"
+#endif
+
+using std::string;
+using std::vector;
+
+INITIALIZE_EASYLOGGINGPP
+
+static void usage() {
+  printf("Usage:\n");
+  printf("  tile_benchmark min_lat max_lat min_lng max_lng\n");
+  printf("  where coordinates are integer degrees\n");
+  printf("\n");
+  printf("  Options:\n");
+  printf("  -i directory      Directory with terrain data\n");
+  printf("  -f format         \"SRTM\", \"NED13-ZIP\", \"NED1-ZIP\" input files\n");
+  printf("  -n iterations     Number of passes over the tiles, default = 3\n");
+  printf("  -p filename       Also measure loading from the given tile pack\n");
+  exit(1);
+}
+
+// Ask the OS to drop any cached pages of the given file, so that the next
+// load has to go to disk.
+static void evictFileFromPageCache(const string &filename) {
+#ifdef PLATFORM_LINUX
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+#endif
+}
+
+// Same as evictFileFromPageCache, for all files in the given directory.
+// Returns false if not supported.
+static bool evictDirectoryFromPageCache(const string &directory) {
+#ifdef PLATFORM_LINUX
+  DIR *dir = opendir(directory.c_str());
+  if (dir == nullptr) {
+    return false;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    evictFileFromPageCache(directory + "/" + entry->d_name);
+  }
+  closedir(dir);
+  return true;
+#else
+  return false;
+#endif
+}
+
+// A way of loading tiles to be measured
+struct LoadingMethod {
+  string name;
+  TileLoadingPolicy *policy;
+};
+
+struct Timing {
+  double totalSeconds;
+  int numTiles;
+  double numBytes;
+};
+
+static Timing timeLoads(const TileLoadingPolicy &policy, const vector<std::pair<int, int>> &tiles) {
+  Timing timing;
+  timing.totalSeconds = 0;
+  timing.numTiles = 0;
+  timing.numBytes = 0;
+
+  for (auto &coords : tiles) {
+    auto start = std::chrono::steady_clock::now();
+    Tile *tile = policy.loadTile(coords.first, coords.second);
+    auto end = std::chrono::steady_clock::now();
+    if (tile != nullptr) {
+      timing.totalSeconds += std::chrono::duration<double>(end - start).count();
+      timing.numTiles += 1;
+      timing.numBytes += (double) tile->width() * tile->height() * sizeof(Elevation);
+      delete tile;
+    }
+  }
+
+  return timing;
+}
+
+static void printTiming(const string &method, const char *cacheState, const Timing &timing) {
+  if (timing.numTiles == 0) {
+    printf("%-12s %-5s  no tiles loaded\n", method.c_str(), cacheState);
+    return;
+  }
+  double msPerTile = 1000 * timing.totalSeconds / timing.numTiles;
+  double mbPerSecond = timing.numBytes / (1024 * 1024) / timing.totalSeconds;
+  printf("%-12s %-5s %6d tiles %10.2f ms/tile %10.1f MB/s of samples\n",
+         method.c_str(), cacheState, timing.numTiles, msPerTile, mbPerSecond);
+}
+
+int main(int argc, char **argv) {
+  string terrain_directory(".");
+  string pack_filename;
+  FileFormat fileFormat = FileFormat::HGT;
+  int numIterations = 3;
+  
+  // Parse options
+  START_EASYLOGGINGPP(argc, argv);
+  int ch;
+  string str;
+  while ((ch = getopt(argc, argv, "f:i:n:p:")) != -1) {
+    switch (ch) {
+    case 'f':
+      str = optarg;
+      if (str == "SRTM") {
+        fileFormat = FileFormat::HGT;
+      } else if (str == "NED1-ZIP") {
+        fileFormat = FileFormat::NED1_ZIP;
+      } else if (str == "NED13-ZIP") {
+        fileFormat = FileFormat::NED13_ZIP;
+      } else {
+        printf("Unknown file format %s\n", optarg);
+        usage();
+      }
+      break;
+
+    case 'i':
+      terrain_directory = optarg;
+      break;
+
+    case 'n':
+      numIterations = atoi(optarg);
+      break;
+
+    case 'p':
+      pack_filename = optarg;
+      break;
+    }
+  }
+
+  argc -= optind;
+  argv += optind;
+
+  if (argc < 4) {
+    usage();
+  }
+
+  float bounds[4];
+  for (int i = 0; i < 4; ++i) {
+    char *endptr;
+    bounds[i] = strtof(argv[i], &endptr);
+    if (*endptr != 0) {
+      printf("Couldn't parse argument %d as number: %s\n", i + 1, argv[i]);
+      usage();
+    }
+  }
+
+  vector<std::pair<int, int>> tiles;
+  for (int lat = (int) floor(bounds[0]); lat < (int) ceil(bounds[1]); ++lat) {
+    for (int lng = (int) floor(bounds[2]); lng < (int) ceil(bounds[3]); ++lng) {
+      tiles.push_back(std::make_pair(lat, lng));
+    }
+  }
+
+  vector<LoadingMethod> methods;
+  LoadingMethod method;
+  method.name = "read";
+  method.policy = new BasicTileLoadingPolicy(terrain_directory, fileFormat);
+  methods.push_back(method);
+
+  BasicTileLoadingPolicy *mappedPolicy = new BasicTileLoadingPolicy(terrain_directory, fileFormat);
+  mappedPolicy->enableMemoryMappedLoading(true);
+  method.name = "mmap";
+  method.policy = mappedPolicy;
+  methods.push_back(method);
+
+  TilePack pack;
+  if (!pack_filename.empty()) {
+    if (!pack.open(pack_filename)) {
+      printf("Couldn't open tile pack %s\n", pack_filename.c_str());
+      exit(1);
+    }
+    method.name = "pack";
+    method.policy = new TilePackLoadingPolicy(&pack);
+    methods.push_back(method);
+  }
+
+  bool canEvict = evictDirectoryFromPageCache(terrain_directory);
+  if (!canEvict) {
+    printf("Can't evict files from page cache; skipping cold cache measurements\n");
+  }
+
+  for (int iteration = 0; iteration < numIterations; ++iteration) {
+    printf("Pass %d\n", iteration + 1);
+    for (const LoadingMethod &m : methods) {
+      if (canEvict) {
+        evictDirectoryFromPageCache(terrain_directory);
+        if (!pack_filename.empty()) {
+          evictFileFromPageCache(pack_filename);
+        }
+        printTiming(m.name, "cold", timeLoads(*m.policy, tiles));
+      }
+
+      // Warm up the page cache, then measure
+      timeLoads(*m.policy, tiles);
+      printTiming(m.name, "warm", timeLoads(*m.policy, tiles));
+    }
+  }
+
+  for (LoadingMethod &m : methods) {
+    delete m.policy;
+  }
+
+  return 0;
+}
@@ -27,101 +27,369 @@
 #include "peakbagger_point.h"
 #include "easylogging++.h"
 
+#include <algorithm>
 #include <assert.h>
+#include <chrono>
 
 using std::string;
 
+TileHandle::TileHandle()
+    : mCache(nullptr),
+      mKey(0),
+      mTile(nullptr) {
+}
+
+TileHandle::TileHandle(TileCache *cache, int key, const Tile *tile)
+    : mCache(cache),
+      mKey(key),
+      mTile(tile) {
+}
+
+TileHandle::TileHandle(const TileHandle &other)
+    : mCache(other.mCache),
+      mKey(other.mKey),
+      mTile(other.mTile) {
+  if (mTile != nullptr) {
+    mCache->pin(mKey);
+  }
+}
+
+TileHandle::~TileHandle() {
+  release();
+}
+
+TileHandle &TileHandle::operator=(const TileHandle &other) {
+  if (other.mTile != nullptr) {
+    other.mCache->pin(other.mKey);
+  }
+  release();
+  mCache = other.mCache;
+  mKey = other.mKey;
+  mTile = other.mTile;
+  return *this;
+}
+
+void TileHandle::release() {
+  if (mTile != nullptr) {
+    mCache->unpin(mKey);
+  }
+  mCache = nullptr;
+  mTile = nullptr;
+}
+
 TileCache::TileCache(TileLoadingPolicy *policy, PointMap *externalPeaks, int maxEntries)
-    : mCache(maxEntries),
+    : mEvictionPolicy(new LruEvictionPolicy()),
+      mMaxEntries(maxEntries),
+      mMaxBytes(0),
+      mNumBytes(0),
+      mNumDuplicateLoadsAvoided(0),
       mLoadingPolicy(policy),
-      mExternalPeaks(externalPeaks) {
+      mExternalPeaks(externalPeaks),
+      mSummary(nullptr),
+      mNextPrefetch(0),
+      mMaxPrefetchBytes(0),
+      mReadyBytes(0),
+      mTileBytesEstimate(0),
+      mNumLoading(0),
+      mStopPrefetching(false) {
+  mPrefetchStats.numPrefetched = 0;
+  mPrefetchStats.numStalls = 0;
+  mPrefetchStats.stallSeconds = 0;
+  mPrefetchStats.loadSeconds = 0;
+  mPrefetchStats.throttleSeconds = 0;
+  mLoadLatency = mStats.loadLatency(policy->formatName());
 }
 
 TileCache::~TileCache() {
+  {
+    std::unique_lock<std::mutex> lock(mPrefetchMutex);
+    mStopPrefetching = true;
+  }
+  mPrefetchCondition.notify_all();
+  for (std::thread &thread : mPrefetchThreads) {
+    thread.join();
+  }
+
+  // Delete any prefetched tiles that were never used
+  for (auto &it : mPrefetchSlots) {
+    if (it.second.state == PrefetchSlot::READY) {
+      delete it.second.tile;
+    }
+  }
+
+  for (auto &it : mEntries) {
+    assert(it.second.pinCount == 0);
+    delete it.second.tile;
+  }
+  delete mEvictionPolicy;
+}
+
+void TileCache::setMaxBytes(size_t maxBytes) {
+  lockCache();
+  mMaxBytes = maxBytes;
+  evictIfNeeded();
+  mLock.unlock();
+}
+
+void TileCache::setEvictionPolicy(CacheEvictionPolicy *policy) {
+  lockCache();
+  assert(mEntries.empty());
+  delete mEvictionPolicy;
+  mEvictionPolicy = policy;
+  mLock.unlock();
 }
 
-Tile *TileCache::getOrLoad(int minLat, int minLng) {
+TileHandle TileCache::getOrLoad(int minLat, int minLng) {
   // In cache?
   int key = makeCacheKey(minLat, minLng);
-  Tile *tile = nullptr;
   
-  mLock.lock();
-  if (mCache.exists(key)) {
-    tile = mCache.get(key);
+  lockCache();
+  auto it = mEntries.find(key);
+  if (it != mEntries.end()) {
+    CacheEntry &entry = it->second;
+    entry.pinCount += 1;
+    mEvictionPolicy->onAccess(key);
+    mStats.addHit();
+    TileHandle handle(this, key, entry.tile);
+    mLock.unlock();
+    return handle;
   }
-  mLock.unlock();
 
-  if (tile != nullptr) {
-    return tile;
+  // Is another thread already loading it?  If so, share its result.
+  auto flightIt = mLoadsInFlight.find(key);
+  if (flightIt != mLoadsInFlight.end()) {
+    InFlightLoad *flight = flightIt->second;
+    flight->numWaiters += 1;
+    mStats.addSharedLoad();
+    while (!flight->done) {
+      mLoadDone.wait(mLock);
+    }
+    // The loading thread already pinned the tile for us
+    Tile *tile = flight->tile;
+    flight->numWaiters -= 1;
+    if (flight->numWaiters == 0) {
+      delete flight;
+    }
+    mLock.unlock();
+    // Handles pin and unpin with mLock, so only create them without it
+    return (tile == nullptr) ? TileHandle() : TileHandle(this, key, tile);
   }
 
-  // Not in cache; load it
-  tile = loadWithoutCaching(minLat, minLng);
+  InFlightLoad *flight = new InFlightLoad();
+  flight->done = false;
+  flight->tile = nullptr;
+  flight->numWaiters = 0;
+  mLoadsInFlight[key] = flight;
+  mLock.unlock();
+  mStats.addMiss();
+
+  // Not in cache; load it.  Prefetched tiles are left for loadWithoutCaching.
+  Tile *tile = loadInternal(minLat, minLng);
   
   // Add to cache
-  mLock.lock();
+  lockCache();
+  mLoadsInFlight.erase(key);
+  mNumDuplicateLoadsAvoided += flight->numWaiters;
+  flight->done = true;
+  flight->tile = tile;
+
   if (tile == nullptr) {
     // No terrain => max elevation 0
     mMaxElevations[key] = 0;
   } else {
-    mCache.put(key, tile);
-
     mMaxElevations[key] = tile->maxElevation();
+
+    assert(mEntries.find(key) == mEntries.end());
+    CacheEntry entry;
+    entry.tile = tile;
+    // Pin once for us and once for each thread waiting for this load
+    entry.pinCount = 1 + flight->numWaiters;
+    mEntries.insert(std::make_pair(key, entry));
+    mNumBytes += tile->sampleBytes();
+    mEvictionPolicy->onInsert(key);
+    evictIfNeeded();
+    mStats.setBytesResident(mNumBytes);
+  }
+
+  if (flight->numWaiters == 0) {
+    delete flight;
+  } else {
+    mLoadDone.notify_all();
   }
   mLock.unlock();
 
-  return tile;
+  return (tile == nullptr) ? TileHandle() : TileHandle(this, key, tile);
+}
+
+int TileCache::numDuplicateLoadsAvoided() {
+  lockCache();
+  int retval = mNumDuplicateLoadsAvoided;
+  mLock.unlock();
+  return retval;
 }
 
 Tile *TileCache::loadWithoutCaching(int minLat, int minLng) {
+  mStats.addUncachedLoad();
+  Tile *tile = nullptr;
+  bool scheduled = false;
+  if (takePrefetchedTile(makeCacheKey(minLat, minLng), &tile, &scheduled)) {
+    return tile;
+  }
+  if (!scheduled) {
+    return loadInternal(minLat, minLng);
+  }
+
+  // The prefetcher hasn't gotten to this tile yet, so load it ourselves
+  // rather than wait; this counts as a stall.
+  auto start = std::chrono::steady_clock::now();
+  tile = loadInternal(minLat, minLng);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::unique_lock<std::mutex> lock(mPrefetchMutex);
+  mPrefetchStats.numStalls += 1;
+  mPrefetchStats.stallSeconds += seconds;
+  return tile;
+}
+
+void TileCache::startPrefetching(const std::vector<std::pair<int, int>> &tiles, int numThreads,
+                                 size_t maxBytes) {
+  {
+    std::unique_lock<std::mutex> lock(mPrefetchMutex);
+    assert(mPrefetchThreads.empty());
+    mMaxPrefetchBytes = maxBytes;
+    for (auto &coords : tiles) {
+      int key = makeCacheKey(coords.first, coords.second);
+      // Only the first request for a tile gets the prefetched copy
+      if (mPrefetchSlots.find(key) == mPrefetchSlots.end()) {
+        PrefetchSlot slot;
+        slot.state = PrefetchSlot::PENDING;
+        slot.tile = nullptr;
+        slot.numBytes = 0;
+        mPrefetchSlots[key] = slot;
+        mPrefetchOrder.push_back(coords);
+      }
+    }
+  }
+
+  VLOG(2) << "Prefetching " << mPrefetchOrder.size() << " tiles with " << numThreads
+          << " threads, up to " << maxBytes << " bytes";
+  for (int i = 0; i < numThreads; ++i) {
+    mPrefetchThreads.push_back(std::thread(&TileCache::prefetchLoop, this));
+  }
+}
+
+TileCache::PrefetchStats TileCache::prefetchStats() {
+  std::unique_lock<std::mutex> lock(mPrefetchMutex);
+  return mPrefetchStats;
+}
+
+void TileCache::prefetchLoop() {
+  std::unique_lock<std::mutex> lock(mPrefetchMutex);
+  for (;;) {
+    // Wait until the tiles that are ready or loading leave room for
+    // another one.  Always allow one, so that we can't get stuck.
+    auto start = std::chrono::steady_clock::now();
+    bool throttled = false;
+    mPrefetchCondition.wait(lock, [this, &throttled] {
+        if (mStopPrefetching || mNextPrefetch >= mPrefetchOrder.size()) {
+          return true;
+        }
+        size_t pendingBytes = mReadyBytes + mNumLoading * mTileBytesEstimate;
+        if (pendingBytes == 0 || pendingBytes + mTileBytesEstimate <= mMaxPrefetchBytes) {
+          return true;
+        }
+        throttled = true;
+        return false;
+      });
+    if (throttled) {
+      mPrefetchStats.throttleSeconds += std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+    }
+    if (mStopPrefetching || mNextPrefetch >= mPrefetchOrder.size()) {
+      return;
+    }
+
+    std::pair<int, int> coords = mPrefetchOrder[mNextPrefetch++];
+    int key = makeCacheKey(coords.first, coords.second);
+    PrefetchSlot &slot = mPrefetchSlots[key];
+    if (slot.state != PrefetchSlot::PENDING) {
+      // Already asked for and loaded directly
+      continue;
+    }
+    slot.state = PrefetchSlot::LOADING;
+    mNumLoading += 1;
+    lock.unlock();
+
+    start = std::chrono::steady_clock::now();
+    Tile *tile = loadInternal(coords.first, coords.second);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    lock.lock();
+    size_t numBytes = 0;
+    if (tile != nullptr) {
+      numBytes = tile->sampleBytes();
+    }
+    mNumLoading -= 1;
+    mTileBytesEstimate = std::max(mTileBytesEstimate, numBytes);
+    mReadyBytes += numBytes;
+    mPrefetchStats.loadSeconds += seconds;
+
+    PrefetchSlot &loadedSlot = mPrefetchSlots[key];
+    loadedSlot.state = PrefetchSlot::READY;
+    loadedSlot.tile = tile;
+    loadedSlot.numBytes = numBytes;
+    mPrefetchCondition.notify_all();
+  }
+}
+
+bool TileCache::takePrefetchedTile(int key, Tile **tile, bool *scheduled) {
+  std::unique_lock<std::mutex> lock(mPrefetchMutex);
+  auto it = mPrefetchSlots.find(key);
+  if (it == mPrefetchSlots.end() || it->second.state == PrefetchSlot::CONSUMED) {
+    return false;
+  }
+
+  *scheduled = true;
+  if (it->second.state == PrefetchSlot::PENDING) {
+    // Make sure the prefetcher skips it
+    it->second.state = PrefetchSlot::CONSUMED;
+    return false;
+  }
+
+  if (it->second.state == PrefetchSlot::LOADING) {
+    auto start = std::chrono::steady_clock::now();
+    mPrefetchCondition.wait(lock, [it] { return it->second.state == PrefetchSlot::READY; });
+    mPrefetchStats.numStalls += 1;
+    mPrefetchStats.stallSeconds += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+  }
+
+  *tile = it->second.tile;
+  it->second.state = PrefetchSlot::CONSUMED;
+  it->second.tile = nullptr;
+  mReadyBytes -= it->second.numBytes;
+  mPrefetchStats.numPrefetched += 1;
+  mPrefetchCondition.notify_all();
+  return true;
+}
+
+Tile *TileCache::loadInternal(int minLat, int minLng) const {
+  auto start = std::chrono::steady_clock::now();
   Tile *tile = mLoadingPolicy->loadTile(minLat, minLng);
   if (tile == nullptr) {
+    mStats.addMissingTile();
     return nullptr;
   }
+  mLoadLatency->record(std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start).count());
 
   // Look for big spikes, and replace them with NODATA.  We want to do
   // this before applying external peaks, because external peaks may
   // look suspiciously like spikes, but actually be valid (because the
   // true peak height may stand out quite a bit from the terrain in
   // the tile).
-  static const Elevation MAX_LEGAL_ELEVATION_DIFF = 1000;
-  for (int y = 0; y < tile->height(); ++y) {
-    for (int x = 0; x < tile->width(); ++x) {
-      Elevation elev = tile->get(x, y);
-      if (elev != Tile::NODATA_ELEVATION) {
-        // Enough to check the 4-neighbors.  Kill the higher point.
-        if (tile->isInExtents(Offsets(x + 1, y))) {
-          Elevation neighborElev = tile->get(x + 1, y);
-          if (neighborElev != Tile::NODATA_ELEVATION && elev - neighborElev > MAX_LEGAL_ELEVATION_DIFF) {
-            tile->set(x, y, Tile::NODATA_ELEVATION);
-          }
-        }
-        if (tile->isInExtents(Offsets(x, y + 1))) {
-          Elevation neighborElev = tile->get(x, y + 1);
-          if (neighborElev != Tile::NODATA_ELEVATION && elev - neighborElev > MAX_LEGAL_ELEVATION_DIFF) {
-            tile->set(x, y, Tile::NODATA_ELEVATION);
-          }
-        }
-        if (tile->isInExtents(Offsets(x - 1, y))) {
-          Elevation neighborElev = tile->get(x - 1, y);
-          if (neighborElev != Tile::NODATA_ELEVATION && elev - neighborElev > MAX_LEGAL_ELEVATION_DIFF) {
-            tile->set(x, y, Tile::NODATA_ELEVATION);
-          }
-        }
-        if (tile->isInExtents(Offsets(x, y - 1))) {
-          Elevation neighborElev = tile->get(x, y - 1);
-          if (neighborElev != Tile::NODATA_ELEVATION && elev - neighborElev > MAX_LEGAL_ELEVATION_DIFF) {
-            tile->set(x, y, Tile::NODATA_ELEVATION);
-          }
-        }
-
-        // Print out spikes
-        if (tile->get(x, y) == Tile::NODATA_ELEVATION && VLOG_IS_ON(1)) {
-          LatLng latlng = tile->latlng(Offsets(x, y));
-          LOG(INFO) << "Removed possible spike at " << latlng.latitude() << ", " << latlng.longitude();
-        }
-      }
-    }
+  if (!mLoadingPolicy->removesSpikes()) {
+    tile->removeSpikes();
   }
   
   // Apply peak elevations, if any.  This forces us to use external (e.g. Peakbagger's)
@@ -169,7 +437,7 @@ bool TileCache::getMaxElevation(int lat, int lng, int *elev) {
   bool retval = true;
   int key = makeCacheKey(lat, lng);
 
-  mLock.lock();
+  lockCache();
   auto it = mMaxElevations.find(key);
   if (it == mMaxElevations.end()) {
     retval = false;
@@ -178,9 +446,122 @@ bool TileCache::getMaxElevation(int lat, int lng, int *elev) {
   }
   mLock.unlock();
 
+  if (!retval && mSummary != nullptr) {
+    const TileSummary::Entry *entry = mSummary->lookup(lat, lng);
+    if (entry != nullptr) {
+      retval = true;
+      // No terrain => max elevation 0, as in getOrLoad
+      *elev = entry->exists ? entry->maxElevation : 0;
+      int peakElevation;
+      if (entry->exists && getMaxExternalPeakElevation(lat, lng, &peakElevation)) {
+        *elev = std::max(*elev, peakElevation);
+      }
+    }
+  }
+
   return retval;
 }
 
+void TileCache::setSummary(const TileSummary *summary) {
+  mSummary = summary;
+}
+
+float TileCache::minDistanceToHigherGround(int lat, int lng, const LatLng &location,
+                                           Elevation elev) {
+  if (mSummary == nullptr) {
+    return 0;
+  }
+
+  // An external peak may raise part of the tile above what the summary says
+  int peakElevation;
+  if (getMaxExternalPeakElevation(lat, lng, &peakElevation) && peakElevation > elev) {
+    return 0;
+  }
+
+  return mSummary->minDistanceToHigherGround(lat, lng, location, elev);
+}
+
+bool TileCache::getMaxExternalPeakElevation(int minLat, int minLng, int *elev) const {
+  if (mExternalPeaks == nullptr) {
+    return false;
+  }
+
+  // Same neighborhood that loadInternal checks
+  bool found = false;
+  for (int deltaX = -1; deltaX <= 1; deltaX += 1) {
+    for (int deltaY = -1; deltaY <= 1; deltaY += 1) {
+      PointMap::Bucket *bucket = mExternalPeaks->lookup(minLat + deltaY, minLng + deltaX);
+      if (bucket != nullptr) {
+        for (auto it : *bucket) {
+          PeakbaggerPoint *pb_point = (PeakbaggerPoint *) it;
+          if (!found || pb_point->elevation() > *elev) {
+            *elev = pb_point->elevation();
+            found = true;
+          }
+        }
+      }
+    }
+  }
+  return found;
+}
+
+
+void TileCache::lockCache() {
+  if (mLock.tryLock()) {
+    return;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  mLock.lock();
+  mStats.addLockWait(std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start).count());
+}
+
+void TileCache::pin(int key) {
+  lockCache();
+  auto it = mEntries.find(key);
+  assert(it != mEntries.end());
+  it->second.pinCount += 1;
+  mLock.unlock();
+}
+
+void TileCache::unpin(int key) {
+  lockCache();
+  auto it = mEntries.find(key);
+  assert(it != mEntries.end() && it->second.pinCount > 0);
+  it->second.pinCount -= 1;
+  if (it->second.pinCount == 0) {
+    evictIfNeeded();
+  }
+  mLock.unlock();
+}
+
+void TileCache::evictIfNeeded() {
+  auto isUnpinned = [this](int key) { return mEntries[key].pinCount == 0; };
+  while (isOverLimit()) {
+    int key = mEvictionPolicy->chooseVictim(isUnpinned);
+    if (key == CacheEvictionPolicy::NO_VICTIM) {
+      // Everything is pinned; try again when something is unpinned
+      break;
+    }
+
+    VLOG(3) << "Evicting tile " << key;
+    auto it = mEntries.find(key);
+    mNumBytes -= it->second.tile->sampleBytes();
+    mStats.addEviction(it->second.tile->sampleBytes());
+    mStats.setBytesResident(mNumBytes);
+    delete it->second.tile;
+    mEntries.erase(it);
+    mEvictionPolicy->onRemove(key);
+  }
+}
+
+bool TileCache::isOverLimit() const {
+  if (mMaxBytes > 0) {
+    return mNumBytes > mMaxBytes;
+  }
+  return static_cast<int>(mEntries.size()) > mMaxEntries;
+}
 
 int TileCache::makeCacheKey(int minLat, int minLng) const {
   return minLat * 1000 + minLng;
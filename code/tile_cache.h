@@ -26,46 +26,214 @@
 #ifndef _TILE_CACHE_H_
 #define _TILE_CACHE_H_
 
+#include "cache_eviction_policy.h"
+#include "cache_stats.h"
 #include "lock.h"
-#include "lrucache.h"
 #include "point_map.h"
 #include "tile.h"
 #include "tile_loading_policy.h"
+#include "tile_summary.h"
 
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <utility>
+#include <vector>
+
+class TileCache;
+
+// A reference to a tile held by a TileCache.  While any handle to a
+// tile exists, the tile is pinned: the cache won't evict or delete it.
+// Handles may be copied; the tile is unpinned when the last copy is
+// released or destroyed.  All handles must be released before the
+// cache is destroyed.
+class TileHandle {
+public:
+  TileHandle();
+  TileHandle(const TileHandle &other);
+  ~TileHandle();
+
+  TileHandle &operator=(const TileHandle &other);
+
+  // nullptr if the handle is empty
+  const Tile *get() const { return mTile; }
+
+  // Unpin the tile and make the handle empty
+  void release();
+
+private:
+  friend class TileCache;
+
+  TileHandle(TileCache *cache, int key, const Tile *tile);
+
+  TileCache *mCache;
+  int mKey;
+  const Tile *mTile;
+};
 
 class TileCache {
 public:
   // policy determines how to load a tile.
   // externalPeaks is a set of peaks whose elevations are written into tiles as
   // they're loaded; they're "ground truth" elevations.  May be nullptr.
-  // maxEntries is the size of the cache.
+  // maxEntries is the size of the cache.  The cache may temporarily hold
+  // more tiles than that if they're pinned by handles.
   explicit TileCache(TileLoadingPolicy *policy, PointMap *externalPeaks, int maxEntries);
 
   ~TileCache();
 
-  // Retrieve the tile with the given minimum lat/lng, loading it from disk if necessary
-  Tile *getOrLoad(int minLat, int minLng);
+  // Limit the cache by the total size of the samples in cached tiles,
+  // rather than by the number of tiles.  0 means limit by maxEntries.
+  void setMaxBytes(size_t maxBytes);
+
+  // Use the given eviction policy instead of LRU.  Takes ownership of
+  // policy.  Must be called before the cache is used.
+  void setEvictionPolicy(CacheEvictionPolicy *policy);
 
-  // Load the tile from disk without caching it
+  // Retrieve the tile with the given minimum lat/lng, loading it from disk if
+  // necessary.  The returned handle is empty if there's no such tile.
+  // If another thread is already loading the tile, wait for it and share
+  // its copy rather than loading it again.
+  TileHandle getOrLoad(int minLat, int minLng);
+
+  // Number of times getOrLoad waited for another thread's load instead of
+  // loading a tile itself
+  int numDuplicateLoadsAvoided();
+
+  // Load the tile from disk without caching it.  If the tile was
+  // scheduled with startPrefetching, wait for the prefetched copy instead.
+  // The caller owns the returned tile.
   Tile *loadWithoutCaching(int minLat, int minLng);
 
-  // If we've ever loaded the tile with the given minimum lat/lng, set elev to its maximum
-  // elevation and return true, otherwise return false.
+  // Start loading the given tiles, in the given order, on numThreads
+  // background threads, so that they're ready by the time
+  // loadWithoutCaching asks for them.  Loading runs ahead only until
+  // prefetched tiles waiting to be used take up about maxBytes of
+  // memory.  Call at most once.
+  void startPrefetching(const std::vector<std::pair<int, int>> &tiles, int numThreads,
+                        size_t maxBytes);
+
+  struct PrefetchStats {
+    int numPrefetched;       // Tiles returned by loadWithoutCaching from the prefetcher
+    int numStalls;           // Scheduled tiles that weren't ready when asked for
+    double stallSeconds;     // Total time loadWithoutCaching waited for or loaded those
+    double loadSeconds;      // Total time prefetch threads spent loading
+    double throttleSeconds;  // Total time prefetch threads waited for memory to free up
+  };
+  PrefetchStats prefetchStats();
+
+  // Hit, miss, eviction, load latency, memory and lock contention counters.
+  // They may be read at any time, including while other threads use the cache.
+  CacheStats *stats() { return &mStats; }
+
+  // Consult the given summary for tiles that haven't been loaded yet.
+  // The caller keeps ownership of summary, which must outlive the cache.
+  void setSummary(const TileSummary *summary);
+
+  // If we've ever loaded the tile with the given minimum lat/lng, or it's in
+  // the summary, set elev to its maximum elevation and return true, otherwise
+  // return false.
   bool getMaxElevation(int lat, int lng, int *elev);
+
+  // Return a lower bound on the distance in meters from location to any
+  // point in the given tile higher than elev, without loading the tile.
+  // Returns 0 if nothing is known about the tile.
+  float minDistanceToHigherGround(int lat, int lng, const LatLng &location, Elevation elev);
   
 private:
+  friend class TileHandle;
+
+  struct CacheEntry {
+    Tile *tile;
+    int pinCount;  // Number of handles referring to tile
+  };
+
+  // A load by getOrLoad that other threads may be waiting for.  Deleted
+  // by the last thread to look at it.
+  struct InFlightLoad {
+    bool done;
+    Tile *tile;  // Result of the load, once done
+    int numWaiters;
+  };
 
   Lock mLock;
-  lru_cache<int, Tile *> mCache;
+  // Cached tiles by key, and the policy that picks which ones to evict.
+  // Protected by mLock.
+  std::unordered_map<int, CacheEntry> mEntries;
+  CacheEvictionPolicy *mEvictionPolicy;
+  int mMaxEntries;
+  size_t mMaxBytes;
+  size_t mNumBytes;  // Total size of samples in mEntries
+  // Loads in progress in getOrLoad, by key, protected by mLock.  Waiters
+  // are woken by mLoadDone.
+  std::unordered_map<int, InFlightLoad *> mLoadsInFlight;
+  std::condition_variable_any mLoadDone;
+  int mNumDuplicateLoadsAvoided;
   TileLoadingPolicy *mLoadingPolicy;
   // Map of encoded lat/lng to max elevation in that tile
   std::unordered_map<int, int> mMaxElevations;
   // External peak elevations, written into tiles as they're loaded
   PointMap *mExternalPeaks;
+  // Updated from const methods too, but only through atomics
+  mutable CacheStats mStats;
+  LatencyHistogram *mLoadLatency;  // Owned by mStats
+  // Summary of tiles that may not have been loaded; may be nullptr
+  const TileSummary *mSummary;
+
+  // State of one tile scheduled for prefetching
+  struct PrefetchSlot {
+    enum State { PENDING, LOADING, READY, CONSUMED };
+    State state;
+    Tile *tile;
+    size_t numBytes;
+  };
+
+  // Prefetching state, protected by mPrefetchMutex.  Uses a condition
+  // variable, so it can't use Lock.
+  std::mutex mPrefetchMutex;
+  std::condition_variable mPrefetchCondition;
+  std::vector<std::pair<int, int>> mPrefetchOrder;
+  std::unordered_map<int, PrefetchSlot> mPrefetchSlots;
+  size_t mNextPrefetch;       // Index into mPrefetchOrder of next tile to load
+  size_t mMaxPrefetchBytes;
+  size_t mReadyBytes;         // Memory used by READY tiles
+  size_t mTileBytesEstimate;  // Largest tile seen so far, for tiles still loading
+  int mNumLoading;
+  bool mStopPrefetching;
+  PrefetchStats mPrefetchStats;
+  std::vector<std::thread> mPrefetchThreads;
 
+  // Load a tile and apply our fixups to it
   Tile *loadInternal(int minLat, int minLng) const;
+
+  // Return the highest external peak that could be written into the
+  // given tile, or false if there isn't one.  The summary doesn't
+  // include external peaks.
+  bool getMaxExternalPeakElevation(int minLat, int minLng, int *elev) const;
+
+  // Acquire mLock, counting the time spent waiting for it
+  void lockCache();
+
+  // Called by TileHandle to add and remove pins
+  void pin(int key);
+  void unpin(int key);
+
+  // Delete unpinned tiles chosen by the eviction policy until the cache
+  // is within its size limit, or only pinned tiles are left.  mLock must
+  // be held.
+  void evictIfNeeded();
+
+  bool isOverLimit() const;
+
+  // Body of each prefetch thread
+  void prefetchLoop();
+
+  // If the given tile was prefetched or is being prefetched, wait for
+  // it, set tile, and return true.  Set scheduled to true if the tile was
+  // passed to startPrefetching and hasn't been taken yet.
+  bool takePrefetchedTile(int key, Tile **tile, bool *scheduled);
   
   int makeCacheKey(int minLat, int minLng) const;
 };
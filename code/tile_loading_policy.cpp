@@ -28,19 +28,44 @@
 
 using std::string;
 
+// Enough edges to cover a full row of tiles around the world, so that
+// the top edge of a tile is still cached by the time the tile below it
+// is loaded when working through an area row by row.
+static const int EDGE_CACHE_SIZE = 400;
+
 BasicTileLoadingPolicy::BasicTileLoadingPolicy(const string &directory, FileFormat format)
     : mDirectory(directory),
       mFileFormat(format),
-      mNeighborEdgeLoadingEnabled(false) {
+      mNeighborEdgeLoadingEnabled(false),
+      mMemoryMappedLoadingEnabled(false),
+      mEdgeCache(EDGE_CACHE_SIZE) {
 }
 
 void BasicTileLoadingPolicy::enableNeighborEdgeLoading(bool enabled) {
   mNeighborEdgeLoadingEnabled = enabled;
 }
 
+void BasicTileLoadingPolicy::enableMemoryMappedLoading(bool enabled) {
+  mMemoryMappedLoadingEnabled = enabled;
+}
+
 Tile *BasicTileLoadingPolicy::loadTile(int minLat, int minLng) const {
+  int key = makeCacheKey(minLat, minLng);
+  if (mNeighborEdgeLoadingEnabled) {
+    mEdgeLock.lock();
+    mTilesLoading.insert(key);
+    mEdgeLock.unlock();
+  }
+  
   Tile *tile = loadInternal(minLat, minLng);
   if (tile == nullptr) {
+    if (mNeighborEdgeLoadingEnabled) {
+      // Waiting neighbors will try to read our edges themselves
+      mEdgeLock.lock();
+      mTilesLoading.erase(key);
+      mEdgesCached.notify_all();
+      mEdgeLock.unlock();
+    }
     return nullptr;
   }
 
@@ -51,26 +76,33 @@ Tile *BasicTileLoadingPolicy::loadTile(int minLat, int minLng) const {
   // peaks or saddles detected on one side of the border, but not the
   // other.  We really need the overlap pixels to be identical.
   //
-  // Despite the major performance penalty, we force the pixels to be
-  // identical by loading our right and bottom neighbors and copying
-  // their leftmost column and topmost row.  Note that this still
-  // leaves ambiguity in our bottom right pixel.  That would be even
-  // more expensive to fix, so we leave it alone in the hopes that
-  // fixing it isn't necessary.
+  // We force the pixels to be identical by copying the topmost row of
+  // our bottom neighbor and the leftmost column of our right neighbor.
+  // Note that this still leaves ambiguity in our bottom right pixel.
+  // That would be more expensive to fix, so we leave it alone in the
+  // hopes that fixing it isn't necessary.
   //
+  // Our own edges are saved before they're modified, since our top and
+  // left neighbors will need them.
   if (mNeighborEdgeLoadingEnabled) {
-    Tile *neighbor = loadInternal(minLat - 1, minLng);  // bottom neighbor
-    if (neighbor != nullptr) {
-      for (int i = 0; i < tile->width(); ++i) {
-        tile->set(i, tile->height() - 1, neighbor->get(i, 0));
+    TileEdges edges;
+    tile->getEdges(&edges);
+    cacheEdges(minLat, minLng, edges);
+    
+    if (getEdges(minLat - 1, minLng, &edges)) {  // bottom neighbor
+      if (static_cast<int>(edges.topRow.size()) == tile->width()) {
+        for (int i = 0; i < tile->width(); ++i) {
+          tile->set(i, tile->height() - 1, edges.topRow[i]);
+        }
       }
     }
 
     int rightLng = (minLng == 179) ? -180 : (minLng + 1);  // antimeridian
-    neighbor = loadInternal(minLat, rightLng);  // right neighbor
-    if (neighbor != nullptr) {
-      for (int i = 0; i < tile->height(); ++i) {
-        tile->set(tile->width() - 1, i, neighbor->get(0, i));
+    if (getEdges(minLat, rightLng, &edges)) {  // right neighbor
+      if (static_cast<int>(edges.leftColumn.size()) == tile->height()) {
+        for (int i = 0; i < tile->height(); ++i) {
+          tile->set(tile->width() - 1, i, edges.leftColumn[i]);
+        }
       }
     }
   }
@@ -83,7 +115,11 @@ Tile *BasicTileLoadingPolicy::loadInternal(int minLat, int minLng) const {
 
   switch (mFileFormat) {
   case FileFormat::HGT:
-    tile = Tile::loadFromHgtFile(mDirectory, minLat, minLng);
+    if (mMemoryMappedLoadingEnabled) {
+      tile = Tile::loadFromMappedHgtFile(mDirectory, minLat, minLng);
+    } else {
+      tile = Tile::loadFromHgtFile(mDirectory, minLat, minLng);
+    }
     break;
 
   case FileFormat::NED13_ZIP:
@@ -101,3 +137,92 @@ Tile *BasicTileLoadingPolicy::loadInternal(int minLat, int minLng) const {
 
   return tile;
 }
+
+bool BasicTileLoadingPolicy::getEdges(int minLat, int minLng, TileEdges *edges) const {
+  int key = makeCacheKey(minLat, minLng);
+  bool cached = false;
+  
+  mEdgeLock.lock();
+  while (mTilesLoading.find(key) != mTilesLoading.end()) {
+    mEdgesCached.wait(mEdgeLock);
+  }
+  if (mEdgeCache.exists(key)) {
+    *edges = *mEdgeCache.get(key);
+    cached = true;
+  }
+  mEdgeLock.unlock();
+
+  if (!cached) {
+    if (!loadEdgesInternal(minLat, minLng, edges)) {
+      edges->topRow.clear();
+      edges->leftColumn.clear();
+    }
+    cacheEdges(minLat, minLng, *edges);
+  }
+
+  return !edges->topRow.empty();
+}
+
+bool BasicTileLoadingPolicy::loadEdgesInternal(int minLat, int minLng, TileEdges *edges) const {
+  switch (mFileFormat) {
+  case FileFormat::HGT:
+    return Tile::loadEdgesFromHgtFile(mDirectory, minLat, minLng, edges);
+
+  case FileFormat::NED13_ZIP:
+    return Tile::loadEdgesFromNED13ZipFile(mDirectory, minLat, minLng, edges);
+
+  case FileFormat::NED1_ZIP:
+    return Tile::loadEdgesFromNED1ZipFile(mDirectory, minLat, minLng, edges);
+
+  default:
+    LOG(ERROR) << "Unsupported tile file format";
+    return false;
+  }
+}
+
+void BasicTileLoadingPolicy::cacheEdges(int minLat, int minLng, const TileEdges &edges) const {
+  int key = makeCacheKey(minLat, minLng);
+  mEdgeLock.lock();
+  // lru_cache doesn't delete the old value when replacing a key
+  if (!mEdgeCache.exists(key)) {
+    mEdgeCache.put(key, new TileEdges(edges));
+  }
+  if (mTilesLoading.erase(key) > 0) {
+    mEdgesCached.notify_all();
+  }
+  mEdgeLock.unlock();
+}
+
+string BasicTileLoadingPolicy::formatName() const {
+  switch (mFileFormat) {
+  case FileFormat::HGT:
+    return "SRTM";
+  case FileFormat::FLT:
+    return "FLT";
+  case FileFormat::NED13_ZIP:
+    return "NED13-ZIP";
+  case FileFormat::NED1_ZIP:
+    return "NED1-ZIP";
+  }
+  return "unknown";
+}
+
+int BasicTileLoadingPolicy::makeCacheKey(int minLat, int minLng) const {
+  return minLat * 1000 + minLng;
+}
+
+TilePackLoadingPolicy::TilePackLoadingPolicy(const TilePack *pack)
+    : mPack(pack) {
+}
+
+Tile *TilePackLoadingPolicy::loadTile(int minLat, int minLng) const {
+  return mPack->loadTile(minLat, minLng);
+}
+
+bool TilePackLoadingPolicy::removesSpikes() const {
+  return (mPack->flags() & TilePack::SPIKES_REMOVED) != 0;
+}
+
+string TilePackLoadingPolicy::formatName() const {
+  return "PACK";
+}
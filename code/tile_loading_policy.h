@@ -26,15 +26,29 @@
 #ifndef _TILE_LOADING_POLICY_H_
 #define _TILE_LOADING_POLICY_H_
 
+#include "lock.h"
+#include "lrucache.h"
 #include "tile.h"
+#include "tile_pack.h"
 
+#include <condition_variable>
 #include <string>
+#include <unordered_set>
 
 // Responsible for loading a tile given lat/lng.
 
 class TileLoadingPolicy {
 public:
+  virtual ~TileLoadingPolicy() {}
+
   virtual Tile *loadTile(int minLat, int minLng) const = 0;
+
+  // Return true if loaded tiles already have spikes removed, so the
+  // cache needn't do it again.
+  virtual bool removesSpikes() const { return false; }
+
+  // Short name of the format tiles are loaded from, for statistics
+  virtual std::string formatName() const = 0;
 };
 
 
@@ -48,20 +62,71 @@ public:
   // Prominence calculations require that pixels along the edges of
   // tiles are exactly identical.  To enforce this, it turns out to be
   // necessary to physically copy the pixels from neighbors, which
-  // makes loading a tile much slower.
+  // makes loading a tile slower.  Only the neighbors' edges are read,
+  // and recently used edges are cached.
   //
   // This is disabled by default.
   void enableNeighborEdgeLoading(bool enabled);
 
+  // Memory-map source files rather than reading them into a temporary
+  // buffer.  Currently only affects HGT files.
+  //
+  // This is disabled by default.
+  void enableMemoryMappedLoading(bool enabled);
+
   virtual Tile *loadTile(int minLat, int minLng) const;
 
+  virtual std::string formatName() const;
+
 private:
   std::string mDirectory;  // Directory for loading tiles
   FileFormat mFileFormat;  
   bool mNeighborEdgeLoadingEnabled;
+  bool mMemoryMappedLoadingEnabled;
+
+  // Edges of recently seen tiles, for copying into their neighbors.
+  // Entries with no samples mark tiles that don't exist.
+  mutable Lock mEdgeLock;
+  mutable lru_cache<int, TileEdges *> mEdgeCache;
+  // Tiles being loaded in full, by key, protected by mEdgeLock.  Their
+  // edges are about to be cached, so neighbors wait on mEdgesCached
+  // rather than reading the edges from the file again.
+  mutable std::unordered_set<int> mTilesLoading;
+  mutable std::condition_variable_any mEdgesCached;
 
   // Load tile without modifications
   Tile *loadInternal(int minLat, int minLng) const;
+
+  // Set edges to the edges of the given tile, from the cache if possible.
+  // Return false if the tile doesn't exist.
+  bool getEdges(int minLat, int minLng, TileEdges *edges) const;
+
+  // Load the edges of the given tile without loading the tile
+  bool loadEdgesInternal(int minLat, int minLng, TileEdges *edges) const;
+
+  // Add a copy of edges to the cache, and wake anyone waiting for them
+  void cacheEdges(int minLat, int minLng, const TileEdges &edges) const;
+
+  int makeCacheKey(int minLat, int minLng) const;
+};
+
+
+// Tile loading policy that reads preprocessed tiles out of a tile pack.
+// Edge stitching and spike removal were done when the pack was built.
+
+class TilePackLoadingPolicy : public TileLoadingPolicy {
+public:
+  // The pack must already be open, and must outlive the policy.
+  explicit TilePackLoadingPolicy(const TilePack *pack);
+
+  virtual Tile *loadTile(int minLat, int minLng) const;
+
+  virtual bool removesSpikes() const;
+
+  virtual std::string formatName() const;
+
+private:
+  const TilePack *mPack;
 };
 
 #endif  // _TILE_LOADING_POLICY_H_
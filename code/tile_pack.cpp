@@ -0,0 +1,235 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tile_pack.h"
+#include "easylogging++.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+using std::string;
+using std::vector;
+
+const char TilePack::MAGIC[8] = { 'T', 'I', 'L', 'E', 'P', 'A', 'C', 'K' };
+
+TilePack::TilePack() {
+  mFlags = 0;
+}
+
+bool TilePack::open(const string &filename) {
+  mIndex.clear();
+  if (!mFile.open(filename)) {
+    LOG(ERROR) << "Couldn't open tile pack " << filename;
+    return false;
+  }
+
+  const uint8 *base = static_cast<const uint8 *>(mFile.data());
+  size_t size = mFile.size();
+  if (size < sizeof(Header)) {
+    LOG(ERROR) << "Tile pack " << filename << " is truncated";
+    return false;
+  }
+
+  const Header *header = reinterpret_cast<const Header *>(base);
+  if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0) {
+    LOG(ERROR) << filename << " is not a tile pack";
+    return false;
+  }
+  if (header->byteOrderMark != BYTE_ORDER_MARK) {
+    LOG(ERROR) << "Tile pack " << filename << " was written on a machine with different byte order";
+    return false;
+  }
+  if (header->version != VERSION) {
+    LOG(ERROR) << "Tile pack " << filename << " has unsupported version " << header->version;
+    return false;
+  }
+  if (header->indexOffset > size ||
+      (size - header->indexOffset) / sizeof(IndexEntry) < header->numTiles) {
+    LOG(ERROR) << "Tile pack " << filename << " has a bad index";
+    return false;
+  }
+
+  mFlags = header->flags;
+  const IndexEntry *entries = reinterpret_cast<const IndexEntry *>(base + header->indexOffset);
+  for (uint32 i = 0; i < header->numTiles; ++i) {
+    const IndexEntry *entry = &entries[i];
+    uint64 dataSize = sizeof(Elevation) * (uint64) entry->width * entry->height;
+    if (entry->width <= 0 || entry->height <= 0 ||
+        entry->dataOffset > size || size - entry->dataOffset < dataSize) {
+      LOG(ERROR) << "Tile pack " << filename << " has a bad entry for "
+                 << entry->minLat << " " << entry->minLng;
+      return false;
+    }
+    mIndex[key(entry->minLat, entry->minLng)] = entry;
+  }
+
+  VLOG(1) << "Opened tile pack " << filename << " with " << mIndex.size() << " tiles";
+  return true;
+}
+
+bool TilePack::hasTile(int minLat, int minLng) const {
+  return findEntry(minLat, minLng) != nullptr;
+}
+
+Elevation TilePack::maxElevation(int minLat, int minLng) const {
+  const IndexEntry *entry = findEntry(minLat, minLng);
+  if (entry == nullptr) {
+    return Tile::NODATA_ELEVATION;
+  }
+  return static_cast<Elevation>(entry->maxElevation);
+}
+
+Tile *TilePack::loadTile(int minLat, int minLng) const {
+  const IndexEntry *entry = findEntry(minLat, minLng);
+  if (entry == nullptr) {
+    VLOG(1) << "Input tile " << minLat << " " << minLng << " isn't in pack; skipping";
+    return nullptr;
+  }
+
+  // Only square 1-degree tiles are written
+  assert(entry->width == entry->height);
+
+  size_t dataSize = sizeof(Elevation) * entry->width * entry->height;
+  Elevation *samples = (Elevation *) malloc(dataSize);
+  memcpy(samples, static_cast<const uint8 *>(mFile.data()) + entry->dataOffset, dataSize);
+
+  return Tile::createOneDegreeTile(minLat, minLng, entry->width,
+                                   entry->arcsecondsPerSample, samples);
+}
+
+const TilePack::IndexEntry *TilePack::findEntry(int minLat, int minLng) const {
+  auto it = mIndex.find(key(minLat, minLng));
+  if (it == mIndex.end()) {
+    return nullptr;
+  }
+  return it->second;
+}
+
+int64 TilePack::key(int minLat, int minLng) {
+  return (static_cast<int64>(minLat) << 32) | static_cast<uint32>(minLng);
+}
+
+TilePackWriter::TilePackWriter() {
+  mFile = nullptr;
+  mFlags = 0;
+  mOffset = 0;
+}
+
+TilePackWriter::~TilePackWriter() {
+  if (mFile != nullptr) {
+    fclose(mFile);
+  }
+}
+
+bool TilePackWriter::open(const string &filename, uint32 flags) {
+  mFile = fopen(filename.c_str(), "wb");
+  if (mFile == nullptr) {
+    LOG(ERROR) << "Couldn't create tile pack " << filename;
+    return false;
+  }
+
+  mFlags = flags;
+  mOffset = 0;
+  mEntries.clear();
+
+  // Placeholder; filled in by close()
+  TilePack::Header header;
+  memset(&header, 0, sizeof(header));
+  return write(&header, sizeof(header));
+}
+
+bool TilePackWriter::addTile(int minLat, int minLng, const Tile &tile) {
+  if (!padToAlignment()) {
+    return false;
+  }
+
+  TilePack::IndexEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.minLat = minLat;
+  entry.minLng = minLng;
+  entry.width = tile.width();
+  entry.height = tile.height();
+  entry.arcsecondsPerSample = tile.arcsecondsPerSample();
+  entry.maxElevation = tile.maxElevation();
+  entry.dataOffset = mOffset;
+
+  vector<Elevation> row(tile.width());
+  for (int y = 0; y < tile.height(); ++y) {
+    for (int x = 0; x < tile.width(); ++x) {
+      row[x] = tile.get(x, y);
+    }
+    if (!write(&row[0], sizeof(Elevation) * row.size())) {
+      return false;
+    }
+  }
+
+  mEntries.push_back(entry);
+  return true;
+}
+
+bool TilePackWriter::close() {
+  if (!padToAlignment()) {
+    return false;
+  }
+
+  TilePack::Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TilePack::MAGIC, sizeof(header.magic));
+  header.byteOrderMark = TilePack::BYTE_ORDER_MARK;
+  header.version = TilePack::VERSION;
+  header.flags = mFlags;
+  header.numTiles = static_cast<uint32>(mEntries.size());
+  header.indexOffset = mOffset;
+
+  if (!mEntries.empty() &&
+      !write(&mEntries[0], sizeof(TilePack::IndexEntry) * mEntries.size())) {
+    return false;
+  }
+
+  if (fseek(mFile, 0, SEEK_SET) != 0 ||
+      fwrite(&header, sizeof(header), 1, mFile) != 1) {
+    LOG(ERROR) << "Couldn't write tile pack header";
+    return false;
+  }
+
+  bool success = fclose(mFile) == 0;
+  mFile = nullptr;
+  return success;
+}
+
+bool TilePackWriter::write(const void *data, size_t size) {
+  if (fwrite(data, 1, size, mFile) != size) {
+    LOG(ERROR) << "Couldn't write to tile pack";
+    return false;
+  }
+  mOffset += size;
+  return true;
+}
+
+bool TilePackWriter::padToAlignment() {
+  static const char zeros[TilePack::ALIGNMENT] = { 0 };
+  size_t padding = (TilePack::ALIGNMENT - mOffset % TilePack::ALIGNMENT) % TilePack::ALIGNMENT;
+  return write(zeros, padding);
+}
@@ -0,0 +1,149 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * A tile pack holds many 1-degree tiles in a single file, already
+ * preprocessed for prominence and isolation runs: samples are int16
+ * feet, spikes have been removed, and (optionally) tile edges have
+ * been stitched to their neighbors.  See make_tile_pack.cpp.
+ *
+ * File layout, all integers in native byte order:
+ *
+ *   Header
+ *   Tile samples, one block per tile, each starting on a page boundary
+ *   Index, one IndexEntry per tile
+ *
+ * The whole pack is memory-mapped once; loading a tile is a lookup in
+ * the index plus a copy of its samples.
+ */
+
+#ifndef _TILE_PACK_H_
+#define _TILE_PACK_H_
+
+#include "mapped_file.h"
+#include "primitives.h"
+#include "tile.h"
+
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class TilePack {
+public:
+  // Flags describing how tiles in the pack were preprocessed
+  enum Flags {
+    EDGES_STITCHED = 1 << 0,
+    SPIKES_REMOVED = 1 << 1,
+  };
+
+  struct Header {
+    char magic[8];
+    uint32 byteOrderMark;
+    uint32 version;
+    uint32 flags;
+    uint32 numTiles;
+    uint64 indexOffset;  // Offset of first IndexEntry from start of file
+  };
+
+  struct IndexEntry {
+    int32 minLat;
+    int32 minLng;
+    int32 width;
+    int32 height;
+    float arcsecondsPerSample;
+    int32 maxElevation;
+    uint64 dataOffset;  // Offset of first sample from start of file
+  };
+
+  TilePack();
+
+  // Map the given pack file and read its index.  Returns false if the file
+  // can't be opened or isn't a valid pack.
+  bool open(const std::string &filename);
+
+  uint32 flags() const { return mFlags; }
+  int numTiles() const { return static_cast<int>(mIndex.size()); }
+
+  // Return true if the pack contains a tile with the given SW corner.
+  bool hasTile(int minLat, int minLng) const;
+
+  // Return the max elevation of the given tile, recorded when the pack
+  // was written, or Tile::NODATA_ELEVATION if the tile isn't present.
+  Elevation maxElevation(int minLat, int minLng) const;
+
+  // Return a new tile with the given SW corner, or nullptr if the pack
+  // doesn't contain it.  Safe to call from multiple threads.
+  Tile *loadTile(int minLat, int minLng) const;
+
+  static const char MAGIC[8];
+  static const uint32 BYTE_ORDER_MARK = 0x01020304;
+  static const uint32 VERSION = 1;
+  static const int ALIGNMENT = 4096;
+
+private:
+  MappedFile mFile;
+  uint32 mFlags;
+  std::unordered_map<int64, const IndexEntry *> mIndex;
+
+  const IndexEntry *findEntry(int minLat, int minLng) const;
+
+  static int64 key(int minLat, int minLng);
+
+  // Not copyable
+  TilePack(const TilePack &);
+  void operator=(const TilePack &);
+};
+
+// Writes tiles to a new pack file.
+
+class TilePackWriter {
+public:
+  TilePackWriter();
+  ~TilePackWriter();
+
+  // Create the given file and write a placeholder header.
+  bool open(const std::string &filename, uint32 flags);
+
+  // Append the samples of the given 1-degree tile.
+  bool addTile(int minLat, int minLng, const Tile &tile);
+
+  // Write the index, fill in the header and close the file.
+  bool close();
+
+private:
+  FILE *mFile;
+  uint32 mFlags;
+  uint64 mOffset;  // Current write position
+  std::vector<TilePack::IndexEntry> mEntries;
+
+  bool write(const void *data, size_t size);
+  bool padToAlignment();
+
+  // Not copyable
+  TilePackWriter(const TilePackWriter &);
+  void operator=(const TilePackWriter &);
+};
+
+#endif  // _TILE_PACK_H_
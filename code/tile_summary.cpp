@@ -0,0 +1,252 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tile_summary.h"
+#include "math_util.h"
+#include "easylogging++.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+
+using std::string;
+
+const float TileSummary::NO_HIGHER_GROUND = 1e30f;
+
+static const char SUMMARY_MAGIC[4] = { 'T', 'S', 'U', 'M' };
+static const int32 SUMMARY_VERSION = 1;
+
+// Fields of an entry as stored in the file; all 16 bits, so there's no padding
+struct FileRecord {
+  int32 minLat;
+  int32 minLng;
+  int16 exists;
+  int16 width;
+  int16 height;
+  int16 maxElevation;
+  Elevation grid[TileSummary::GRID_SIZE][TileSummary::GRID_SIZE];
+};
+
+void TileSummary::setTile(int minLat, int minLng, const Tile *tile) {
+  Entry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.exists = (tile != nullptr);
+  if (tile != nullptr) {
+    entry.width = static_cast<int16>(tile->width());
+    entry.height = static_cast<int16>(tile->height());
+    // Like Tile::maxElevation, no-data values count as 0
+    for (int row = 0; row < GRID_SIZE; ++row) {
+      for (int col = 0; col < GRID_SIZE; ++col) {
+        entry.grid[row][col] = 0;
+      }
+    }
+    for (int y = 0; y < tile->height(); ++y) {
+      int row = y * GRID_SIZE / tile->height();
+      for (int x = 0; x < tile->width(); ++x) {
+        int col = x * GRID_SIZE / tile->width();
+        entry.grid[row][col] = std::max(entry.grid[row][col], tile->get(x, y));
+      }
+    }
+    for (int row = 0; row < GRID_SIZE; ++row) {
+      for (int col = 0; col < GRID_SIZE; ++col) {
+        entry.maxElevation = std::max(entry.maxElevation, entry.grid[row][col]);
+      }
+    }
+  }
+
+  mEntries[makeKey(minLat, minLng)] = entry;
+}
+
+const TileSummary::Entry *TileSummary::lookup(int minLat, int minLng) const {
+  auto it = mEntries.find(makeKey(minLat, minLng));
+  if (it == mEntries.end()) {
+    return nullptr;
+  }
+  return &it->second;
+}
+
+// Return the smallest distance in degrees from value to [low, high],
+// going around the circle if that's shorter.
+static double longitudeGap(double value, double low, double high) {
+  double gap = 180;
+  for (int shift = -360; shift <= 360; shift += 360) {
+    double shifted = value + shift;
+    if (shifted < low) {
+      gap = std::min(gap, low - shifted);
+    } else if (shifted > high) {
+      gap = std::min(gap, shifted - high);
+    } else {
+      return 0;
+    }
+  }
+  return gap;
+}
+
+// Return a lower bound on the great circle distance in meters from location
+// to any point in the given box, using the same spherical earth as
+// LatLng::distance.  Each term of the haversine formula is bounded
+// separately: the latitude and longitude gaps can't be smaller than the gaps
+// to the box, and cos(latitude) inside the box is smallest at one of its
+// edges.
+static double minDistanceToBox(const LatLng &location, double minLat, double maxLat,
+                               double minLng, double maxLng) {
+  double lat = location.latitude();
+  double latGap = 0;
+  if (lat < minLat) {
+    latGap = minLat - lat;
+  } else if (lat > maxLat) {
+    latGap = lat - maxLat;
+  }
+  double lngGap = longitudeGap(location.longitude(), minLng, maxLng);
+  double minCos = std::min(cos(degToRad(minLat)), cos(degToRad(maxLat)));
+
+  double latTerm = sin(degToRad(latGap) / 2);
+  double lngTerm = sin(degToRad(lngGap) / 2);
+  double a = latTerm * latTerm + cos(degToRad(lat)) * minCos * lngTerm * lngTerm;
+  a = std::min(1.0, std::max(0.0, a));
+  const double earthRadius = 6371000;
+  return 2 * asin(sqrt(a)) * earthRadius;
+}
+
+float TileSummary::minDistanceToHigherGround(int minLat, int minLng, const LatLng &location,
+                                             Elevation elevation) const {
+  const Entry *entry = lookup(minLat, minLng);
+  if (entry == nullptr) {
+    return 0;
+  }
+  if (!entry->exists || entry->maxElevation <= elevation) {
+    return NO_HIGHER_GROUND;
+  }
+
+  double minDistance = NO_HIGHER_GROUND;
+  double maxLat = minLat + 1;
+  for (int row = 0; row < GRID_SIZE; ++row) {
+    // Samples in this row of cells; see setTile
+    int firstY = (row * entry->height + GRID_SIZE - 1) / GRID_SIZE;
+    int lastY = ((row + 1) * entry->height + GRID_SIZE - 1) / GRID_SIZE - 1;
+    for (int col = 0; col < GRID_SIZE; ++col) {
+      if (entry->grid[row][col] <= elevation) {
+        continue;
+      }
+      int firstX = (col * entry->width + GRID_SIZE - 1) / GRID_SIZE;
+      int lastX = ((col + 1) * entry->width + GRID_SIZE - 1) / GRID_SIZE - 1;
+      double distance = minDistanceToBox(location,
+                                         maxLat - (double) lastY / (entry->height - 1),
+                                         maxLat - (double) firstY / (entry->height - 1),
+                                         minLng + (double) firstX / (entry->width - 1),
+                                         minLng + (double) lastX / (entry->width - 1));
+      minDistance = std::min(minDistance, distance);
+    }
+  }
+
+  // LatLng::distance uses floats; leave room for its rounding
+  return static_cast<float>(minDistance * 0.999 - 1);
+}
+
+bool TileSummary::readFromFile(const string &filename) {
+  FILE *infile = fopen(filename.c_str(), "rb");
+  if (infile == nullptr) {
+    LOG(ERROR) << "Couldn't open tile summary " << filename;
+    return false;
+  }
+
+  char magic[4];
+  int32 version = 0;
+  int32 numRecords = 0;
+  if (fread(magic, sizeof(magic), 1, infile) != 1 ||
+      memcmp(magic, SUMMARY_MAGIC, sizeof(magic)) != 0 ||
+      fread(&version, sizeof(version), 1, infile) != 1 ||
+      version != SUMMARY_VERSION ||
+      fread(&numRecords, sizeof(numRecords), 1, infile) != 1) {
+    LOG(ERROR) << filename << " is not a valid tile summary";
+    fclose(infile);
+    return false;
+  }
+
+  mEntries.clear();
+  for (int i = 0; i < numRecords; ++i) {
+    FileRecord record;
+    if (fread(&record, sizeof(record), 1, infile) != 1) {
+      LOG(ERROR) << "Tile summary " << filename << " is truncated";
+      fclose(infile);
+      return false;
+    }
+
+    Entry entry;
+    entry.exists = record.exists != 0;
+    entry.width = record.width;
+    entry.height = record.height;
+    entry.maxElevation = record.maxElevation;
+    memcpy(entry.grid, record.grid, sizeof(entry.grid));
+    mEntries[makeKey(record.minLat, record.minLng)] = entry;
+  }
+
+  fclose(infile);
+  VLOG(1) << "Read summary of " << numRecords << " tiles from " << filename;
+  return true;
+}
+
+bool TileSummary::writeToFile(const string &filename) const {
+  FILE *outfile = fopen(filename.c_str(), "wb");
+  if (outfile == nullptr) {
+    LOG(ERROR) << "Couldn't create tile summary " << filename;
+    return false;
+  }
+
+  int32 numRecords = static_cast<int32>(mEntries.size());
+  bool success =
+      fwrite(SUMMARY_MAGIC, sizeof(SUMMARY_MAGIC), 1, outfile) == 1 &&
+      fwrite(&SUMMARY_VERSION, sizeof(SUMMARY_VERSION), 1, outfile) == 1 &&
+      fwrite(&numRecords, sizeof(numRecords), 1, outfile) == 1;
+
+  for (auto &it : mEntries) {
+    if (!success) {
+      break;
+    }
+    FileRecord record;
+    memset(&record, 0, sizeof(record));
+    // Inverse of makeKey
+    record.minLat = (it.first >> 16) - 90;
+    record.minLng = (it.first & 0xffff) - 180;
+    record.exists = it.second.exists ? 1 : 0;
+    record.width = it.second.width;
+    record.height = it.second.height;
+    record.maxElevation = it.second.maxElevation;
+    memcpy(record.grid, it.second.grid, sizeof(record.grid));
+    success = fwrite(&record, sizeof(record), 1, outfile) == 1;
+  }
+
+  if (fclose(outfile) != 0) {
+    success = false;
+  }
+  if (!success) {
+    LOG(ERROR) << "Couldn't write tile summary " << filename;
+  }
+  return success;
+}
+
+int TileSummary::makeKey(int minLat, int minLng) {
+  return ((minLat + 90) << 16) | (minLng + 180);
+}
@@ -0,0 +1,84 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _TILE_SUMMARY_H_
+#define _TILE_SUMMARY_H_
+
+#include "latlng.h"
+#include "primitives.h"
+#include "tile.h"
+
+#include <string>
+#include <unordered_map>
+
+// A summary of 1x1 degree tiles, for deciding whether a tile is worth
+// loading without opening its file.  For each tile the summary records
+// whether it exists, its max elevation, and the max elevation of each
+// cell of a coarse grid over the tile.  Tiles that aren't in the
+// summary at all are unknown.
+//
+// Summaries are built by make_tile_summary, and saved in a binary file
+// in native byte order.
+
+class TileSummary {
+public:
+  static const int GRID_SIZE = 16;
+
+  struct Entry {
+    bool exists;
+    int16 width;   // Tile size in samples
+    int16 height;
+    Elevation maxElevation;
+    // Max elevation of each cell, by [row][column].  Rows run north to south.
+    Elevation grid[GRID_SIZE][GRID_SIZE];
+  };
+
+  // Returned by minDistanceToHigherGround when there's no higher ground
+  static const float NO_HIGHER_GROUND;
+
+  // Record the given processed tile, or that there's no tile (if tile is nullptr).
+  void setTile(int minLat, int minLng, const Tile *tile);
+
+  // Return the entry for the given tile, or nullptr if it's unknown.
+  const Entry *lookup(int minLat, int minLng) const;
+
+  // Return a lower bound on the distance in meters from location to any
+  // sample in the given tile that's higher than elevation, using the grid.
+  // Returns NO_HIGHER_GROUND if there's no such sample, and 0 if the tile
+  // is unknown.
+  float minDistanceToHigherGround(int minLat, int minLng, const LatLng &location,
+                                  Elevation elevation) const;
+
+  int numTiles() const { return static_cast<int>(mEntries.size()); }
+
+  bool readFromFile(const std::string &filename);
+  bool writeToFile(const std::string &filename) const;
+
+private:
+  std::unordered_map<int, Entry> mEntries;
+
+  static int makeKey(int minLat, int minLng);
+};
+
+#endif  // _TILE_SUMMARY_H_
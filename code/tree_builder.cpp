@@ -25,12 +25,16 @@
 #include "tree_builder.h"
 #include "divide_tree.h"
 #include "easylogging++.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
 #include <math.h>
 #include <memory.h>
+#include <memory>
 #include <stdlib.h>
 #include <stack>
 #include <string>
+#include <thread>
 
 using std::stack;
 using std::string;
@@ -59,8 +63,62 @@ using std::vector;
 // edges to the divide tree by walking uphill from each runoff.
 
 TreeBuilder::TreeBuilder(const Tile *tile) :
-    mDomainMap(tile) {
+    mDomainMap(tile),
+    mBoundaryPoints(tile->width(), tile->height()),
+    mWalker(tile->width(), tile->height()),
+    mCoordinateSystem(tile->minLatitude(), tile->minLongitude(),
+                      tile->height() - 1,  // Remove overlap with neighbors
+                      tile->width() - 1),
+    mRowOffset(0),
+    mTileHeight(tile->height()),
+    mTileRunoffs(nullptr) {
   mTile = tile;
+  mRunsInUse = nullptr;
+  mNumWalkThreads = 1;
+}
+
+TreeBuilder::TreeBuilder(const Tile *band, const CoordinateSystem &coordinateSystem,
+                         int rowOffset, int tileHeight, const vector<Runoff> *tileRunoffs) :
+    mDomainMap(band),
+    mBoundaryPoints(band->width(), band->height()),
+    mWalker(band->width(), band->height()),
+    mCoordinateSystem(coordinateSystem),
+    mRowOffset(rowOffset),
+    mTileHeight(tileHeight),
+    mTileRunoffs(tileRunoffs) {
+  mTile = band;
+  mRunsInUse = nullptr;
+  mNumWalkThreads = 1;
+}
+
+TreeBuilder::~TreeBuilder() {
+  for (Walker *walker : mExtraWalkers) {
+    delete walker;
+  }
+}
+
+void TreeBuilder::reset(const Tile *tile) {
+  mTile = tile;
+  mDomainMap.reset(tile);
+  // mBoundaryPoints is already clear
+  mPeaks.clear();
+  mSaddles.clear();
+  mRunoffs.clear();
+  mSaddleInfo.clear();
+  mCoordinateSystem = CoordinateSystem(tile->minLatitude(), tile->minLongitude(),
+                                       tile->height() - 1, tile->width() - 1);
+  mRowOffset = 0;
+  mTileHeight = tile->height();
+  mTileRunoffs = nullptr;
+}
+
+bool TreeBuilder::fitsTile(const Tile *tile) const {
+  // mTile may have been deleted since the last build
+  return tile->width() == mDomainMap.width() && tile->height() == mDomainMap.height();
+}
+
+void TreeBuilder::setNumWalkThreads(int numThreads) {
+  mNumWalkThreads = std::max(numThreads, 1);
 }
 
 DivideTree *TreeBuilder::buildDivideTree() {
@@ -71,11 +129,189 @@ DivideTree *TreeBuilder::buildDivideTree() {
   return generateDivideTree();
 }
 
+DivideTree *TreeBuilder::buildDivideTreeInBands(const Tile *tile, int numBands,
+                                                size_t *memoryBytes) {
+  // Each band covers (height - 1) / numBands rows plus the row it shares
+  // with the next band
+  int numRows = tile->height() - 1;
+  numBands = std::min(numBands, numRows / MIN_BAND_HEIGHT);
+  if (numBands <= 1) {
+    TreeBuilder builder(tile);
+    DivideTree *tree = builder.buildDivideTree();
+    if (memoryBytes != nullptr) {
+      *memoryBytes = builder.memoryBytes();
+    }
+    return tree;
+  }
+
+  // A band's own walk around its border would find different runoffs
+  // along the tile's edges than a walk around the whole tile
+  vector<Runoff> tileRunoffs;
+  findTileRunoffs(tile, &tileRunoffs);
+  
+  CoordinateSystem coordinateSystem(tile->minLatitude(), tile->minLongitude(),
+                                    tile->height() - 1,  // Remove overlap with neighbors
+                                    tile->width() - 1);
+  VLOG(1) << "Building divide tree in " << numBands << " bands";
+  vector<DivideTree *> trees(numBands, nullptr);
+  vector<size_t> bandBytes(numBands, 0);
+  vector<std::thread> threads;
+  for (int i = 0; i < numBands; ++i) {
+    int minY = i * numRows / numBands;
+    int maxY = (i + 1) * numRows / numBands;
+    threads.push_back(std::thread([=, &trees, &bandBytes, &tileRunoffs, &coordinateSystem] {
+          std::unique_ptr<Tile> band(tile->createBand(minY, maxY));
+          TreeBuilder builder(band.get(), coordinateSystem, minY, tile->height(), &tileRunoffs);
+          trees[i] = builder.buildDivideTree();
+          bandBytes[i] = band->sampleBytes() + builder.memoryBytes();
+        }));
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  if (memoryBytes != nullptr) {
+    *memoryBytes = 0;
+    for (size_t bytes : bandBytes) {
+      *memoryBytes += bytes;
+    }
+  }
+
+  // Splice the seams.  buildDivideTree places a peak at the first point
+  // of its flat area in row order, even if the area crosses a seam.
+  DivideTree *tree = trees[0];
+  for (int i = 1; i < numBands; ++i) {
+    tree->merge(*trees[i], true);
+    delete trees[i];
+  }
+  tree->sortPeaks();
+  tree->compact();
+  
+  return tree;
+}
+
+void TreeBuilder::classifyRow(int y) {
+  int width = mTile->width();
+  mRowClasses.resize(width);
+  mRowHigherNeighbors.resize(width);
+  mRowEqualNeighbors.resize(width);
+
+  FlatRuns::RowCursor runs(mRunsInUse, y, 1);
+  int x = 1;
+  while (x < width - 1) {
+    const FlatRuns::Run *run = runs.next(x);
+    if (run == nullptr) {
+      classifyPoints(y, x, width - 1);
+      break;
+    }
+
+    // The first point of a run has an equal neighbor
+    classifyPoints(y, x, std::min(std::max((int) run->xmin, x), width - 1));
+    if (run->xmin >= x && run->xmin < width - 1) {
+      mRowClasses[run->xmin] = FLAT_AREA_POINT;
+    }
+    x = run->xmax + 1;
+  }
+}
+
+void TreeBuilder::classifyPoints(int y, int minX, int maxX) {
+  // Compare each point to its neighbors.  Written without branches, so
+  // that the compiler can vectorize it.
+  const Elevation *above = mTile->row(y - 1);
+  const Elevation *row = mTile->row(y);
+  const Elevation *below = mTile->row(y + 1);
+  uint8 *higher = mRowHigherNeighbors.data();
+  uint8 *equal = mRowEqualNeighbors.data();
+  for (int x = minX; x < maxX; ++x) {
+    Elevation elev = row[x];
+    higher[x] = (uint8) ((above[x - 1] > elev) | ((above[x] > elev) << 1) |
+                         ((above[x + 1] > elev) << 2) | ((row[x - 1] > elev) << 3) |
+                         ((row[x + 1] > elev) << 4) | ((below[x - 1] > elev) << 5) |
+                         ((below[x] > elev) << 6) | ((below[x + 1] > elev) << 7));
+    equal[x] = (uint8) ((above[x - 1] == elev) | (above[x] == elev) | (above[x + 1] == elev) |
+                        (row[x - 1] == elev) | (row[x + 1] == elev) |
+                        (below[x - 1] == elev) | (below[x] == elev) | (below[x + 1] == elev));
+  }
+
+  for (int x = minX; x < maxX; ++x) {
+    mRowClasses[x] = equal[x] ? FLAT_AREA_POINT : classifyHigherNeighbors(higher[x]);
+  }
+}
+
+uint8 TreeBuilder::classifyHigherNeighbors(uint8 higherNeighbors) {
+  // Neighbors in the order of the bits set by classifyRow
+  static const int DX[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+  static const int DY[8] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+
+  // A point that's alone in its flat area is a saddle candidate if its
+  // higher neighbors form more than one 8-connected segment, which is
+  // what findExtrema looks for in the boundary of a flat area.
+  struct ClassTable {
+    uint8 classes[256];
+    ClassTable() {
+      for (int mask = 0; mask < 256; ++mask) {
+        int numSegments = 0;
+        int visited = 0;
+        for (int start = 0; start < 8; ++start) {
+          if (!(mask & (1 << start)) || (visited & (1 << start))) {
+            continue;
+          }
+          numSegments += 1;
+          int pending = 1 << start;
+          while (pending != 0) {
+            int i = 0;
+            while (!(pending & (1 << i))) {
+              i += 1;
+            }
+            pending &= ~(1 << i);
+            visited |= 1 << i;
+            for (int j = 0; j < 8; ++j) {
+              if ((mask & (1 << j)) && !(visited & (1 << j)) &&
+                  abs(DX[i] - DX[j]) <= 1 && abs(DY[i] - DY[j]) <= 1) {
+                pending |= 1 << j;
+              }
+            }
+          }
+        }
+        if (numSegments == 0) {
+          classes[mask] = PEAK_POINT;
+        } else if (numSegments == 1) {
+          classes[mask] = SLOPE_POINT;
+        } else {
+          classes[mask] = FLAT_AREA_POINT;
+        }
+      }
+    }
+  };
+
+  static const ClassTable table;
+  return table.classes[higherNeighbors];
+}
+
 void TreeBuilder::findExtrema() {
-  DomainMap::Boundary boundary;
+  // Lakes, ocean and missing data make long runs of equal samples
+  mRunsInUse = mFlatRuns.build(mTile) ? &mFlatRuns : nullptr;
+  mDomainMap.setFlatRuns(mRunsInUse);
+  
   vector<Offsets> segmentHighPoints;
-  for (int y = 0; y < mTile->height(); ++y) {
-    for (int x = 0; x < mTile->width(); ++x) {
+  DomainMap::Boundary &boundary = mWalker.boundary;
+  int width = mTile->width();
+  int height = mTile->height();
+  for (int y = 0; y < height; ++y) {
+    bool interiorRow = y > 0 && y < height - 1;
+    if (interiorRow) {
+      classifyRow(y);
+    }
+    
+    FlatRuns::RowCursor runs(mRunsInUse, y, 0);
+    for (int x = 0; x < width; ++x) {
+      // Every point of a run is in the same flat area, so once its
+      // first point is done, so are the rest
+      const FlatRuns::Run *run = runs.find(x);
+      if (run != nullptr && x > run->xmin) {
+        x = run->xmax;
+        continue;
+      }
+
       Elevation elev = mTile->get(x, y);
 
       // Skip nodata
@@ -88,7 +324,26 @@ void TreeBuilder::findExtrema() {
         continue;
       }
 
-      mDomainMap.findFlatArea(x, y, &boundary);
+      // Most points are alone in their flat area, and their neighbors
+      // alone say what they are.  The results are the same as below.
+      if (interiorRow && x > 0 && x < width - 1) {
+        uint8 pointClass = mRowClasses[x];
+        if (pointClass == SLOPE_POINT) {
+          mDomainMap.set(x, y, DomainMap::GenericFlatArea);
+          continue;
+        }
+        if (pointClass == PEAK_POINT) {
+          int peakId = mPeaks.size() + 1;
+          mDomainMap.set(x, y, peakId);
+          mPeaks.push_back(Peak(Offsets(x, y), elev));
+          LatLng pos = mTile->latlng(Offsets(x, y));
+          VLOG(2) << "Peak #" << peakId << " at " << x << " " << y
+                  << " at " << pos.latitude() << " " << pos.longitude();
+          continue;
+        }
+      }
+
+      mDomainMap.findFlatArea(x, y, &boundary, &mWalker.flood);
 
       // If no higher boundary points, this is a peak
       if (boundary.higherPoints.empty()) {
@@ -115,42 +370,33 @@ void TreeBuilder::findExtrema() {
       segmentHighPoints.clear();
       int segmentWithHighestPoint = 0;
 
-      // Keeping the vector sorted turns out to be a speed win
+      // Segments are found in order of their lowest point, so sort the
+      // points.  Membership in the boundary is kept in mBoundaryPoints, so
+      // that flood-filling a segment takes time linear in its size, even in
+      // enormous flat areas like lakes.  The boundary may contain
+      // duplicates, which are skipped once their segment has been filled.
       std::sort(boundary.higherPoints.begin(), boundary.higherPoints.end());
-
-      // Remove duplicates -- makes a difference on enormous flat areas
-      int size = (int) boundary.higherPoints.size();
-      if (size > 100) {
-        int to = 0;
-        Offsets::Value last = -1;
-        for (int i = 0; i < size; ++i) {
-          Offsets::Value next = boundary.higherPoints[i];
-          if (last != next) {
-            boundary.higherPoints[to] = next;
-            last = next;
-            to += 1;
-          }
-        }
-        boundary.higherPoints.resize(to);
-      }      
+      for (Offsets::Value value : boundary.higherPoints) {
+        Offsets point(value);
+        mBoundaryPoints.set(point.x(), point.y());
+      }
       
-      while (!boundary.higherPoints.empty()) {
-        // Store high point in segment
-        Offsets higherPoint(*(boundary.higherPoints.begin()));
+      for (Offsets::Value value : boundary.higherPoints) {
+        Offsets higherPoint(value);
+        if (!mBoundaryPoints.get(higherPoint.x(), higherPoint.y())) {
+          continue;  // Already in a segment
+        }
 
-        // "Flood-fill" boundary, finding any higher points connected to this one
+        // "Flood-fill" boundary, finding any higher points connected to this one.
+        // Every point is removed from mBoundaryPoints, leaving it clear for the
+        // next flat area.
         mPendingStack.push(higherPoint);
         Offsets highestPointInSegment = higherPoint;
         Elevation maxHeightInSegment = mTile->get(higherPoint);
         while (!mPendingStack.empty()) {
           Offsets point = mPendingStack.top();
           mPendingStack.pop();
-          // Fast erase from sorted vector, see:
-          // http://stackoverflow.com/questions/26719144/how-to-erase-a-value-efficiently-from-a-sorted-vector
-          auto pr = std::equal_range(boundary.higherPoints.begin(),
-                                     boundary.higherPoints.end(),
-                                     point.value());
-          boundary.higherPoints.erase(pr.first, pr.second);
+          mBoundaryPoints.reset(point.x(), point.y());
           
           if (mTile->get(point) > maxHeightInSegment) {
             highestPointInSegment = point;
@@ -161,9 +407,8 @@ void TreeBuilder::findExtrema() {
           for (int dy = -1; dy <= 1; ++dy) {
             for (int dx = -1; dx <= 1; ++dx) {
               Offsets neighbor(point.x() + dx, point.y() + dy);
-              if (std::binary_search(boundary.higherPoints.begin(),
-                                     boundary.higherPoints.end(),
-                                     neighbor.value())) {
+              if (mTile->isInExtents(neighbor) &&
+                  mBoundaryPoints.get(neighbor.x(), neighbor.y())) {
                 mPendingStack.push(neighbor);
               }
             }
@@ -203,24 +448,18 @@ void TreeBuilder::findExtrema() {
 
           // Mark flat area; only need to do this once, and which saddle ID to use is arbitrary
           if (filledSaddleId == 0) {
-            mDomainMap.fillFlatArea(x, y, saddleId);
+            mDomainMap.fillFlatArea(x, y, saddleId, &mFlatRanges);
             filledSaddleId = saddleId;
           }
 
           PerSaddleInfo info(segmentHighPoints[i], segmentHighPoints[segmentWithHighestPoint]);
 
-          // In an absolutely enormous saddle with tons of segments, it's too slow
-          // to find nice-looking saddle points.  (It's likely that the saddle is near sea level
-          // and has no prominence anyway.)
-          Offsets closePoint(x, y);
-          if (numSegments < 500) {
-            // Try to find a location for the saddle that will look nice.  Put it
-            // in the flat area as close as possible to the midpoint between the boundary
-            // high points.
-            Offsets midpoint((info.rise1.x() + info.rise2.x()) / 2,
-                             (info.rise1.y() + info.rise2.y()) / 2);
-            closePoint = mDomainMap.findClosePointWithValue(midpoint, filledSaddleId);
-          }
+          // Try to find a location for the saddle that will look nice.  Put it
+          // in the flat area as close as possible to the midpoint between the boundary
+          // high points.
+          Offsets midpoint((info.rise1.x() + info.rise2.x()) / 2,
+                           (info.rise1.y() + info.rise2.y()) / 2);
+          Offsets closePoint = DomainMap::findClosePointInRanges(midpoint, mFlatRanges);
           
           Saddle saddle(closePoint, elev);
           mSaddles.push_back(saddle);
@@ -234,6 +473,16 @@ void TreeBuilder::findExtrema() {
 }
 
 void TreeBuilder::findRunoffs() {
+  if (mTileRunoffs != nullptr) {
+    findBandRunoffs();
+    return;
+  }
+  
+  findTileRunoffs(mTile, &mRunoffs);
+  markRunoffsInsidePeakAreas();
+}
+
+void TreeBuilder::findTileRunoffs(const Tile *tile, vector<Runoff> *runoffs) {
   // Walk tile border, going left to right, and top to bottom.  It's important that
   // the directions match in neighboring tiles so that runoffs are found in exactly
   // the same places in overlapping rows and columns.  That would not happen if
@@ -245,14 +494,14 @@ void TreeBuilder::findRunoffs() {
   int dx = 1;
   int dy = 0;
   bool risingOrFlat = false;
-  Elevation elev = mTile->get(x, y);
+  Elevation elev = tile->get(x, y);
   Elevation lastElevation = elev;
   if (elev != Tile::NODATA_ELEVATION) {
-    mRunoffs.push_back(Runoff(Offsets(0, 0), elev, 1));
+    runoffs->push_back(Runoff(Offsets(0, 0), elev, 1));
   }
   
   while (true) {
-    elev = mTile->get(x, y);
+    elev = tile->get(x, y);
 
     if (elev != Tile::NODATA_ELEVATION &&
         (lastElevation == Tile::NODATA_ELEVATION || elev > lastElevation)) {
@@ -262,37 +511,37 @@ void TreeBuilder::findRunoffs() {
                (elev == Tile::NODATA_ELEVATION || elev < lastElevation)) {
       // Fell after a rise: previous point was runoff.
       // 2 neighboring quadrants, because this is along an edge and not at corner.
-      mRunoffs.push_back(Runoff(Offsets(x - dx, y - dy), lastElevation, 2));
+      runoffs->push_back(Runoff(Offsets(x - dx, y - dy), lastElevation, 2));
       risingOrFlat = false;
     }
     lastElevation = elev;
     
     // Always generate runoffs at corners, because there may be a peak
     // or saddle there that involves pixels we haven't even seen yet.
-    if (x == mTile->width() - 1 && y == 0) {  // upper right
+    if (x == tile->width() - 1 && y == 0) {  // upper right
       if (elev != Tile::NODATA_ELEVATION) {
-        mRunoffs.push_back(Runoff(Offsets(x, y), elev, 1));
+        runoffs->push_back(Runoff(Offsets(x, y), elev, 1));
         risingOrFlat = false;
       }
       dx = 0;
       dy = 1;
-    } else if (x == mTile->width() - 1 && y == mTile->height() - 1) {  // lower right
+    } else if (x == tile->width() - 1 && y == tile->height() - 1) {  // lower right
       if (dx == 1) {
         // Hit lower right while traveling right.  Done.
         break;
       }
       if (elev != Tile::NODATA_ELEVATION) {
-        mRunoffs.push_back(Runoff(Offsets(x, y), elev, 1));
+        runoffs->push_back(Runoff(Offsets(x, y), elev, 1));
       }
       risingOrFlat = false;
       x = 0;  // Go back to upper left and go down
       y = 0;
-      lastElevation = mTile->get(0, 0);
+      lastElevation = tile->get(0, 0);
       dx = 0;
       dy = 1;
-    } else if (x == 0 && y == mTile->height() - 1) {  // lower left
+    } else if (x == 0 && y == tile->height() - 1) {  // lower left
       if (elev != Tile::NODATA_ELEVATION) {
-        mRunoffs.push_back(Runoff(Offsets(x, y), elev, 1));
+        runoffs->push_back(Runoff(Offsets(x, y), elev, 1));
         risingOrFlat = false;
       }
       dx = 1;
@@ -302,27 +551,141 @@ void TreeBuilder::findRunoffs() {
     x += dx;
     y += dy;
   }
+}
+
+void TreeBuilder::findBandRunoffs() {
+  // The runoffs along the tile's edges are exactly the ones that
+  // buildDivideTree finds, so that the spliced tree matches its tree.
+  // Those on a seam row are split between the bands above and below it.
+  int lastY = mTile->height() - 1;
+  bool seamAbove = mRowOffset > 0;
+  bool seamBelow = mRowOffset + lastY < mTileHeight - 1;
+  for (const Runoff &runoff : *mTileRunoffs) {
+    int y = runoff.location.y() - mRowOffset;
+    if (y >= 0 && y <= lastY) {
+      int filledQuadrants = runoff.filledQuadrants;
+      if ((y == 0 && seamAbove) || (y == lastY && seamBelow)) {
+        filledQuadrants = 1;
+      }
+      mRunoffs.push_back(Runoff(Offsets(runoff.location.x(), y), runoff.elevation,
+                                filledQuadrants));
+    }
+  }
+
+  // Walk the seam rows the same way the neighboring bands walk them,
+  // so that the runoffs along seams match up
+  if (seamAbove) {
+    findSeamRunoffs(0);
+  }
+  if (seamBelow) {
+    findSeamRunoffs(lastY);
+  }
 
+  markRunoffsInsidePeakAreas();
+}
+
+void TreeBuilder::findSeamRunoffs(int y) {
+  findEdgeRunoffs(mTile, Offsets(0, y), 1, 0, mTile->width(), &mRunoffs);
+
+  // The ends of a seam are corners of both bands.  Like the corners of a
+  // tile, they always need runoffs, because there may be a peak or saddle
+  // there that involves the other band's pixels.  If the tile has no runoff
+  // there, the two bands' runoffs fill all four quadrants between them, so
+  // none is left once they're spliced.
+  int lastX = mTile->width() - 1;
+  for (int x = 0; x <= lastX; x += lastX) {
+    Offsets location(x, y);
+    if (mTile->get(location) == Tile::NODATA_ELEVATION) {
+      continue;
+    }
+    bool found = false;
+    for (const Runoff &runoff : mRunoffs) {
+      if (runoff.location == location) {
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      mRunoffs.push_back(Runoff(location, mTile->get(location), 2));
+    }
+  }
+}
+
+void TreeBuilder::markRunoffsInsidePeakAreas() {
   // Determine if each runoff is within the flat area of a peak
   for (Runoff &runoff : mRunoffs) {
     runoff.insidePeakArea = (mDomainMap.get(runoff.location) > 0);
   }
 }
 
+void TreeBuilder::findEdgeRunoffs(const Tile *tile, Offsets start, int dx, int dy, int length,
+                                  vector<Runoff> *runoffs) {
+  // Same rise and fall test as in findTileRunoffs
+  bool risingOrFlat = false;
+  Elevation lastElevation = tile->get(start);
+  for (int i = 1; i < length; ++i) {
+    int x = start.x() + i * dx;
+    int y = start.y() + i * dy;
+    Elevation elev = tile->get(x, y);
+
+    if (elev != Tile::NODATA_ELEVATION &&
+        (lastElevation == Tile::NODATA_ELEVATION || elev > lastElevation)) {
+      risingOrFlat = true;
+    } else if (risingOrFlat &&
+               (elev == Tile::NODATA_ELEVATION || elev < lastElevation)) {
+      runoffs->push_back(Runoff(Offsets(x - dx, y - dy), lastElevation, 2));
+      risingOrFlat = false;
+    }
+    lastElevation = elev;
+  }
+}
+
+size_t TreeBuilder::memoryBytes() const {
+  size_t walkersBytes = mWalker.memoryBytes();
+  for (const Walker *walker : mExtraWalkers) {
+    walkersBytes += walker->memoryBytes();
+  }
+  return mDomainMap.memoryBytes() + mBoundaryPoints.memoryBytes() +
+    mPeaks.capacity() * sizeof(Peak) +
+    mSaddles.capacity() * sizeof(Saddle) +
+    mRunoffs.capacity() * sizeof(Runoff) +
+    mSaddleInfo.capacity() * sizeof(PerSaddleInfo) +
+    mFlatRanges.capacity() * sizeof(DomainMap::Range) +
+    mFlatRuns.memoryBytes() + walkersBytes +
+    mWalkStarts.capacity() * sizeof(Offsets) +
+    mWalkPeaks.capacity() * sizeof(DomainMap::Pixel);
+}
+
+size_t TreeBuilder::Walker::memoryBytes() const {
+  return boundary.higherPoints.capacity() * sizeof(Offsets::Value) +
+    flood.memoryBytes() +
+    path.capacity() * sizeof(Offsets) +
+    walkedPoints.capacity() * sizeof(Offsets) +
+    walkedPeaks.capacity() * sizeof(DomainMap::Pixel);
+}
+
 DivideTree *TreeBuilder::generateDivideTree() {
-  CoordinateSystem coordinateSystem(mTile->minLatitude(), mTile->minLongitude(),
-                                    mTile->height() - 1,  // Remove overlap with neighbors
-                                    mTile->width() - 1);
-  DivideTree *tree = new DivideTree(coordinateSystem, mPeaks, mSaddles, mRunoffs);
+  DivideTree *tree = new DivideTree(mCoordinateSystem, mPeaks, mSaddles, mRunoffs);
+
+  // Find the peaks above every saddle and runoff first, so that the
+  // walks can be spread over threads
+  mWalkStarts.clear();
+  for (const PerSaddleInfo &info : mSaddleInfo) {
+    mWalkStarts.push_back(info.rise1);
+    mWalkStarts.push_back(info.rise2);
+  }
+  for (const Runoff &runoff : mRunoffs) {
+    mWalkStarts.push_back(runoff.location);
+  }
+  walkAllUpToPeaks();
   
   int saddleIndex = 0;
   for (Saddle &saddle : mSaddles) {
     saddleIndex += 1;
-    const PerSaddleInfo &info = mSaddleInfo[saddleIndex - 1];
-    vector<Offsets> path1 = walkUpToPeak(info.rise1);
-    vector<Offsets> path2 = walkUpToPeak(info.rise2);
+    int peak1 = mWalkPeaks[2 * saddleIndex - 2];
+    int peak2 = mWalkPeaks[2 * saddleIndex - 1];
     
-    if (path1.empty() || path2.empty()) {
+    if (peak1 == 0 || peak2 == 0) {
       LatLng pos = mTile->latlng(saddle.location);
       LOG(ERROR) << "Failed to connect saddle " << saddleIndex << " to peak from "
                  << saddle.location.x() << " " << saddle.location.y() << " "
@@ -331,8 +694,6 @@ DivideTree *TreeBuilder::generateDivideTree() {
       continue;
     }
 
-    int peak1 = mDomainMap.get(path1.back());
-    int peak2 = mDomainMap.get(path2.back());
     if (peak1 == peak2) {
       // This is not really a saddle; skip it
       VLOG(4) << "Got false saddle " << saddleIndex << " for peak " << peak1;
@@ -350,26 +711,31 @@ DivideTree *TreeBuilder::generateDivideTree() {
       mSaddles[basinSaddleId - 1].type = Saddle::Type::BASIN;
     }
   }
+  tree->finishAddingEdges();
   tree->setSaddles(mSaddles);  // We've changed the saddle types
 
   // Add runoffs to divide tree after finding associated peak by uphill walk
   for (int index = 0; index < (int) mRunoffs.size(); ++index) {
     const Runoff &runoff = mRunoffs[index];
-    vector<Offsets> path = walkUpToPeak(runoff.location);
-    if (path.empty()) {
+    int peak = mWalkPeaks[2 * mSaddles.size() + index];
+    if (peak == 0) {
       LatLng pos = mTile->latlng(runoff.location);
       LOG(ERROR) << "Failed to connect runoff " << saddleIndex << " to peak from "
                  << runoff.location.x() << " " << runoff.location.y() << " "
                  << pos.latitude() << " " << pos.longitude();
       continue;
     }
-    int peak = mDomainMap.get(path.back());
     tree->addRunoffEdge(peak, index);
   }
 
   // Delete false saddles
   tree->compact();
 
+  // Convert band coordinates to those of the full tile
+  if (mRowOffset != 0) {
+    tree->offsetLocations(0, mRowOffset);
+  }
+
   if (VLOG_IS_ON(2)) {
     tree->debugPrint();
   }
@@ -398,17 +764,74 @@ DivideTree *TreeBuilder::generateDivideTree() {
   return tree;
 }
 
-vector<Offsets> TreeBuilder::walkUpToPeak(Offsets startPoint) {
-  vector<Offsets> path;
+void TreeBuilder::walkAllUpToPeaks() {
+  int numWalks = (int) mWalkStarts.size();
+  mWalkPeaks.resize(numWalks);
+  if (mNumWalkThreads == 1) {
+    for (int i = 0; i < numWalks; ++i) {
+      mWalkPeaks[i] = walkUpToPeak(mWalkStarts[i], &mWalker);
+      markWalkedPoints(&mWalker);
+    }
+    return;
+  }
+
+  while ((int) mExtraWalkers.size() < mNumWalkThreads - 1) {
+    mExtraWalkers.push_back(new Walker(mDomainMap.width(), mDomainMap.height()));
+  }
+  vector<Walker *> walkers;
+  walkers.push_back(&mWalker);
+  walkers.insert(walkers.end(), mExtraWalkers.begin(),
+                 mExtraWalkers.begin() + (mNumWalkThreads - 1));
+  int numThreads = (int) walkers.size();
+
+  // The domain map isn't changed during a round, so the walks in it can
+  // run in parallel.  The points they walked are marked between rounds.
+  ThreadPool threadPool(numThreads - 1);
+  int roundSize = numThreads * WALKS_PER_THREAD_PER_ROUND;
+  for (int roundStart = 0; roundStart < numWalks; roundStart += roundSize) {
+    int roundEnd = std::min(roundStart + roundSize, numWalks);
+    auto walkShare = [this, &walkers, numThreads, roundStart, roundEnd](int thread) {
+      for (int i = roundStart + thread; i < roundEnd; i += numThreads) {
+        mWalkPeaks[i] = walkUpToPeak(mWalkStarts[i], walkers[thread]);
+      }
+    };
+    
+    vector<std::future<void>> results;
+    for (int thread = 1; thread < numThreads; ++thread) {
+      results.push_back(threadPool.enqueue(walkShare, thread));
+    }
+    walkShare(0);
+    for (auto &&result : results) {
+      result.get();
+    }
+
+    for (Walker *walker : walkers) {
+      markWalkedPoints(walker);
+    }
+  }
+}
+
+void TreeBuilder::markWalkedPoints(Walker *walker) {
+  for (size_t i = 0; i < walker->walkedPoints.size(); ++i) {
+    Offsets point = walker->walkedPoints[i];
+    mDomainMap.set(point.x(), point.y(), walker->walkedPeaks[i]);
+  }
+  walker->walkedPoints.clear();
+  walker->walkedPeaks.clear();
+}
+
+DomainMap::Pixel TreeBuilder::walkUpToPeak(Offsets startPoint, Walker *walker) const {
+  vector<Offsets> &path = walker->path;
+  path.clear();
   
   Offsets point = startPoint;
-  DomainMap::Pixel domainPixel = 0;
+  DomainMap::Pixel peak = 0;
   while (true) {
-    path.push_back(point);
-    domainPixel = mDomainMap.get(point.x(), point.y());
+    DomainMap::Pixel domainPixel = mDomainMap.get(point.x(), point.y());
     
-    // Found a peak?
+    // Found a peak, or a point already known to be in a peak's domain?
     if (domainPixel > 0) {
+      peak = domainPixel;
       break;
     }
     
@@ -419,16 +842,19 @@ vector<Offsets> TreeBuilder::walkUpToPeak(Offsets startPoint) {
       point = getSaddleInfo(domainPixel).rise1;
       continue;
     }
+
+    // Saddles keep their markings; other points join the domain of the
+    // peak we reach
+    path.push_back(point);
     
     // Ascend via steepest neighbor
     Offsets newPoint = findSteepestNeighbor(point);
     if (point == newPoint) {
       // No higher neighbor; need to check boundary of entire flat area
-      DomainMap::Boundary boundary;
-      mDomainMap.findFlatArea(point.x(), point.y(), &boundary);
+      mDomainMap.findFlatArea(point.x(), point.y(), &walker->boundary, &walker->flood);
 
       int highestElevation = mTile->get(point);
-      for (auto value : boundary.higherPoints) {
+      for (auto value : walker->boundary.higherPoints) {
         Offsets neighbor(value);
         if (mTile->get(neighbor) > highestElevation) {
           highestElevation = mTile->get(neighbor);
@@ -443,18 +869,20 @@ vector<Offsets> TreeBuilder::walkUpToPeak(Offsets startPoint) {
                    << " elev " << mTile->get(point) << " at " << pos.latitude() << " " << pos.longitude();
         LOG(ERROR) << "Path length was " << path.size();
         // Indicate badness to caller
-        return vector<Offsets>();
+        return 0;
       }
     }
     
     point = newPoint;
   }
 
-  if (domainPixel != 0) {
-    VLOG(2) << "Found path from saddle to peak " << domainPixel << " of length " << path.size();
-  }
+  // Later walks that cross this one can stop there
+  walker->walkedPoints.insert(walker->walkedPoints.end(), path.begin(), path.end());
+  walker->walkedPeaks.insert(walker->walkedPeaks.end(), path.size(), peak);
+
+  VLOG(2) << "Found path to peak " << peak << " of length " << path.size();
   
-  return path;
+  return peak;
 }
 
 const Saddle &TreeBuilder::getSaddle(DomainMap::Pixel domainPixel) const {
@@ -481,3 +909,45 @@ Offsets TreeBuilder::findSteepestNeighbor(Offsets point) const {
 
   return maxPoint;
 }
+
+TreeBuilderPool::TreeBuilderPool() {
+}
+
+TreeBuilderPool::~TreeBuilderPool() {
+  for (TreeBuilder *builder : mIdleBuilders) {
+    delete builder;
+  }
+}
+
+TreeBuilder *TreeBuilderPool::acquire(const Tile *tile) {
+  TreeBuilder *builder = nullptr;
+  TreeBuilder *unfit = nullptr;
+  mLock.lock();
+  for (auto it = mIdleBuilders.begin(); it != mIdleBuilders.end(); ++it) {
+    if ((*it)->fitsTile(tile)) {
+      builder = *it;
+      mIdleBuilders.erase(it);
+      break;
+    }
+  }
+  if (builder == nullptr && !mIdleBuilders.empty()) {
+    // Free a builder for another size before allocating a new one, so that
+    // the pool doesn't grow when tile sizes vary
+    unfit = mIdleBuilders.back();
+    mIdleBuilders.pop_back();
+  }
+  mLock.unlock();
+
+  delete unfit;
+  if (builder == nullptr) {
+    return new TreeBuilder(tile);
+  }
+  builder->reset(tile);
+  return builder;
+}
+
+void TreeBuilderPool::release(TreeBuilder *builder) {
+  mLock.lock();
+  mIdleBuilders.push_back(builder);
+  mLock.unlock();
+}
@@ -50,7 +50,11 @@
 #include <stack>
 #include <vector>
 #include "primitives.h"
+#include "coordinate_system.h"
 #include "domain_map.h"
+#include "flat_runs.h"
+#include "lock.h"
+#include "pixel_array.h"
 #include "tile.h"
 
 class DivideTree;
@@ -59,10 +63,60 @@ class DivideTree;
 class TreeBuilder {
 public:
   explicit TreeBuilder(const Tile *tile);
+  ~TreeBuilder();
+
+  // Prepare to build the divide tree of another tile, which must have the
+  // same size as the last one, reusing this builder's memory
+  void reset(const Tile *tile);
+
+  // Return true if reset can be called for the given tile
+  bool fitsTile(const Tile *tile) const;
+
+  // Walk uphill from saddles and runoffs on this many threads; default 1.
+  // The tree is the same for any number of threads.
+  void setNumWalkThreads(int numThreads);
 
   DivideTree *buildDivideTree();
+
+  // Memory used while building the divide tree, not counting the tile
+  // itself, in bytes.  Call after buildDivideTree.
+  size_t memoryBytes() const;
+
+  // Build a divide tree for tile equivalent to the one from buildDivideTree,
+  // but split the tile into up to numBands horizontal bands and build a
+  // tree for each band on its own thread.  Neighboring bands share a row,
+  // so their trees have runoffs at the same places along the seam, and
+  // are spliced together by DivideTree::merge just like the trees of
+  // neighboring tiles.  If memoryBytes isn't nullptr, set it to the
+  // total memory used by the bands, including their copies of the tile's
+  // samples.
+  //
+  // The peaks and runoffs are the same as buildDivideTree's, and so are
+  // the peaks' prominences.  Saddles in flat areas that cross a seam may
+  // be placed differently, and where several saddles have the same
+  // elevation, a different one may be kept.
+  static DivideTree *buildDivideTreeInBands(const Tile *tile, int numBands,
+                                            size_t *memoryBytes);
+
+  // Add the runoffs around the border of tile to runoffs, in the order
+  // that buildDivideTree finds them
+  static void findTileRunoffs(const Tile *tile, std::vector<Runoff> *runoffs);
   
 private:
+  // Bands are at least this many rows high
+  static const int MIN_BAND_HEIGHT = 64;
+
+  // With several walk threads, each one takes this many walks at a time
+  // before the points walked are marked in the domain map
+  static const int WALKS_PER_THREAD_PER_ROUND = 1024;
+
+  // Build the tree for a band of a larger tile, starting at the given row.
+  // Locations in the tree are in the larger tile's coordinates.
+  // tileRunoffs are the runoffs around the border of the larger tile,
+  // from findTileRunoffs.
+  TreeBuilder(const Tile *band, const CoordinateSystem &coordinateSystem, int rowOffset,
+              int tileHeight, const std::vector<Runoff> *tileRunoffs);
+
   std::vector<Peak> mPeaks;
   std::vector<Saddle> mSaddles;  // all saddles
   std::vector<Runoff> mRunoffs;
@@ -82,17 +136,96 @@ private:
   std::vector<PerSaddleInfo> mSaddleInfo;
   
   DomainMap mDomainMap;
-  std::stack<Offsets> mPendingStack;  // member var to avoid frequent allocations
+  // Runs of equal samples in mTile, if it has enough of them to be worth
+  // handling as a unit; see FlatRuns::build
+  FlatRuns mFlatRuns;
+  const FlatRuns *mRunsInUse;  // &mFlatRuns, or nullptr if not worth it
+  // Nonzero for points on the boundary of the current flat area whose
+  // segment hasn't been found yet.  Clear between flat areas.
+  PixelBitArray mBoundaryPoints;
+  // Working memory of one thread walking uphill
+  struct Walker {
+    Walker(int width, int height) : flood(width, height) {}
+
+    size_t memoryBytes() const;
+
+    DomainMap::Boundary boundary;
+    DomainMap::FloodScratch flood;
+    std::vector<Offsets> path;  // Points of the current walk
+    // Points walked since they were last marked in the domain map, and
+    // the peaks they lead to
+    std::vector<Offsets> walkedPoints;
+    std::vector<DomainMap::Pixel> walkedPeaks;
+  };
+
+  Walker mWalker;  // Also used by findExtrema
+  std::vector<Walker *> mExtraWalkers;  // One for each extra walk thread
+  int mNumWalkThreads;
+  // Points to walk uphill from: the two rises of each saddle, then the
+  // runoffs.  mWalkPeaks is parallel, with the peaks reached.
+  std::vector<Offsets> mWalkStarts;
+  std::vector<DomainMap::Pixel> mWalkPeaks;
+  // Member vars to avoid frequent allocations
+  std::stack<Offsets, std::vector<Offsets>> mPendingStack;
+  std::vector<DomainMap::Range> mFlatRanges;  // Ranges of the current saddle's flat area
   
   const Tile *mTile;
+  CoordinateSystem mCoordinateSystem;
+  int mRowOffset;  // Row of the full tile that's row 0 of mTile
+  int mTileHeight;  // Height of the full tile
+  const std::vector<Runoff> *mTileRunoffs;  // nullptr unless building a band
+
+  // Classes of interior points that findExtrema can handle without
+  // looking at the whole flat area around them
+  static const uint8 SLOPE_POINT = 0;       // No equal neighbors, higher neighbors all touch
+  static const uint8 PEAK_POINT = 1;        // No equal or higher neighbors
+  static const uint8 FLAT_AREA_POINT = 2;   // Anything else; needs a flood fill
+
+  // Classes of the points of the current row, indexed by x
+  std::vector<uint8> mRowClasses;
+  // For the current row, a bit for each neighbor higher than the point
+  std::vector<uint8> mRowHigherNeighbors;
+  std::vector<uint8> mRowEqualNeighbors;
+
+  // Fill in mRowClasses for the interior points of row y, which must
+  // not be the first or last row.  Points inside runs, after their first
+  // point, are left out, since findExtrema skips them.
+  void classifyRow(int y);
+
+  // Fill in mRowClasses for points minX through maxX - 1 of row y
+  void classifyPoints(int y, int minX, int maxX);
+
+  // Return the class of a point with no equal neighbors, given the bits
+  // of its higher neighbors
+  static uint8 classifyHigherNeighbors(uint8 higherNeighbors);
 
   // Find peaks, saddles, runoffs
   void findExtrema();
   void findRunoffs();
+  void findBandRunoffs();
+  void findSeamRunoffs(int y);
+  void markRunoffsInsidePeakAreas();
+
+  // Add the runoffs found by walking length pixels from start in the
+  // given direction, excluding the first and last pixels
+  static void findEdgeRunoffs(const Tile *tile, Offsets start, int dx, int dy, int length,
+                              std::vector<Runoff> *runoffs);
   
   DivideTree *generateDivideTree();
 
-  std::vector<Offsets> walkUpToPeak(Offsets startPoint);
+  // Fill in mWalkPeaks for mWalkStarts
+  void walkAllUpToPeaks();
+
+  // Return the peak reached by walking uphill from startPoint, or 0 if
+  // there's no way up.  Points on the way are added to walker's
+  // walkedPoints, for markWalkedPoints.
+  DomainMap::Pixel walkUpToPeak(Offsets startPoint, Walker *walker) const;
+
+  // Add the points walker has walked to the domains of their peaks in
+  // mDomainMap, so that later walks crossing them end early.  Any walk
+  // from a given point reaches the same peak, so this saves time without
+  // changing the results.
+  void markWalkedPoints(Walker *walker);
   const Saddle &getSaddle(DomainMap::Pixel domainPixel) const;
   const PerSaddleInfo &getSaddleInfo(DomainMap::Pixel domainPixel) const;
 
@@ -101,4 +234,25 @@ private:
   Offsets findSteepestNeighbor(Offsets point) const;
 };
 
+// Keeps TreeBuilders that are done with one tile, so that their
+// tile-sized buffers can be reused for later tiles of the same size
+// instead of being freed and allocated again.  Safe to use from several
+// threads.
+class TreeBuilderPool {
+public:
+  TreeBuilderPool();
+  ~TreeBuilderPool();
+
+  // Return a builder for the given tile, reusing one from the pool if
+  // there is one of the right size
+  TreeBuilder *acquire(const Tile *tile);
+
+  // Put a builder from acquire back in the pool
+  void release(TreeBuilder *builder);
+
+private:
+  Lock mLock;
+  std::vector<TreeBuilder *> mIdleBuilders;  // Protected by mLock
+};
+
 #endif  // _TREE_BUILDER_H_
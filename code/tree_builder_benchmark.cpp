@@ -0,0 +1,178 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// A tool to measure how long it takes to build the divide tree of a
+// synthetic tile dominated by one enormous flat area: a lake dotted
+// with islands, each of which splits the lake's shoreline into another
+// segment.  This is the worst case for finding saddles in flat areas.
+
+#include "divide_tree.h"
+#include "tile.h"
+#include "tree_builder.h"
+
+#include "easylogging++.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef PLATFORM_WINDOWS
+#include "getopt-win.h"
+#endif
+
+INITIALIZE_EASYLOGGINGPP
+
+static void usage() {
+  printf("Usage:\n");
+  printf("  tree_builder_benchmark\n");
+  printf("\n");
+  printf("  Options:\n");
+  printf("  -s side_length    Samples on each side of the tile, default = 3601\n");
+  printf("  -l islands        Number of islands in the lake, default = 10000\n");
+  printf("  -n iterations     Number of times to build the tree, default = 3\n");
+  printf("  -r seed           Random seed for island placement, default = 1\n");
+  printf("  -w num_threads    Threads walking uphill from saddles, default = 1\n");
+  exit(1);
+}
+
+static const Elevation LAKE_ELEVATION = 100;
+
+// Smooth hills everywhere outside the lake, high enough to never reach
+// the lake's level.  The lake is a disc in the middle of the tile with a
+// wavy shoreline, with small islands scattered over it.
+static Tile *createLakeTile(int sideLength, int numIslands, unsigned seed) {
+  Elevation *samples = (Elevation *) malloc(sizeof(Elevation) * sideLength * sideLength);
+  float center = (sideLength - 1) / 2.0f;
+  float radius = 0.45f * sideLength;
+  for (int y = 0; y < sideLength; ++y) {
+    for (int x = 0; x < sideLength; ++x) {
+      float dx = x - center;
+      float dy = y - center;
+      float shore = radius * (1 + 0.05f * sinf(12 * atan2f(dy, dx)));
+      Elevation elev;
+      if (dx * dx + dy * dy < shore * shore) {
+        elev = LAKE_ELEVATION;
+      } else {
+        elev = (Elevation) (LAKE_ELEVATION + 400 + 150 * (sinf(x * 0.05f) + cosf(y * 0.07f)));
+      }
+      samples[y * sideLength + x] = elev;
+    }
+  }
+
+  // Islands are low cones a few samples across
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> angleDistribution(0, 2 * (float) M_PI);
+  std::uniform_real_distribution<float> fractionDistribution(0, 0.9f);
+  std::uniform_int_distribution<int> sizeDistribution(1, 4);
+  for (int i = 0; i < numIslands; ++i) {
+    float angle = angleDistribution(random);
+    float distance = radius * sqrtf(fractionDistribution(random));
+    int cx = (int) (center + distance * cosf(angle));
+    int cy = (int) (center + distance * sinf(angle));
+    int islandRadius = sizeDistribution(random);
+    for (int y = cy - islandRadius; y <= cy + islandRadius; ++y) {
+      for (int x = cx - islandRadius; x <= cx + islandRadius; ++x) {
+        int height = islandRadius + 1 - std::max(abs(x - cx), abs(y - cy));
+        Elevation *sample = &samples[y * sideLength + x];
+        *sample = std::max(*sample, (Elevation) (LAKE_ELEVATION + 10 * height));
+      }
+    }
+  }
+
+  return Tile::createOneDegreeTile(0, 0, sideLength, 3600.0f / (sideLength - 1), samples);
+}
+
+int main(int argc, char **argv) {
+  int sideLength = 3601;
+  int numIslands = 10000;
+  int numIterations = 3;
+  unsigned seed = 1;
+  int numWalkThreads = 1;
+
+  // Parse options
+  START_EASYLOGGINGPP(argc, argv);
+  int ch;
+  while ((ch = getopt(argc, argv, "l:n:r:s:w:")) != -1) {
+    switch (ch) {
+    case 'l':
+      numIslands = atoi(optarg);
+      break;
+
+    case 'n':
+      numIterations = atoi(optarg);
+      break;
+
+    case 'r':
+      seed = (unsigned) atoi(optarg);
+      break;
+
+    case 's':
+      sideLength = atoi(optarg);
+      break;
+
+    case 'w':
+      numWalkThreads = atoi(optarg);
+      break;
+
+    default:
+      usage();
+    }
+  }
+
+  argc -= optind;
+  if (argc != 0 || sideLength < 16 || numIslands < 0 || numIterations < 1 ||
+      numWalkThreads < 1) {
+    usage();
+  }
+
+  Tile *tile = createLakeTile(sideLength, numIslands, seed);
+
+  // Like prominence, reuse builders, so that passes after the first
+  // don't allocate their buffers again
+  TreeBuilderPool pool;
+  double totalSeconds = 0;
+  for (int i = 0; i < numIterations; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    TreeBuilder *builder = pool.acquire(tile);
+    builder->setNumWalkThreads(numWalkThreads);
+    DivideTree *divideTree = builder->buildDivideTree();
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    totalSeconds += seconds;
+
+    printf("Pass %d: %.3f s, %d peaks, %d saddles, %d runoffs, %.1f MB\n", i + 1, seconds,
+           (int) divideTree->peaks().size(), (int) divideTree->saddles().size(),
+           (int) divideTree->runoffs().size(), builder->memoryBytes() / (1024.0 * 1024));
+    delete divideTree;
+    pool.release(builder);
+  }
+
+  printf("%dx%d samples, %d islands: %.3f s per build\n",
+         sideLength, sideLength, numIslands, totalSeconds / numIterations);
+
+  delete tile;
+  return 0;
+}
@@ -36,14 +36,6 @@
 
 using std::string;
 
-float feetToMeters(float feet) {
-  return feet * 0.3048f;
-}
-
-float metersToFeet(float meters) {
-  return meters / 0.3048f;
-}
-
 string trim(const string &s) {
   static const std::string whitespace = " \t\f\v\n\r";
   std::size_t start = s.find_first_not_of(whitespace);
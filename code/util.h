@@ -30,8 +30,14 @@
 #include <map>
 #include <unordered_set>
 
-float feetToMeters(float feet);
-float metersToFeet(float meters);
+// Inline so that loops converting whole tiles can be vectorized
+inline float feetToMeters(float feet) {
+  return feet * 0.3048f;
+}
+
+inline float metersToFeet(float meters) {
+  return meters / 0.3048f;
+}
 
 // Trim whitespace from the start and end of the string, return a new string
 std::string trim(const std::string &s);
@@ -82,4 +88,20 @@ void removeVectorElementsByIndices(std::vector<T> *vec, const std::unordered_set
   vec->erase(vec->begin() + to, vec->end());  // adjust size
 }
 
+// Remove all elements of vec whose entries in deleted are true.
+template <typename T>
+void removeVectorElementsByIndices(std::vector<T> *vec, const std::vector<bool> &deleted) {
+  int to = 0;
+  for (int from = 0; from < (int) vec->size(); ++from) {
+    if (!deleted[from]) {
+      if (from != to) {
+        (*vec)[to] = (*vec)[from];
+      }
+      to += 1;
+    }
+  }
+
+  vec->erase(vec->begin() + to, vec->end());  // adjust size
+}
+
 #endif  // ifndef _UTIL_H__
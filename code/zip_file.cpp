@@ -0,0 +1,193 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "zip_file.h"
+#include "easylogging++.h"
+
+#include <algorithm>
+#include <string.h>
+
+using std::string;
+
+static const uint32 LOCAL_HEADER_SIGNATURE = 0x04034b50;
+static const uint32 CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+static const uint32 END_OF_DIRECTORY_SIGNATURE = 0x06054b50;
+
+static const int LOCAL_HEADER_SIZE = 30;
+static const int CENTRAL_HEADER_SIZE = 46;
+static const int END_OF_DIRECTORY_SIZE = 22;
+
+static const uint16 METHOD_STORED = 0;
+static const uint16 METHOD_DEFLATED = 8;
+
+static const uint16 FLAG_ENCRYPTED = 0x0001;
+
+// Zip files are little-endian
+static uint16 readUint16(const uint8 *p) {
+  return (uint16) (p[0] | (p[1] << 8));
+}
+
+static uint32 readUint32(const uint8 *p) {
+  return ((uint32) p[0]) | ((uint32) p[1] << 8) | ((uint32) p[2] << 16) | ((uint32) p[3] << 24);
+}
+
+ZipEntryReader::ZipEntryReader(const uint8 *data, size_t compressedSize,
+                               uint64 uncompressedSize, bool compressed) {
+  mData = data;
+  mUncompressedSize = uncompressedSize;
+  mBytesRead = 0;
+  mInflater = compressed ? new Inflater(data, compressedSize) : nullptr;
+  mFailed = false;
+}
+
+ZipEntryReader::~ZipEntryReader() {
+  delete mInflater;
+}
+
+size_t ZipEntryReader::read(void *buf, size_t len) {
+  len = (size_t) std::min((uint64) len, mUncompressedSize - mBytesRead);
+
+  size_t numRead = len;
+  if (mInflater == nullptr) {
+    memcpy(buf, mData + mBytesRead, len);
+  } else {
+    numRead = mInflater->read(static_cast<uint8 *>(buf), len);
+    if (numRead < len) {
+      mFailed = true;
+    }
+  }
+
+  mBytesRead += numRead;
+  return numRead;
+}
+
+bool ZipEntryReader::failed() const {
+  return mFailed || (mInflater != nullptr && mInflater->failed());
+}
+
+bool ZipFile::open(const string &filename) {
+  mFilename = filename;
+  mEntries.clear();
+  if (!mFile.open(filename)) {
+    return false;
+  }
+
+  const uint8 *data = static_cast<const uint8 *>(mFile.data());
+  size_t size = mFile.size();
+
+  // Find end of central directory record, which is followed by a
+  // variable-length comment of at most 64K
+  if (size < (size_t) END_OF_DIRECTORY_SIZE) {
+    LOG(ERROR) << "Zip file " << filename << " is too small";
+    return false;
+  }
+  size_t minPos = (size > 0xffff + END_OF_DIRECTORY_SIZE) ?
+      size - 0xffff - END_OF_DIRECTORY_SIZE : 0;
+  size_t pos = size - END_OF_DIRECTORY_SIZE;
+  while (readUint32(data + pos) != END_OF_DIRECTORY_SIGNATURE) {
+    if (pos == minPos) {
+      LOG(ERROR) << "Couldn't find zip directory in " << filename;
+      return false;
+    }
+    pos -= 1;
+  }
+
+  int numEntries = readUint16(data + pos + 10);
+  size_t directoryOffset = readUint32(data + pos + 16);
+
+  // Read central directory
+  pos = directoryOffset;
+  for (int i = 0; i < numEntries; ++i) {
+    if (pos + CENTRAL_HEADER_SIZE > size ||
+        readUint32(data + pos) != CENTRAL_HEADER_SIGNATURE) {
+      LOG(ERROR) << "Corrupt zip directory in " << filename;
+      return false;
+    }
+
+    uint16 flags = readUint16(data + pos + 8);
+    Entry entry;
+    entry.method = readUint16(data + pos + 10);
+    entry.compressedSize = readUint32(data + pos + 20);
+    entry.uncompressedSize = readUint32(data + pos + 24);
+    int nameLength = readUint16(data + pos + 28);
+    int extraLength = readUint16(data + pos + 30);
+    int commentLength = readUint16(data + pos + 32);
+    entry.localHeaderOffset = readUint32(data + pos + 42);
+
+    if (pos + CENTRAL_HEADER_SIZE + nameLength > size) {
+      LOG(ERROR) << "Corrupt zip directory in " << filename;
+      return false;
+    }
+    string name(reinterpret_cast<const char *>(data + pos + CENTRAL_HEADER_SIZE), nameLength);
+    
+    if (flags & FLAG_ENCRYPTED) {
+      VLOG(2) << "Skipping encrypted zip entry " << name;
+    } else {
+      mEntries[name] = entry;
+    }
+
+    pos += CENTRAL_HEADER_SIZE + nameLength + extraLength + commentLength;
+  }
+
+  return true;
+}
+
+ZipEntryReader *ZipFile::openEntry(const string &name) const {
+  auto it = mEntries.find(name);
+  if (it == mEntries.end()) {
+    VLOG(1) << "No entry " << name << " in zip file " << mFilename;
+    return nullptr;
+  }
+  const Entry &entry = it->second;
+
+  if (entry.method != METHOD_STORED && entry.method != METHOD_DEFLATED) {
+    LOG(ERROR) << "Unsupported compression method " << entry.method << " for "
+               << name << " in " << mFilename;
+    return nullptr;
+  }
+  if (entry.compressedSize == 0xffffffff || entry.uncompressedSize == 0xffffffff ||
+      entry.localHeaderOffset == 0xffffffff) {
+    LOG(ERROR) << "Zip64 entry " << name << " in " << mFilename << " is not supported";
+    return nullptr;
+  }
+
+  // Data follows the local header, whose variable-length fields may
+  // differ from those in the central directory
+  const uint8 *data = static_cast<const uint8 *>(mFile.data());
+  size_t size = mFile.size();
+  size_t pos = entry.localHeaderOffset;
+  if (pos + LOCAL_HEADER_SIZE > size || readUint32(data + pos) != LOCAL_HEADER_SIGNATURE) {
+    LOG(ERROR) << "Corrupt local header for " << name << " in " << mFilename;
+    return nullptr;
+  }
+  size_t dataOffset = pos + LOCAL_HEADER_SIZE + readUint16(data + pos + 26) +
+      readUint16(data + pos + 28);
+  if (dataOffset + entry.compressedSize > size) {
+    LOG(ERROR) << "Truncated data for " << name << " in " << mFilename;
+    return nullptr;
+  }
+  
+  return new ZipEntryReader(data + dataOffset, (size_t) entry.compressedSize,
+                            entry.uncompressedSize, entry.method == METHOD_DEFLATED);
+}
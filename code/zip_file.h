@@ -0,0 +1,93 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2017 Andrew Kirmse
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Read-only access to the entries of a zip archive, without extracting
+ * them to disk.  Entries may be stored or DEFLATE-compressed.  Zip64
+ * archives and encrypted entries are not supported.
+ */
+
+#ifndef _ZIP_FILE_H_
+#define _ZIP_FILE_H_
+
+#include "inflater.h"
+#include "mapped_file.h"
+#include "primitives.h"
+
+#include <string>
+#include <unordered_map>
+
+// Streams the uncompressed contents of one zip entry
+class ZipEntryReader {
+public:
+  ~ZipEntryReader();
+
+  // Read up to len bytes of uncompressed data into buf.  Returns the
+  // number of bytes read, which is less than len only at the end of
+  // the entry or on error.
+  size_t read(void *buf, size_t len);
+
+  // true if the entry's data was found to be corrupt
+  bool failed() const;
+
+  uint64 uncompressedSize() const { return mUncompressedSize; }
+
+private:
+  friend class ZipFile;
+
+  ZipEntryReader(const uint8 *data, size_t compressedSize, uint64 uncompressedSize,
+                 bool compressed);
+
+  const uint8 *mData;
+  uint64 mUncompressedSize;
+  uint64 mBytesRead;
+  Inflater *mInflater;  // nullptr for stored entries
+  bool mFailed;
+};
+
+class ZipFile {
+public:
+  // Map the given zip file and read its directory.  Returns false
+  // if the file can't be opened or isn't a valid zip file.
+  bool open(const std::string &filename);
+
+  // Return a reader for the entry with the given name, or nullptr if there
+  // is no such entry or it can't be read.  Caller owns the reader, which
+  // must not outlive this object.
+  ZipEntryReader *openEntry(const std::string &name) const;
+
+private:
+  struct Entry {
+    uint16 method;
+    uint64 compressedSize;
+    uint64 uncompressedSize;
+    uint64 localHeaderOffset;
+  };
+
+  std::string mFilename;
+  MappedFile mFile;
+  std::unordered_map<std::string, Entry> mEntries;
+};
+
+#endif  // _ZIP_FILE_H_